@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <limits.h>
 #include <string.h>
 #include <strings.h>
 #include <time.h>
@@ -87,6 +88,7 @@ static retro_input_poll_t input_poll_cb;
 static retro_input_state_t input_state_cb;
 static retro_environment_t environ_cb;
 static retro_audio_sample_batch_t audio_batch_cb;
+static struct retro_perf_callback perf_cb;
 static retro_set_rumble_state_t rumble_cb;
 static struct retro_log_callback logging;
 static retro_log_printf_t log_cb;
@@ -133,6 +135,10 @@ static unsigned frameskip_threshold             = 0;
 static unsigned frameskip_interval              = 0;
 static unsigned frameskip_counter               = 0;
 
+static int runahead_frames;
+static int runahead_valid;
+static int runahead_mute;
+
 static int retro_audio_buff_active              = false;
 static unsigned retro_audio_buff_occupancy      = 0;
 static int retro_audio_buff_underrun            = false;
@@ -775,6 +781,13 @@ void pl_timing_prepare(int is_pal)
 {
 }
 
+/* input is read before every retro_run(), late polling is up to the frontend */
+int in_latch_pending;
+
+void pl_input_latch(void)
+{
+}
+
 void plat_trigger_vibrate(int pad, int low, int high)
 {
    if (!rumble_cb)
@@ -824,13 +837,30 @@ void pl_gun_byte2(int port, unsigned char byte)
    }
 }
 
+// back to the real state, before something that shouldn't be redone
+static void runahead_drop(void)
+{
+   if (runahead_valid)
+      LoadStateSnapshot();
+   runahead_valid = 0;
+}
+
 /* sound calls */
 static void snd_feed(void *buf, int bytes)
 {
-   if (audio_batch_cb != NULL)
+   if (audio_batch_cb != NULL && !runahead_mute)
       audio_batch_cb(buf, bytes / 4);
 }
 
+/* for the spu's rate control, known once the buffer status
+ * callback is in use */
+static int snd_fill(void)
+{
+   if (!retro_audio_buff_active)
+      return -1;
+   return retro_audio_buff_occupancy;
+}
+
 void out_register_libretro(struct out_driver *drv)
 {
    drv->name   = "libretro";
@@ -838,6 +868,7 @@ void out_register_libretro(struct out_driver *drv)
    drv->finish = snd_finish;
    drv->busy   = snd_busy;
    drv->feed   = snd_feed;
+   drv->fill   = snd_fill;
 }
 
 #define RETRO_DEVICE_PSE_STANDARD         RETRO_DEVICE_SUBCLASS(RETRO_DEVICE_JOYPAD,   0)
@@ -965,7 +996,10 @@ static bool update_option_visibility(void)
             "pcsx_rearmed_gpu_peops_lazy_screen_update",
             "pcsx_rearmed_gpu_peops_repeated_triangles",
             "pcsx_rearmed_gpu_peops_quads_with_triangles",
-            "pcsx_rearmed_gpu_peops_fake_busy_state"
+            "pcsx_rearmed_gpu_peops_fake_busy_state",
+#ifdef GPU_PEOPS_THREADS
+            "pcsx_rearmed_gpu_peops_threaded",
+#endif
          };
 
          option_display.visible = show_advanced_gpu_peops_settings;
@@ -1007,6 +1041,9 @@ static bool update_option_visibility(void)
             "pcsx_rearmed_gpu_unai_skipline",
             "pcsx_rearmed_gpu_unai_lighting",
             "pcsx_rearmed_gpu_unai_fast_lighting",
+#ifdef GPU_UNAI_THREADS
+            "pcsx_rearmed_gpu_unai_threaded",
+#endif
          };
 
          option_display.visible = show_advanced_gpu_unai_settings;
@@ -1289,6 +1326,9 @@ static void save_close(void *file)
 bool retro_serialize(void *data, size_t size)
 {
    int ret;
+   // the running state is some frames ahead, save the real one
+   if (runahead_valid)
+      LoadStateSnapshot();
    CdromFrontendId = disk_current_index;
    ret = SaveState(data);
    return ret == 0 ? true : false;
@@ -1300,6 +1340,7 @@ bool retro_unserialize(const void *data, size_t size)
 {
    int ret;
    CdromFrontendId = -1;
+   runahead_valid = 0;
    ret = LoadState(data);
    if (ret)
       return false;
@@ -1429,6 +1470,7 @@ static bool disk_set_eject_state(bool ejected)
 {
    if (ejected != disk_ejected)
       SysPrintf("new eject_state: %d\n", ejected);
+   runahead_drop();
 
    // weird PCSX API...
    SetCdOpenCaseTime(ejected ? -1 : (time(NULL) + 2));
@@ -1463,6 +1505,7 @@ static bool disk_set_image_index(unsigned int index)
 {
    if (index >= sizeof(disks) / sizeof(disks[0]))
       return false;
+   runahead_drop();
 
    CdromId[0] = '\0';
    CdromLabel[0] = '\0';
@@ -1780,18 +1823,41 @@ static void retro_audio_buff_status_cb(
    retro_audio_buff_underrun  = underrun_likely;
 }
 
+/* For gpulib's frameskip cost model: how long the next frame may take
+ * before the audio buffer drops below the threshold ('auto' uses 0) */
+static int fskip_slack_us(void)
+{
+   int frame_us = (int)(1000000.0 / psxGetFps());
+   int threshold = frameskip_type == FRAMESKIP_AUTO_THRESHOLD ?
+      frameskip_threshold : 0;
+
+   if (!retro_audio_buff_active)
+      return frame_us;
+   if (retro_audio_buff_underrun)
+      return -frame_us;
+   return frame_us + ((int)retro_audio_buff_occupancy - threshold)
+      * (int)retro_audio_latency * 10;
+}
+
+static long long lr_get_usec(void)
+{
+   return perf_cb.get_time_usec();
+}
+
 static void retro_set_audio_buff_status_cb(void)
 {
-   if (frameskip_type == FRAMESKIP_NONE)
+   if (frameskip_type == FRAMESKIP_NONE && !spu_config.iRateControl)
    {
       environ_cb(RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK, NULL);
       retro_audio_latency = 0;
    }
    else
    {
-      bool calculate_audio_latency = true;
+      /* rate control alone only needs the buffer status */
+      bool calculate_audio_latency = frameskip_type != FRAMESKIP_NONE;
 
-      if (frameskip_type == FRAMESKIP_FIXED_INTERVAL)
+      retro_audio_latency = 0;
+      if (frameskip_type == FRAMESKIP_FIXED_INTERVAL && !spu_config.iRateControl)
          environ_cb(RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK, NULL);
       else
       {
@@ -1847,6 +1913,7 @@ bool retro_load_game(const struct retro_game_info *info)
    size_t i;
    unsigned int cd_index = 0;
    bool is_m3u, is_exe;
+   const char *dir;
    int ret;
 
    struct retro_input_descriptor desc[] = {
@@ -1920,6 +1987,10 @@ bool retro_load_game(const struct retro_game_info *info)
 
    extract_directory(base_dir, info->path, sizeof(base_dir));
 
+   // cd read-ahead learns what games load and keeps it there
+   if (environ_cb(RETRO_ENVIRONMENT_GET_SAVE_DIRECTORY, &dir) && dir)
+      cdra_set_hint_dir(dir);
+
    if (is_m3u)
    {
       if (!read_m3u(info->path))
@@ -2109,6 +2180,7 @@ void retro_reset(void)
 {
    //hack to prevent retroarch freezing when reseting in the menu but not while running with the hot key
    rebootemu = 1;
+   runahead_valid = 0;
    //SysReset();
 }
 
@@ -2150,6 +2222,7 @@ static void update_variables(bool in_flight)
    int gpu_peops_fix = GPU_PEOPS_OLD_FRAME_SKIP;
 #endif
    frameskip_type_t prev_frameskip_type;
+   int prev_rate_control = spu_config.iRateControl;
    double old_fps = psxGetFps();
 
    var.value = NULL;
@@ -2169,7 +2242,18 @@ static void update_variables(bool in_flight)
          frameskip_type = FRAMESKIP_FIXED_INTERVAL;
    }
 
-   if (frameskip_type != 0)
+   var.value = NULL;
+   var.key = "pcsx_rearmed_runahead";
+   runahead_frames = 0;
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      runahead_frames = atoi(var.value);
+   if (runahead_frames == 0) {
+      runahead_drop();
+      FreeStateSnapshot();
+   }
+
+   // run-ahead uses gpulib's frameskip to not draw the hidden frames
+   if (frameskip_type != 0 || runahead_frames)
       pl_rearmed_cbs.frameskip = -1;
    
    var.value = NULL;
@@ -2374,6 +2458,13 @@ static void update_variables(bool in_flight)
    {
       cdra_set_buf_count(strtol(var.value, NULL, 10));
    }
+
+   var.value = NULL;
+   var.key = "pcsx_rearmed_cd_resident";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      cdra_set_resident(strcmp(var.value, "enabled") == 0);
+   }
 #endif
 
    //
@@ -2398,6 +2489,9 @@ static void update_variables(bool in_flight)
       else if (strcmp(var.value, "enabled") == 0)
          Config.Cpu = CPU_DYNAREC;
 
+      if (((Config.Cpu == CPU_INTERPRETER) ? &psxInt : &psxRec) != prev_cpu)
+         // back to the real state while the old core is still in use
+         runahead_drop();
       psxCpu = (Config.Cpu == CPU_INTERPRETER) ? &psxInt : &psxRec;
       if (psxCpu != prev_cpu)
       {
@@ -2445,6 +2539,26 @@ static void update_variables(bool in_flight)
          ndrc_g.hacks &= ~NDHACK_NO_SMC_CHECK;
    }
 
+   var.value = NULL;
+   var.key = "pcsx_rearmed_smc_mprotect";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (strcmp(var.value, "enabled") == 0)
+         ndrc_g.hacks |= NDHACK_SMC_MPROTECT;
+      else
+         ndrc_g.hacks &= ~NDHACK_SMC_MPROTECT;
+   }
+
+   var.value = NULL;
+   var.key = "pcsx_rearmed_superblocks";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (strcmp(var.value, "enabled") == 0)
+         ndrc_g.hacks |= NDHACK_SUPERBLOCKS;
+      else
+         ndrc_g.hacks &= ~NDHACK_SUPERBLOCKS;
+   }
+
    var.value = NULL;
    var.key = "pcsx_rearmed_gteregsunneeded";
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
@@ -2486,6 +2600,16 @@ static void update_variables(bool in_flight)
          Config.DisableStalls = 0;
    }
 
+   var.value = NULL;
+   var.key = "pcsx_rearmed_idle_skip";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (strcmp(var.value, "enabled") == 0)
+         Config.IdleSkip = 1;
+      else
+         Config.IdleSkip = 0;
+   }
+
    var.value = NULL;
    var.key = "pcsx_rearmed_icache_emulation";
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
@@ -2537,6 +2661,15 @@ static void update_variables(bool in_flight)
          spu_config.iUseInterpolation = 0;
    }
 
+   var.value = NULL;
+   var.key = "pcsx_rearmed_spu_rate_control";
+   spu_config.iRateControl = 0;
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (strcmp(var.value, "enabled") == 0)
+         spu_config.iRateControl = 1;
+   }
+
 #if P_HAVE_PTHREAD
    var.value = NULL;
    var.key = "pcsx_rearmed_spu_thread";
@@ -2739,6 +2872,19 @@ static void update_variables(bool in_flight)
 
    if (pl_rearmed_cbs.gpu_peops.dwActFixes != gpu_peops_fix)
       pl_rearmed_cbs.gpu_peops.dwActFixes = gpu_peops_fix;
+
+#ifdef GPU_PEOPS_THREADS
+   var.key = "pcsx_rearmed_gpu_peops_threaded";
+   var.value = NULL;
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (strcmp(var.value, "disabled") == 0)
+         pl_rearmed_cbs.gpu_peops.threaded = 0;
+      else if (strcmp(var.value, "enabled") == 0)
+         pl_rearmed_cbs.gpu_peops.threaded = 1;
+   }
+#endif
 #endif
 
 #ifdef GPU_UNAI
@@ -2802,6 +2948,19 @@ static void update_variables(bool in_flight)
       else if (strcmp(var.value, "enabled") == 0)
          pl_rearmed_cbs.gpu_unai.blending = 1;
    }
+
+#ifdef GPU_UNAI_THREADS
+   var.key = "pcsx_rearmed_gpu_unai_threaded";
+   var.value = NULL;
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (strcmp(var.value, "disabled") == 0)
+         pl_rearmed_cbs.gpu_unai.threaded = 0;
+      else if (strcmp(var.value, "enabled") == 0)
+         pl_rearmed_cbs.gpu_unai.threaded = 1;
+   }
+#endif
 #endif // GPU_UNAI
 
    var.value = NULL;
@@ -2931,7 +3090,8 @@ static void update_variables(bool in_flight)
       }
 
       /* Reinitialise frameskipping, if required */
-      if (((frameskip_type     != prev_frameskip_type)))
+      if (((frameskip_type     != prev_frameskip_type))
+          || spu_config.iRateControl != prev_rate_control)
          retro_set_audio_buff_status_cb();
 
       /* dfinput_activate(); */
@@ -3299,9 +3459,17 @@ static void print_internal_fps(void)
 #if !defined(DRC_DISABLE) && !defined(LIGHTREC)
             if (ndrc_g.did_compile) {
                pos = snprintf(str, sizeof(str), "DRC: %d ", ndrc_g.did_compile);
-               ndrc_g.did_compile = 0;
+               if (ndrc_g.did_recompile)
+                  pos += snprintf(str + pos, sizeof(str) - pos, "(%d re) ",
+                        ndrc_g.did_recompile);
+               ndrc_g.did_compile = ndrc_g.did_recompile = 0;
             }
 #endif
+            if (pl_rearmed_cbs.fskip.predicted) {
+               pos += snprintf(str + pos, sizeof(str) - pos, "Skip: %u/%u ",
+                     pl_rearmed_cbs.fskip.skipped, pl_rearmed_cbs.fskip.predicted);
+               pl_rearmed_cbs.fskip.skipped = pl_rearmed_cbs.fskip.predicted = 0;
+            }
             cd_count = cdra_get_buf_count();
             if (cd_count) {
                pos += snprintf(str + pos, sizeof(str) - pos, "CD: %2d/%d ",
@@ -3339,8 +3507,44 @@ static void print_internal_fps(void)
    }
 }
 
+/* Run-ahead: the frame that counts is emulated from the state the
+ * previous call left, then a snapshot is taken and 'frames' more are
+ * run with the same input. Only the last of those is drawn and none
+ * of them are heard. The next call goes back to the snapshot. */
+static void run_ahead(int frames)
+{
+   int fskip_force = pl_rearmed_cbs.fskip_force;
+   int i;
+
+   if (runahead_valid)
+      LoadStateSnapshot();
+
+   // gpulib decides at each flip whether the next frame is drawn
+   runahead_mute = 0;
+   pl_rearmed_cbs.fskip_force = fskip_force || frames > 1;
+   psxRegs.stop = 0;
+   psxCpu->Execute(&psxRegs);
+
+   runahead_valid = SaveStateSnapshot() == 0;
+   // the spu thread's last samples are only done now, play them
+   SPU_async(psxRegs.cycle, 1);
+   if (!runahead_valid)
+      return;
+
+   runahead_mute = 1;
+   for (i = 1; i <= frames; i++)
+   {
+      pl_rearmed_cbs.fskip_force = fskip_force || i < frames - 1;
+      psxRegs.stop = 0;
+      psxCpu->Execute(&psxRegs);
+   }
+   runahead_mute = 0;
+}
+
 void retro_run(void)
 {
+   long long busy_start;
+
    //SysReset must be run while core is running,Not in menu (Locks up Retroarch)
    if (rebootemu != 0)
    {
@@ -3357,6 +3561,7 @@ void retro_run(void)
     * be skipped */
    pl_rearmed_cbs.fskip_force = 0;
    pl_rearmed_cbs.fskip_dirty = 0;
+   pl_rearmed_cbs.fskip.slack_us = INT_MAX;
 
    if (frameskip_type != FRAMESKIP_NONE)
    {
@@ -3365,10 +3570,15 @@ void retro_run(void)
       switch (frameskip_type)
       {
          case FRAMESKIP_AUTO:
-            skip_frame = retro_audio_buff_active && retro_audio_buff_underrun;
-            break;
          case FRAMESKIP_AUTO_THRESHOLD:
-            skip_frame = retro_audio_buff_active && (retro_audio_buff_occupancy < frameskip_threshold);
+            // the whole run-ahead batch has to fit
+            if (pl_rearmed_cbs.fskip.get_usec)
+               pl_rearmed_cbs.fskip.slack_us =
+                  fskip_slack_us() / (1 + runahead_frames);
+            else if (frameskip_type == FRAMESKIP_AUTO)
+               skip_frame = retro_audio_buff_active && retro_audio_buff_underrun;
+            else
+               skip_frame = retro_audio_buff_active && (retro_audio_buff_occupancy < frameskip_threshold);
             break;
          case FRAMESKIP_FIXED_INTERVAL:
             skip_frame = true;
@@ -3401,8 +3611,16 @@ void retro_run(void)
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &updated) && updated)
       update_variables(true);
 
-   psxRegs.stop = 0;
-   psxCpu->Execute(&psxRegs);
+   busy_start = pl_rearmed_cbs.fskip.get_usec ? lr_get_usec() : 0;
+   if (runahead_frames)
+      run_ahead(runahead_frames);
+   else
+   {
+      psxRegs.stop = 0;
+      psxCpu->Execute(&psxRegs);
+   }
+   if (busy_start)
+      pl_rearmed_cbs.fskip.busy_us += lr_get_usec() - busy_start;
 
    if (pl_rearmed_cbs.fskip_dirty == 1) {
       if (frameskip_counter < frameskip_interval)
@@ -3647,6 +3865,10 @@ void retro_init(void)
    msg_interface_version = 0;
    environ_cb(RETRO_ENVIRONMENT_GET_MESSAGE_INTERFACE_VERSION, &msg_interface_version);
 
+   if (environ_cb(RETRO_ENVIRONMENT_GET_PERF_INTERFACE, &perf_cb)
+       && perf_cb.get_time_usec)
+      pl_rearmed_cbs.fskip.get_usec = lr_get_usec;
+
 #if defined(__MACH__) && !defined(TVOS)
    // magic sauce to make the dynarec work on iOS
    syscall(SYS_ptrace, 0 /*PTRACE_TRACEME*/, 0, 0, 0);
@@ -192,13 +192,33 @@ struct retro_core_option_v2_definition option_defs_us[] = {
       "12",
    },
 #undef V
+#if !defined(_3DS) && !defined(VITA)
+   {
+      "pcsx_rearmed_cd_resident",
+      "CD image in RAM",
+      NULL,
+      "Reads the whole disk into RAM in the background after loading, after which no more disk access or decompression is done while the game runs. Requires up to an additional 800MB of RAM.",
+      NULL,
+      "system",
+      {
+         { "disabled", NULL },
+         { "enabled",  NULL },
+         { NULL, NULL },
+      },
+      "disabled",
+   },
+#endif
 #endif
 #ifndef DRC_DISABLE
    {
       "pcsx_rearmed_drc",
       "Dynamic Recompiler",
       NULL,
-      "Dynamically recompile PSX CPU instructions to native instructions. Much faster than using an interpreter, but may be less accurate on some platforms.",
+      "Dynamically recompile PSX CPU instructions to native instructions. Much faster than using an interpreter, but may be less accurate on some platforms."
+#if defined(LIGHTREC) && LIGHTREC_ENABLE_THREADED_COMPILER
+      " New code is interpreted while worker threads compile it, which avoids stutter when a game loads lots of code. This is chosen when the core is built (LIGHTREC_THREADED_COMPILER) and can't be changed here."
+#endif
+      ,
       NULL,
       "system",
       {
@@ -349,7 +369,7 @@ struct retro_core_option_v2_definition option_defs_us[] = {
       "pcsx_rearmed_frameskip_type",
       "Frameskip",
       NULL,
-      "Skip frames to avoid audio buffer under-run (crackling). Improves performance at the expense of visual smoothness. 'Auto' skips frames when advised by the frontend. 'Auto (Threshold)' utilises the 'Frameskip Threshold (%)' setting. 'Fixed Interval' utilises the 'Frameskip Interval' setting.",
+      "Skip frames to avoid audio buffer under-run (crackling). Improves performance at the expense of visual smoothness. 'Auto' skips the drawing of frames that are predicted to finish too late, going by recent frame times and the frontend's audio buffer. 'Auto (Threshold)' does the same but keeps the buffer above the 'Frameskip Threshold (%)' setting. 'Fixed Interval' utilises the 'Frameskip Interval' setting.",
       NULL,
       "video",
       {
@@ -411,6 +431,22 @@ struct retro_core_option_v2_definition option_defs_us[] = {
       },
       "3"
    },
+   {
+      "pcsx_rearmed_runahead",
+      "Run-Ahead Frames",
+      NULL,
+      "Run the emulation this many frames ahead after each frame and show the last one, hiding that much of the game's own input lag. Uses the core's cheap in-memory states instead of full savestates, so it costs far less than the frontend's run-ahead, but still needs the CPU to emulate 1 + this many frames for each frame shown. Don't enable both.",
+      NULL,
+      "input",
+      {
+         { "disabled", NULL },
+         { "1", NULL },
+         { "2", NULL },
+         { "3", NULL },
+         { NULL, NULL },
+      },
+      "disabled"
+   },
    {
       "pcsx_rearmed_display_fps_v2",
       "Display Internal FPS",
@@ -747,6 +783,22 @@ struct retro_core_option_v2_definition option_defs_us[] = {
       },
       "disabled",
    },
+#ifdef GPU_PEOPS_THREADS
+   {
+      "pcsx_rearmed_gpu_peops_threaded",
+      "(GPU) Dual Thread Rendering",
+      "Dual Thread Rendering",
+      "Draw the top and bottom halves of the screen on two separate threads. Can improve performance on multi-core devices.",
+      NULL,
+      "gpu_peops",
+      {
+         { "disabled", NULL },
+         { "enabled",  NULL },
+         { NULL, NULL},
+      },
+      "disabled",
+   },
+#endif
 #endif /* GPU_PEOPS */
 #ifdef GPU_UNAI
    {
@@ -835,6 +887,22 @@ struct retro_core_option_v2_definition option_defs_us[] = {
       },
       "disabled",
    },
+#ifdef GPU_UNAI_THREADS
+   {
+      "pcsx_rearmed_gpu_unai_threaded",
+      "(GPU) Dual Thread Rendering",
+      "Dual Thread Rendering",
+      "Draw odd and even lines on two separate threads. Can improve performance on multi-core devices.",
+      NULL,
+      "gpu_unai",
+      {
+         { "disabled", NULL },
+         { "enabled",  NULL },
+         { NULL, NULL},
+      },
+      "disabled",
+   },
+#endif
 #endif /* GPU_UNAI */
    {
       "pcsx_rearmed_spu_reverb",
@@ -874,6 +942,20 @@ struct retro_core_option_v2_definition option_defs_us[] = {
       "simple",
 #endif
    },
+   {
+      "pcsx_rearmed_spu_rate_control",
+      "Audio Rate Control",
+      NULL,
+      "Play sound up to 0.5% faster or slower, depending on how full the frontend's audio buffer is, to keep it from running dry or overflowing. Helps with crackling when the display refresh rate doesn't quite match the emulated system, without having to skip frames. Requires a frontend that reports the audio buffer status.",
+      NULL,
+      "audio",
+      {
+         { "disabled", NULL },
+         { "enabled",  NULL },
+         { NULL, NULL },
+      },
+      "disabled",
+   },
    {
       "pcsx_rearmed_nocdaudio",
       "CD Audio",
@@ -1712,6 +1794,34 @@ struct retro_core_option_v2_definition option_defs_us[] = {
       },
       "disabled",
    },
+   {
+      "pcsx_rearmed_smc_mprotect",
+      "(Speed Hack) SMC Checks by Page Protection",
+      "SMC Checks by Page Protection",
+      "Detect writes to code by write-protecting memory pages that hold it instead of checking every store. Faster for most games, slower for ones that keep data next to code. Code is dropped a little later than with store checks, so a game that overwrites code and runs it right away may run the old code and crash or glitch. Linux only.",
+      NULL,
+      "speed_hack",
+      {
+         { "disabled", NULL },
+         { "enabled",  NULL },
+         { NULL, NULL },
+      },
+      "disabled",
+   },
+   {
+      "pcsx_rearmed_superblocks",
+      "(Speed Hack) Superblocks for Hot Code",
+      "Superblocks for Hot Code",
+      "Recompile the most often run code into longer blocks that continue past jumps and calls, so fewer registers need to be saved and reloaded between blocks.",
+      NULL,
+      "speed_hack",
+      {
+         { "disabled", NULL },
+         { "enabled",  NULL },
+         { NULL, NULL },
+      },
+      "disabled",
+   },
    {
       "pcsx_rearmed_gteregsunneeded",
       "(Speed Hack) Assume GTE Registers Unneeded",
@@ -1759,6 +1869,20 @@ struct retro_core_option_v2_definition option_defs_us[] = {
       },
       "disabled",
    },
+   {
+      "pcsx_rearmed_idle_skip",
+      "(Speed Hack) Skip Polling Loops",
+      "Skip Polling Loops",
+      "When the game only waits in a short loop for a flag in RAM or a hardware register, jump ahead to the next event instead of running the loop. Saves power and time on slow devices, but may break games that are fussy about timing.",
+      NULL,
+      "speed_hack",
+      {
+         { "disabled", NULL },
+         { "enabled",  NULL },
+         { NULL, NULL },
+      },
+      "disabled",
+   },
    { NULL, NULL, NULL, NULL, NULL, NULL, {{0}}, NULL },
 };
 
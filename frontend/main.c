@@ -26,10 +26,12 @@
 #include "plat.h"
 #include "plat_webos.h"
 #include "../libpcsxcore/misc.h"
+#include "../libpcsxcore/psxmem_map.h"
 #include "../libpcsxcore/cheat.h"
 #include "../libpcsxcore/sio.h"
 #include "../libpcsxcore/database.h"
 #include "../libpcsxcore/cdrom-async.h"
+#include "../libpcsxcore/psxtrace.h"
 #include "../libpcsxcore/new_dynarec/new_dynarec.h"
 #include "../plugins/cdrcimg/cdrcimg.h"
 #include "../plugins/dfsound/spu_config.h"
@@ -86,6 +88,7 @@ static void set_default_paths(void)
 {
 #ifndef NO_FRONTEND
 	const char *home = get_home_dir();
+	char path[MAXPATHLEN];
 	struct stat st;
 	MAKE_PATH(Config.PatchesDir, PATCHES_DIR, NULL);
 	MAKE_PATH(Config.Mcd1, MEMCARD_DIR, "card1.mcd");
@@ -93,6 +96,8 @@ static void set_default_paths(void)
 	MAKE_PATH(Config.BiosDir, BIOS_DIR, NULL);
 
 	emu_make_data_path(Config.PluginsDir, "plugins", sizeof(Config.PluginsDir));
+	MAKE_PATH(path, CFG_DIR, NULL);
+	cdra_set_hint_dir(path);
 
 	// prefer bios in working dir for compatibility
 	if (!strcmp(home, ".") && !stat("bios", &st))
@@ -136,6 +141,7 @@ void emu_set_default_config(void)
 	spu_config.iXAPitch = 0;
 	spu_config.iVolume = 768;
 	spu_config.iTempo = 0;
+	spu_config.iRateControl = 0;
 	// may cause issues, no effect if only 1 core is detected
 	spu_config.iUseThread = 0;
 #if defined(HAVE_PRE_ARMV7) && !defined(_3DS) /* XXX GPH hack */
@@ -581,6 +587,50 @@ static void check_memcards(void)
 	}
 }
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static int tlbstat_fd = -1;
+
+// counts data TLB read misses of the emu thread and threads it starts later
+static void tlbstat_start(void)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_DTLB |
+		(PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		(PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.inherit = 1;
+	tlbstat_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	if (tlbstat_fd < 0)
+		SysPrintf("tlbstat: perf_event_open failed\n");
+}
+
+static void tlbstat_finish(void)
+{
+	extern unsigned int frame_counter;
+	unsigned long long misses = 0;
+
+	if (tlbstat_fd < 0)
+		return;
+	if (read(tlbstat_fd, &misses, sizeof(misses)) == sizeof(misses))
+		SysPrintf("tlbstat: %llu dTLB read misses, %llu/frame over %u frames, "
+			"huge pages %s\n", misses, misses / (frame_counter ? frame_counter : 1),
+			frame_counter, psxMapHugePages ? "on" : "off");
+	close(tlbstat_fd);
+	tlbstat_fd = -1;
+}
+#else
+static void tlbstat_start(void) {}
+static void tlbstat_finish(void) {}
+#endif
+
 int main(int argc, char *argv[])
 {
 	char file[MAXPATHLEN] = "";
@@ -588,8 +638,12 @@ int main(int argc, char *argv[])
 	char isofilename[MAXPATHLEN];
 	const char *cdfile = NULL;
 	const char *loadst_f = NULL;
+	const char *trace_f = NULL;
+	int trace_flags = 0;
 	int psxout = 0;
 	int loadst = 0;
+	int hugepages = 0;
+	int tlbstat = 0;
 	int i;
 
 #ifdef WEBOS
@@ -603,6 +657,8 @@ int main(int argc, char *argv[])
 	// read command line options
 	for (i = 1; i < argc; i++) {
 		     if (!strcmp(argv[i], "-psxout")) psxout = 1;
+		else if (!strcmp(argv[i], "-hugepages")) hugepages = 1;
+		else if (!strcmp(argv[i], "-tlbstat")) tlbstat = 1;
 		else if (!strcmp(argv[i], "-load")) loadst = atol(argv[++i]);
 		else if (!strcmp(argv[i], "-cfg")) {
 			if (i+1 >= argc) break;
@@ -628,6 +684,11 @@ int main(int argc, char *argv[])
 			if (i+1 >= argc) break;
 			loadst_f = argv[++i];
 		}
+		else if (!strcmp(argv[i], "-trace") || !strcmp(argv[i], "-tracemem")) {
+			if (i+1 >= argc) break;
+			trace_flags = argv[i][6] ? PSXTR_F_MEM : 0;
+			trace_f = argv[++i];
+		}
 		else if (!strcmp(argv[i], "-h") ||
 			 !strcmp(argv[i], "-help") ||
 			 !strcmp(argv[i], "--help")) {
@@ -640,6 +701,10 @@ int main(int argc, char *argv[])
 							"\t-psxout\t\tEnable PSX output\n"
 							"\t-load STATENUM\tLoads savestate STATENUM (1-9)\n"
 							"\t-loadf FILE\tLoads savestate from FILE\n"
+							"\t-trace FILE\tRecords an execution trace to FILE\n"
+							"\t-tracemem FILE\tSame, with memory hashes on events\n"
+							"\t-hugepages\tBack PSX RAM/VRAM with huge pages\n"
+							"\t-tlbstat\tReport dTLB misses on exit (Linux)\n"
 							"\t-h -help\tDisplay this message\n"
 							"\tfile\t\tLoads a PSX EXE file\n"));
 			 return 0;
@@ -671,6 +736,11 @@ int main(int argc, char *argv[])
 	// WebOS: Set Video Overlay output (hardware accelerated, avoids touch flicker)
 	webos_set_video_default();
 
+	if (hugepages)
+		Config.HugePages = 1;
+	if (tlbstat)
+		tlbstat_start();
+
 	if (emu_core_init() != 0)
 		return 1;
 
@@ -696,6 +766,8 @@ int main(int argc, char *argv[])
 	CheckCdrom();
 	plugin_call_rearmed_cbs();
 	SysReset();
+	if (trace_f)
+		psxTraceStart(trace_f, trace_flags);
 
 	if (file[0] != '\0') {
 		if (Load(file) != -1)
@@ -740,6 +812,7 @@ int main(int argc, char *argv[])
 	}
 
 	printf("Exit..\n");
+	tlbstat_finish();
 	ClosePlugins();
 	SysClose();
 	menu_finish();
@@ -813,11 +886,47 @@ int get_state_filename(char *buf, int size, int i) {
 		"%s" STATES_DIR "%.32s-%.9s.%3.3d", i);
 }
 
+static int get_state_index_filename(char *buf, int size) {
+	return get_gameid_filename(buf, size,
+		"%s" STATES_DIR "%.32s-%.9s.idx", 0);
+}
+
+// the index entry is only trusted if the state file is still
+// the one it was made for
+int emu_get_state_info(int slot, struct PcsxStateInfo *info, u16 *thumb)
+{
+	char fname[MAXPATHLEN];
+	struct stat st;
+	int ret;
+
+	ret = get_state_filename(fname, sizeof(fname), slot);
+	if (ret != 0)
+		return ret;
+	if (stat(fname, &st) != 0)
+		return -1;
+
+	ret = get_state_index_filename(fname, sizeof(fname));
+	if (ret != 0)
+		return ret;
+	ret = LoadStateInfo(fname, slot, info, thumb);
+	if (ret != 0)
+		return ret;
+
+	if (info->size != (u32)st.st_size || info->mtime != (u32)st.st_mtime
+	    || strncmp(info->game_id, CdromId, sizeof(CdromId)) != 0)
+		return -1;
+	return 0;
+}
+
 int emu_check_state(int slot)
 {
+	struct PcsxStateInfo info;
 	char fname[MAXPATHLEN];
 	int ret;
 
+	if (emu_get_state_info(slot, &info, NULL) == 0)
+		return 0;
+
 	ret = get_state_filename(fname, sizeof(fname), slot);
 	if (ret != 0)
 		return ret;
@@ -827,14 +936,17 @@ int emu_check_state(int slot)
 
 int emu_save_state(int slot)
 {
-	char fname[MAXPATHLEN];
+	char fname[MAXPATHLEN], iname[MAXPATHLEN];
 	int ret;
 
 	ret = get_state_filename(fname, sizeof(fname), slot);
+	if (ret != 0)
+		return ret;
+	ret = get_state_index_filename(iname, sizeof(iname));
 	if (ret != 0)
 		return ret;
 
-	ret = SaveState(fname);
+	ret = SaveStateIndexed(fname, iname, slot);
 #if defined(HAVE_PRE_ARMV7) && !defined(_3DS) && !defined(__SWITCH__) /* XXX GPH hack */
 	sync();
 #endif
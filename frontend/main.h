@@ -55,8 +55,11 @@ void emu_on_new_cd(int show_hud_msg);
 void emu_make_path(char *buf, size_t size, const char *dir, const char *fname);
 void emu_make_data_path(char *buff, const char *end, int size);
 
+struct PcsxStateInfo;
+
 int get_state_filename(char *buf, int size, int i);
 int emu_check_state(int slot);
+int emu_get_state_info(int slot, struct PcsxStateInfo *info, unsigned short *thumb);
 int emu_save_state(int slot);
 int emu_load_state(int slot);
 
@@ -110,8 +110,9 @@ static int config_save_counter, region, in_type_sel1, in_type_sel2;
 static int psx_clock;
 static int memcard1_sel = -1, memcard2_sel = -1;
 static int cd_buf_count;
+static int cd_resident;
 extern int g_autostateld_opt;
-static int menu_iopts[8];
+static int menu_iopts[9];
 int g_opts, g_scaler, g_gamma = 100;
 int scanlines, scanline_level = 20;
 int soft_scaling, analog_deadzone; // for Caanoo
@@ -421,6 +422,8 @@ static const struct {
 	CE_CONFIG_VAL(FractionalFramerate),
 	CE_CONFIG_VAL(PreciseExceptions),
 	CE_CONFIG_VAL(TurboCD),
+	CE_CONFIG_VAL(HugePages),
+	CE_CONFIG_VAL(IdleSkip),
 	CE_CONFIG_VAL(SlowBoot),
 	CE_INTVAL(region),
 	CE_INTVAL_V(g_scaler, 3),
@@ -445,6 +448,7 @@ static const struct {
 	CE_INTVAL(memcard2_sel),
 	CE_INTVAL(g_autostateld_opt),
 	CE_INTVAL(cd_buf_count),
+	CE_INTVAL(cd_resident),
 	CE_INTVAL_N("adev0_axis0", in_adev_axis[0][0]),
 	CE_INTVAL_N("adev0_axis1", in_adev_axis[0][1]),
 	CE_INTVAL_N("adev1_axis0", in_adev_axis[1][0]),
@@ -456,11 +460,13 @@ static const struct {
 	CE_INTVAL_P(thread_rendering),
 	CE_INTVAL_P(scale_hires),
 	CE_INTVAL_P(gpu_peops.dwActFixes),
+	CE_INTVAL_P(gpu_peops.threaded),
 	CE_INTVAL_P(gpu_unai.old_renderer),
 	CE_INTVAL_P(gpu_unai.ilace_force),
 	CE_INTVAL_P(gpu_unai.lighting),
 	CE_INTVAL_P(gpu_unai.fast_lighting),
 	CE_INTVAL_P(gpu_unai.blending),
+	CE_INTVAL_P(gpu_unai.threaded),
 	CE_INTVAL_P(gpu_neon.allow_interlace),
 	CE_INTVAL_P(gpu_neon.enhancement_enable),
 	CE_INTVAL_P(gpu_neon.enhancement_no_main),
@@ -484,6 +490,7 @@ static const struct {
 	CE_INTVAL(spu_config.iXAPitch),
 	CE_INTVAL(spu_config.iUseInterpolation),
 	CE_INTVAL(spu_config.iTempo),
+	CE_INTVAL(spu_config.iRateControl),
 	CE_INTVAL(spu_config.iUseThread),
 	CE_INTVAL(config_save_counter),
 	CE_INTVAL(in_evdev_allow_abs_only),
@@ -545,6 +552,7 @@ static int menu_write_config(int is_game)
 	}
 
 	cd_buf_count = cdra_get_buf_count();
+	cd_resident = cdra_get_resident();
 
 	for (i = 0; i < ARRAY_SIZE(config_data); i++) {
 		fprintf(f, "%s = ", config_data[i].name);
@@ -708,6 +716,7 @@ int menu_load_config(int is_game)
 
 	keys_load_all(cfg);
 	cdra_set_buf_count(cd_buf_count);
+	cdra_set_resident(cd_resident);
 	ret = 0;
 fail_read:
 	free(cfg);
@@ -790,6 +799,45 @@ static void draw_savestate_bg(int slot);
 #define MENU_ALIGN_LEFT
 #include "libpicofe/menu.c"
 
+// from the state index, which is way faster than gunzipping the state
+static int draw_savestate_thumb(int slot)
+{
+	struct PcsxStateInfo info;
+	int x, y, sx, sy, scale;
+	u16 *thumb, *d;
+
+	thumb = malloc(STATE_THUMB_W * STATE_THUMB_H * 2);
+	if (thumb == NULL)
+		return -1;
+	if (emu_get_state_info(slot, &info, thumb) != 0) {
+		free(thumb);
+		return -1;
+	}
+
+	memcpy(g_menubg_ptr, g_menubg_src_ptr, g_menuscreen_w * g_menuscreen_h * 2);
+
+	scale = min(g_menuscreen_w / 2 / STATE_THUMB_W,
+		g_menuscreen_h / STATE_THUMB_H);
+	if (scale < 1)
+		scale = 1;
+	sx = min(g_menuscreen_w, STATE_THUMB_W * scale);
+	sy = min(g_menuscreen_h, STATE_THUMB_H * scale);
+	x = (g_menuscreen_w - sx) & ~3;
+	y = max(0, g_menuscreen_h / 2 - sy / 2);
+	d = (u16 *)g_menubg_ptr + g_menuscreen_w * y + x;
+
+	for (y = 0; y < sy; y++, d += g_menuscreen_w) {
+		const u16 *s = thumb + y / scale * STATE_THUMB_W;
+		for (x = 0; x < sx; x++)
+			d[x] = s[x / scale];
+		if (g_menuscreen_w - sx < 320)
+			menu_darken_bg(d, d, sx, 0);
+	}
+
+	free(thumb);
+	return 0;
+}
+
 // a bit of black magic here
 static void draw_savestate_bg(int slot)
 {
@@ -802,6 +850,9 @@ static void draw_savestate_bg(int slot)
 	int ret;
 	u32 tmp;
 
+	if (draw_savestate_thumb(slot) == 0)
+		return;
+
 	ret = get_state_filename(fname, sizeof(fname), slot);
 	if (ret != 0)
 		return;
@@ -1252,6 +1303,8 @@ static const char *men_in_type_sel[] = {
 static const char h_nub_btns[] = "Experimental, keep this OFF if unsure. Select rescan after change.";
 static const char h_notsgun[]  = "Don't trigger (shoot) when touching screen in gun games.";
 static const char h_vibration[]= "Must select analog above and enable this ingame too.";
+static const char h_late_input[]="Read the controls when the game first polls the pad\n"
+				 "each frame instead of at vsync, reduces input lag";
 
 static menu_entry e_menu_keyconfig[] =
 {
@@ -1266,6 +1319,7 @@ static menu_entry e_menu_keyconfig[] =
 	mee_onoff_h   ("Vibration",         MA_CTRL_VIBRATION,  in_enable_vibration, 1, h_vibration),
 	mee_range     ("Analog deadzone",   MA_CTRL_DEADZONE,   analog_deadzone, 1, 99),
 	mee_onoff_h   ("No TS Gun trigger", 0, g_opts, OPT_TSGUN_NOTRIGGER, h_notsgun),
+	mee_onoff_h   ("Late input latch",  0, g_opts, OPT_LATE_INPUT, h_late_input),
 	mee_cust_nosave("Save global config",       MA_OPT_SAVECFG,      mh_savecfg, mgn_saveloadcfg),
 	mee_cust_nosave("Save cfg for loaded game", MA_OPT_SAVECFG_GAME, mh_savecfg, mgn_saveloadcfg),
 	mee_handler   ("Rescan devices:",  mh_input_rescan),
@@ -1314,6 +1368,10 @@ static const char h_soft_filter[] = "Works only if game uses low resolution mode
 static const char h_gamma[]     = "Gamma/brightness adjustment (default 100)";
 static const char h_lowres[]    = "Forces all PSX high resolutions to 320x240 or lower\n"
 				  "by skipping lines and pixels";
+#ifdef HAVE_RTHREADS
+static const char h_thread_flip[] = "Convert frames on a separate thread while\n"
+				  "the next one is emulated. Adds a frame of lag";
+#endif
 #ifdef HAVE_NEON32
 static const char *men_scanlines[] = { "OFF", "1", "2", "3", NULL };
 static const char h_scanline_l[]  = "Scanline brightness, 0-100%";
@@ -1417,6 +1475,9 @@ static menu_entry e_menu_gfx_options[] =
 #endif
 	mee_range_h   ("Gamma adjustment",         MA_OPT_GAMMA, g_gamma, 1, 200, h_gamma),
 	mee_onoff     ("OpenGL Vsync",             MA_OPT_VSYNC, g_opts, OPT_VSYNC),
+#ifdef HAVE_RTHREADS
+	mee_onoff_h   ("Threaded output",          0, g_opts, OPT_THREAD_FLIP, h_thread_flip),
+#endif
 	mee_cust_h    ("Setup custom scaler",      MA_OPT_VARSCALER_C, menu_loop_cscaler, NULL, h_cscaler),
 	mee_onoff_h   ("Force low resolution",     0, pl_rearmed_cbs.scale_hires, 1, h_lowres),
 	mee_end,
@@ -1451,6 +1512,10 @@ static menu_entry e_menu_plugin_gpu_neon[] =
 	mee_end,
 };
 
+static const char h_gpu_unai_threaded[] =
+	"Draws odd and even lines on separate threads\n"
+	"(for multi-core devices)";
+
 static menu_entry e_menu_plugin_gpu_unai[] =
 {
 	mee_onoff     ("Old renderer",               0, pl_rearmed_cbs.gpu_unai.old_renderer, 1),
@@ -1458,6 +1523,9 @@ static menu_entry e_menu_plugin_gpu_unai[] =
 	mee_onoff     ("Lighting",                   0, pl_rearmed_cbs.gpu_unai.lighting, 1),
 	mee_onoff     ("Fast lighting",              0, pl_rearmed_cbs.gpu_unai.fast_lighting, 1),
 	mee_onoff     ("Blending",                   0, pl_rearmed_cbs.gpu_unai.blending, 1),
+#ifdef GPU_UNAI_THREADS
+	mee_onoff_h   ("Dual thread rendering",      0, pl_rearmed_cbs.gpu_unai.threaded, 1, h_gpu_unai_threaded),
+#endif
 	mee_end,
 };
 
@@ -1470,6 +1538,9 @@ static const char h_gpu_6[]            = "Pandemonium 2";
 static const char h_gpu_8[]            = "Needed by Dark Forces";
 static const char h_gpu_9[]            = "better g-colors, worse textures";
 static const char h_gpu_10[]           = "Toggle busy flags after drawing";
+static const char h_gpu_peops_threaded[] =
+	"Draws the top and bottom halves of the screen\n"
+	"on separate threads (for multi-core devices)";
 
 static menu_entry e_menu_plugin_gpu_peops[] =
 {
@@ -1482,6 +1553,9 @@ static menu_entry e_menu_plugin_gpu_peops[] =
 	mee_onoff_h   ("Repeated flat tex triangles ",0,pl_rearmed_cbs.gpu_peops.dwActFixes, 1<<8, h_gpu_8),
 	mee_onoff_h   ("Draw quads with triangles",  0, pl_rearmed_cbs.gpu_peops.dwActFixes, 1<<9, h_gpu_9),
 	mee_onoff_h   ("Fake 'gpu busy' states",     0, pl_rearmed_cbs.gpu_peops.dwActFixes, 1<<10, h_gpu_10),
+#ifdef GPU_PEOPS_THREADS
+	mee_onoff_h   ("Dual thread rendering",      0, pl_rearmed_cbs.gpu_peops.threaded, 1, h_gpu_peops_threaded),
+#endif
 	mee_end,
 };
 
@@ -1519,6 +1593,8 @@ static const char *men_spu_interp[] = { "None", "Simple", "Gaussian", "Cubic", N
 static const char h_spu_volboost[]  = "Large values cause distortion";
 static const char h_spu_tempo[]     = "Slows down audio if emu is too slow\n"
 				      "This is inaccurate and breaks games";
+static const char h_spu_ratectl[]   = "Plays up to 0.5% faster/slower to keep\n"
+				      "the sound buffer half full (SDL only)";
 
 static menu_entry e_menu_plugin_spu[] =
 {
@@ -1527,6 +1603,7 @@ static menu_entry e_menu_plugin_spu[] =
 	mee_enum      ("Interpolation",             0, spu_config.iUseInterpolation, men_spu_interp),
 	//mee_onoff     ("Adjust XA pitch",           0, spu_config.iXAPitch, 1),
 	mee_onoff_h   ("Adjust tempo",              0, spu_config.iTempo, 1, h_spu_tempo),
+	mee_onoff_h   ("Rate control",              0, spu_config.iRateControl, 1, h_spu_ratectl),
 	mee_end,
 };
 
@@ -1647,20 +1724,30 @@ static int menu_loop_plugin_options(int id, int keys)
 #ifndef DRC_DISABLE
 static const char h_cfg_noch[]    = "Disables game-specific compatibility hacks";
 static const char h_cfg_nosmc[]   = "Will cause crashes when loading, break memcards";
+static const char h_cfg_smcmp[]   = "Detect code writes with page protection instead\n"
+				    "of checking every store (linux only).\n"
+				    "Code is dropped a bit later, games that run\n"
+				    "code right after writing it may break";
+static const char h_cfg_sb[]      = "Recompile often run code into longer blocks";
 static const char h_cfg_gteunn[]  = "May cause graphical glitches";
 static const char h_cfg_gteflgs[] = "Will cause graphical glitches";
 #endif
 static const char h_cfg_stalls[]  = "Will cause some games to run too fast";
+static const char h_cfg_idle[]    = "Skip ahead to the next event when the game is\n"
+				    "only waiting in a loop. May break timing";
 
 static menu_entry e_menu_speed_hacks[] =
 {
 #ifndef DRC_DISABLE
 	mee_onoff_h   ("Disable compat hacks",     0, ndrc_g.hacks, NDHACK_NO_COMPAT_HACKS, h_cfg_noch),
 	mee_onoff_h   ("Disable SMC checks",       0, ndrc_g.hacks, NDHACK_NO_SMC_CHECK, h_cfg_nosmc),
+	mee_onoff_h   ("SMC checks by page faults", 0, ndrc_g.hacks, NDHACK_SMC_MPROTECT, h_cfg_smcmp),
+	mee_onoff_h   ("Superblocks for hot code", 0, ndrc_g.hacks, NDHACK_SUPERBLOCKS, h_cfg_sb),
 	mee_onoff_h   ("Assume GTE regs unneeded", 0, ndrc_g.hacks, NDHACK_GTE_UNNEEDED, h_cfg_gteunn),
 	mee_onoff_h   ("Disable GTE flags",        0, ndrc_g.hacks, NDHACK_GTE_NO_FLAGS, h_cfg_gteflgs),
 #endif
 	mee_onoff_h   ("Disable CPU/GTE stalls",   0, menu_iopts[0], 1, h_cfg_stalls),
+	mee_onoff_h   ("Skip polling loops",       0, menu_iopts[1], 1, h_cfg_idle),
 	mee_end,
 };
 
@@ -1668,8 +1755,10 @@ static int menu_loop_speed_hacks(int id, int keys)
 {
 	static int sel = 0;
 	menu_iopts[0] = Config.DisableStalls;
+	menu_iopts[1] = Config.IdleSkip;
 	me_loop(e_menu_speed_hacks, &sel);
 	Config.DisableStalls = menu_iopts[0];
+	Config.IdleSkip = menu_iopts[1];
 	return 0;
 }
 
@@ -1684,7 +1773,12 @@ static const char h_cfg_cdda[]   = "Disable CD Audio for a performance boost\n"
 				   "(proper .cue/.bin dump is needed otherwise)";
 #ifndef DRC_DISABLE
 static const char h_cfg_nodrc[]  = "Disable dynamic recompiler and use interpreter\n"
-				   "Might be useful to overcome some dynarec bugs";
+				   "Might be useful to overcome some dynarec bugs"
+#if defined(LIGHTREC) && LIGHTREC_ENABLE_THREADED_COMPILER
+				   "\nLightrec compiles on worker threads in this\n"
+				   "build (LIGHTREC_THREADED_COMPILER, build time)"
+#endif
+				   ;
 #endif
 static const char h_cfg_shacks[] = "Breaks games but may give better performance";
 static const char h_cfg_icache[] = "Support F1 games (only when dynarec is off)";
@@ -1695,10 +1789,14 @@ static const char h_cfg_gpul[]   = "Try enabling this if the game misses some gr
 static const char h_cfg_ffps[]   = "Instead of 50/60fps for PAL/NTSC use ~49.75/59.81\n"
 				   "Closer to real hw but doesn't match modern displays.";
 static const char h_cfg_tcd[]    = "Greatly reduce CD load times. Breaks some games.";
+static const char h_cfg_huge[]   = "Back PSX RAM and VRAM with 2MB pages to reduce\n"
+				   "TLB misses. Takes effect after restart.";
+static const char h_cfg_cdres[]  = "Read the whole CD image into RAM in the background\n"
+				   "(needs up to ~800MB of memory)";
 static const char h_cfg_psxclk[]  = "Over/under-clock the PSX, default is " DEFAULT_PSX_CLOCK_S "\n"
 				    "(adjust this if the game is too slow/too fast/hangs)";
 
-enum { AMO_XA, AMO_CDDA, AMO_IC, AMO_BP, AMO_CPU, AMO_GPUL, AMO_FFPS, AMO_TCD };
+enum { AMO_XA, AMO_CDDA, AMO_IC, AMO_BP, AMO_CPU, AMO_GPUL, AMO_FFPS, AMO_TCD, AMO_HUGE };
 
 static menu_entry e_menu_adv_options[] =
 {
@@ -1712,8 +1810,12 @@ static menu_entry e_menu_adv_options[] =
 	mee_enum_h    ("GPU l-list slow walking",0, menu_iopts[AMO_GPUL], men_autooo, h_cfg_gpul),
 	mee_enum_h    ("Fractional framerate",   0, menu_iopts[AMO_FFPS], men_autooo, h_cfg_ffps),
 	mee_onoff_h   ("Turbo CD-ROM ",          0, menu_iopts[AMO_TCD], 1, h_cfg_tcd),
+#ifdef __linux__
+	mee_onoff_h   ("Huge pages",             0, menu_iopts[AMO_HUGE], 1, h_cfg_huge),
+#endif
 #ifdef USE_ASYNC_CDROM
 	mee_range     ("CD-ROM read-ahead",      0, cd_buf_count, 0, 1024),
+	mee_onoff_h   ("CD-ROM image in RAM",    0, cd_resident, 1, h_cfg_cdres),
 #endif
 #if !defined(DRC_DISABLE) || defined(LIGHTREC)
 	mee_onoff_h   ("Disable dynarec (slow!)",0, menu_iopts[AMO_CPU],  1, h_cfg_nodrc),
@@ -1736,6 +1838,7 @@ static int menu_loop_adv_options(int id, int keys)
 		{ &Config.PreciseExceptions, &menu_iopts[AMO_BP] },
 		{ &Config.Cpu,     &menu_iopts[AMO_CPU] },
 		{ &Config.TurboCD, &menu_iopts[AMO_TCD] },
+		{ &Config.HugePages, &menu_iopts[AMO_HUGE] },
 	};
 	int i;
 	for (i = 0; i < ARRAY_SIZE(opts); i++)
@@ -1750,6 +1853,7 @@ static int menu_loop_adv_options(int id, int keys)
 	Config.GpuListWalking = menu_iopts[AMO_GPUL] - 1;
 	Config.FractionalFramerate = menu_iopts[AMO_FFPS] - 1;
 	cdra_set_buf_count(cd_buf_count);
+	cdra_set_resident(cd_resident);
 
 	return 0;
 }
@@ -17,6 +17,8 @@ enum g_opts_opts {
 	OPT_SHOWSPU = 1 << 3,
 	OPT_TSGUN_NOTRIGGER = 1 << 4,
 	OPT_VSYNC = 1 << 5,
+	OPT_THREAD_FLIP = 1 << 6,
+	OPT_LATE_INPUT = 1 << 7,
 };
 
 enum g_scaler_opts {
@@ -27,6 +27,9 @@
 long PAD1_readPort(PadDataS *pad) {
 	int pad_index = pad->requestPadIndex;
 
+	if (in_latch_pending)
+		pl_input_latch();
+
 	pad->controllerType = in_type[pad_index];
 	pad->buttonStatus = ~in_keystate[pad_index];
 
@@ -55,6 +58,9 @@ long PAD1_readPort(PadDataS *pad) {
 long PAD2_readPort(PadDataS *pad) {
 	int pad_index = pad->requestPadIndex;
 
+	if (in_latch_pending)
+		pl_input_latch();
+
 	pad->controllerType = in_type[pad_index];
 	pad->buttonStatus = ~in_keystate[pad_index];
 
@@ -10,6 +10,7 @@
 #include <string.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <limits.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -17,6 +18,9 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <assert.h>
+#ifdef HAVE_RTHREADS
+#include "pcsxr-threads.h"
+#endif
 
 #include "libpicofe/fonts.h"
 #include "libpicofe/input.h"
@@ -59,6 +63,7 @@ int in_adev_axis[2][2] =
 int in_adev_is_nublike[2];
 unsigned short in_keystate[8];
 int in_mouse[8][2];
+int in_latch_pending;
 int in_enable_vibration;
 void *tsdev;
 void *pl_vout_buf;
@@ -68,6 +73,7 @@ static int pl_vout_scale_w, pl_vout_scale_h;
 static int psx_w, psx_h, psx_bpp;
 static int vsync_cnt;
 static int is_pal, frame_interval, frame_interval1024;
+static int fskip_per_sec;
 static int vsync_usec_time;
 
 // platform hooks
@@ -119,31 +125,56 @@ static void hud_printf(void *fb, int w, int x, int y, const char *texto, ...)
 	hud_print(fb, w, x, y, buffer);
 }
 
-static void print_msg(int h, int border)
+/* what the HUD shows, taken on the emu thread */
+struct hud_state {
+	char msg[sizeof(hud_msg)];
+	int opts, flips, fskip, cpu;
+	float vsps;
+	int live_chans, run_chans, fmod_chans, noise_chans;
+};
+
+static void hud_snapshot(struct hud_state *hud)
 {
-	hud_print(pl_vout_buf, pl_vout_w, border + 2, h - HUD_HEIGHT, hud_msg);
+	extern void spu_get_debug_info(int *chans_out, int *run_chans,
+		int *fmod_chans_out, int *noise_chans_out); // hack
+
+	memcpy(hud->msg, hud_msg, sizeof(hud->msg));
+	hud->msg[sizeof(hud->msg) - 1] = 0;
+	hud->opts = g_opts;
+	hud->flips = pl_rearmed_cbs.flips_per_sec;
+	hud->vsps = pl_rearmed_cbs.vsps_cur;
+	hud->fskip = fskip_per_sec;
+	hud->cpu = pl_rearmed_cbs.cpu_usage;
+	if (g_opts & OPT_SHOWSPU)
+		spu_get_debug_info(&hud->live_chans, &hud->run_chans,
+			&hud->fmod_chans, &hud->noise_chans);
+}
+
+static void print_msg(int h, int border, const struct hud_state *hud)
+{
+	hud_print(pl_vout_buf, pl_vout_w, border + 2, h - HUD_HEIGHT, hud->msg);
 }
 
-static void print_fps(int h, int border)
+static void print_fps(int h, int border, const struct hud_state *hud)
 {
-	hud_printf(pl_vout_buf, pl_vout_w, border + 2, h - HUD_HEIGHT,
-		"%2d %4.1f", pl_rearmed_cbs.flips_per_sec,
-		pl_rearmed_cbs.vsps_cur);
+	if (hud->fskip)
+		hud_printf(pl_vout_buf, pl_vout_w, border + 2, h - HUD_HEIGHT,
+			"%2d %4.1f -%d", hud->flips, hud->vsps, hud->fskip);
+	else
+		hud_printf(pl_vout_buf, pl_vout_w, border + 2, h - HUD_HEIGHT,
+			"%2d %4.1f", hud->flips, hud->vsps);
 }
 
-static void print_cpu_usage(int x, int h)
+static void print_cpu_usage(int x, int h, const struct hud_state *hud)
 {
 	hud_printf(pl_vout_buf, pl_vout_w, x - 28,
-		h - HUD_HEIGHT, "%3d", pl_rearmed_cbs.cpu_usage);
+		h - HUD_HEIGHT, "%3d", hud->cpu);
 }
 
 // draw 192x8 status of 24 sound channels
-static __attribute__((noinline)) void draw_active_chans(int vout_w, int vout_h)
+static __attribute__((noinline)) void draw_active_chans(int vout_w, int vout_h,
+	const struct hud_state *hud)
 {
-	extern void spu_get_debug_info(int *chans_out, int *run_chans,
-		int *fmod_chans_out, int *noise_chans_out); // hack
-	int live_chans, run_chans, fmod_chans, noise_chans;
-
 	static const unsigned short colors[2] = { 0x1fe3, 0x0700 };
 	unsigned short *dest = (unsigned short *)pl_vout_buf +
 		pl_vout_w * (vout_h - HUD_HEIGHT) + pl_vout_w / 2 - 192/2;
@@ -153,13 +184,11 @@ static __attribute__((noinline)) void draw_active_chans(int vout_w, int vout_h)
 	if (pl_vout_buf == NULL || pl_vout_bpp != 16)
 		return;
 
-	spu_get_debug_info(&live_chans, &run_chans, &fmod_chans, &noise_chans);
-
 	for (c = 0; c < 24; c++) {
 		d = dest + c * 8;
-		p = !(live_chans & (1<<c)) ? (run_chans & (1<<c) ? 0x01c0 : 0) :
-		     (fmod_chans & (1<<c)) ? 0xf000 :
-		     (noise_chans & (1<<c)) ? 0x001f :
+		p = !(hud->live_chans & (1<<c)) ? (hud->run_chans & (1<<c) ? 0x01c0 : 0) :
+		     (hud->fmod_chans & (1<<c)) ? 0xf000 :
+		     (hud->noise_chans & (1<<c)) ? 0x001f :
 		     colors[c & 1];
 		for (y = 0; y < 8; y++, d += pl_vout_w)
 			for (x = 0; x < 8; x++)
@@ -167,7 +196,7 @@ static __attribute__((noinline)) void draw_active_chans(int vout_w, int vout_h)
 	}
 }
 
-static void print_hud(int x, int w, int h)
+static void print_hud(int x, int w, int h, const struct hud_state *hud)
 {
 	if (h < 192)
 		return;
@@ -175,16 +204,16 @@ static void print_hud(int x, int w, int h)
 	if (h > pl_vout_h)
 		h = pl_vout_h;
 
-	if (g_opts & OPT_SHOWSPU)
-		draw_active_chans(w, h);
+	if (hud->opts & OPT_SHOWSPU)
+		draw_active_chans(w, h, hud);
 
-	if (hud_msg[0] != 0)
-		print_msg(h, x);
-	else if (g_opts & OPT_SHOWFPS)
-		print_fps(h, x);
+	if (hud->msg[0] != 0)
+		print_msg(h, x, hud);
+	else if (hud->opts & OPT_SHOWFPS)
+		print_fps(h, x, hud);
 
-	if (g_opts & OPT_SHOWCPU)
-		print_cpu_usage(x + w, h);
+	if (hud->opts & OPT_SHOWCPU)
+		print_cpu_usage(x + w, h, hud);
 }
 
 /* update scaler target size according to user settings */
@@ -253,6 +282,8 @@ void pl_update_layer_size(int w, int h, int fw, int fh)
 	if (g_layer_h > fh * 2) g_layer_h = fh * 2;
 }
 
+static void pl_vout_sync(void);
+
 static const struct cspace_func_type {
 	void (*blit)(void *dst, const void *src, int dst_pixels);
 	void (*blit_dscale640)(void *dst, const void *src, int dst_pixels);
@@ -274,6 +305,8 @@ static void pl_vout_set_mode(int w, int h, int raw_w, int raw_h, int bpp)
 	const struct cspace_func_type *cspace_f = cspace_funcs;
 	int vout_w, vout_h, vout_bpp;
 
+	pl_vout_sync();
+
 	// special h handling, Wipeout likes to change it by 1-6
 	static int vsync_cnt_ms_prev;
 	if ((unsigned int)(vsync_cnt - vsync_cnt_ms_prev) < 5*60)
@@ -351,8 +384,22 @@ void pl_force_clear(void)
 	flip_clear_counter = 2;
 }
 
-static void pl_vout_flip(const void *vram_, int vram_ofs, int bgr24,
-	int x, int y, int w, int h, int dims_changed)
+/* clear pl_vout_buf before this frame? only called on the emu thread */
+static int vout_take_clear(const void *vram, int dims_changed)
+{
+	if (vram == NULL)
+		return 0; // blanking clears anyway
+	if (dims_changed)
+		flip_clear_counter = 3;
+	if (flip_clear_counter <= 0)
+		return 0;
+	flip_clear_counter--;
+	return 1;
+}
+
+/* convert and draw the HUD into pl_vout_buf, without flipping */
+static void vout_convert(const void *vram_, int vram_ofs, int bgr24,
+	int x, int y, int w, int h, int clear, const struct hud_state *hud)
 {
 	void (*blit)(void *dst, const void *src, int bytes);
 	unsigned char *dest = pl_vout_buf;
@@ -364,8 +411,6 @@ static void pl_vout_flip(const void *vram_, int vram_ofs, int bgr24,
 	int xoffs = 0, doffs;
 	int hwrapped;
 
-	pcnt_start(PCNT_BLIT);
-
 	if (vram == NULL) {
 		// blanking
 		if (pl_plat_clear)
@@ -380,16 +425,12 @@ static void pl_vout_flip(const void *vram_, int vram_ofs, int bgr24,
 	xoffs = x * pl_vout_scale_w;
 	doffs = xoffs + y * pl_vout_scale_h * dstride;
 
-	if (dims_changed)
-		flip_clear_counter = 3;
-
-	if (flip_clear_counter > 0) {
+	if (clear) {
 		if (pl_plat_clear)
 			pl_plat_clear();
 		else
 			memset(pl_vout_buf, 0,
 				dstride * h_full * pl_vout_bpp / 8);
-		flip_clear_counter--;
 	}
 
 	if (pl_plat_blit)
@@ -399,7 +440,7 @@ static void pl_vout_flip(const void *vram_, int vram_ofs, int bgr24,
 	}
 
 	if (dest == NULL)
-		goto out;
+		return;
 
 	dest += doffs * 2;
 
@@ -506,9 +547,181 @@ static void pl_vout_flip(const void *vram_, int vram_ofs, int bgr24,
 	}
 
 out_hud:
-	print_hud(xoffs, w * pl_vout_scale_w, (y + h) * pl_vout_scale_h);
+	print_hud(xoffs, w * pl_vout_scale_w, (y + h) * pl_vout_scale_h, hud);
+}
+
+#ifdef HAVE_RTHREADS
+/*
+ * Pipelined output: the emu thread snapshots the displayed vram lines and
+ * the HUD, and a helper thread converts them into pl_vout_buf while the
+ * next frame is being emulated. The flip itself stays on the emu thread
+ * (done from pl_frame_limit) as the platform code is not thread safe.
+ */
+static struct {
+	sthread_t *thread;
+	slock_t *lock;
+	scond_t *cond;
+	unsigned char *vram;	// same layout as psx vram, only used lines valid
+	int vram_ofs, bgr24, x, y, w, h, clear, blank;
+	struct hud_state hud;
+	int state;		// VOUT_THR_*
+	int exit;
+} vout_thr;
+
+enum { VOUT_THR_IDLE, VOUT_THR_QUEUED, VOUT_THR_DONE };
+
+static STRHEAD_RET_TYPE vout_thread(void *unused)
+{
+	slock_lock(vout_thr.lock);
+	for (;;) {
+		while (vout_thr.state != VOUT_THR_QUEUED && !vout_thr.exit)
+			scond_wait(vout_thr.cond, vout_thr.lock);
+		if (vout_thr.exit)
+			break;
+		slock_unlock(vout_thr.lock);
+
+		vout_convert(vout_thr.blank ? NULL : vout_thr.vram,
+			vout_thr.vram_ofs, vout_thr.bgr24, vout_thr.x, vout_thr.y,
+			vout_thr.w, vout_thr.h, vout_thr.clear, &vout_thr.hud);
+
+		slock_lock(vout_thr.lock);
+		vout_thr.state = VOUT_THR_DONE;
+		// only the emu thread can be waiting
+		scond_signal(vout_thr.cond);
+	}
+	slock_unlock(vout_thr.lock);
+	STRHEAD_RETURN();
+}
+
+/* wait for the queued frame (if any) and flip it */
+static void pl_vout_sync(void)
+{
+	if (!vout_thr.thread || vout_thr.state == VOUT_THR_IDLE)
+		return;
+
+	slock_lock(vout_thr.lock);
+	while (vout_thr.state == VOUT_THR_QUEUED)
+		scond_wait(vout_thr.cond, vout_thr.lock);
+	vout_thr.state = VOUT_THR_IDLE;
+	slock_unlock(vout_thr.lock);
+
+	pl_vout_buf = plat_gvideo_flip();
+	pl_rearmed_cbs.flip_cnt++;
+}
+
+static void vout_thread_stop(void)
+{
+	if (vout_thr.thread) {
+		pl_vout_sync();
+
+		slock_lock(vout_thr.lock);
+		vout_thr.exit = 1;
+		scond_signal(vout_thr.cond);
+		slock_unlock(vout_thr.lock);
+		sthread_join(vout_thr.thread);
+		vout_thr.thread = NULL;
+	}
+	if (vout_thr.cond) { scond_free(vout_thr.cond); vout_thr.cond = NULL; }
+	if (vout_thr.lock) { slock_free(vout_thr.lock); vout_thr.lock = NULL; }
+	free(vout_thr.vram);
+	vout_thr.vram = NULL;
+}
+
+static void vout_thread_start(void)
+{
+	if (vout_thr.thread)
+		return;
+	// some slack as the converters may read past the line end
+	vout_thr.vram = malloc(1024 * 1024 + 4096);
+	vout_thr.lock = slock_new();
+	vout_thr.cond = scond_new();
+	vout_thr.state = VOUT_THR_IDLE;
+	vout_thr.exit = 0;
+	if (vout_thr.vram && vout_thr.lock && vout_thr.cond)
+		vout_thr.thread = pcsxr_sthread_create(vout_thread, PCSXRT_GPU);
+	if (!vout_thr.thread) {
+		fprintf(stderr, "could not start vout thread\n");
+		vout_thread_stop();
+	}
+}
+
+static int vout_can_queue(int w)
+{
+	// enhancement buffer is not snapshotted, platform blitters
+	// touch the display and neon filters read around the source rect
+	return vout_thr.thread && w <= psx_w && pl_vout_buf != NULL
+		&& !pl_plat_blit && !pl_plat_clear && !pl_plat_hud_print
+		&& pl_vout_scale_w == 1;
+}
+
+static void vout_queue(const unsigned char *vram, int vram_ofs, int bgr24,
+	int x, int y, int w, int h, int clear)
+{
+	int sstride = 2048, rows = h, r, o, len;
+
+	if (vram != NULL) {
+		if (h >= pl_vout_h * 3 / 2) {
+			sstride = 4096;
+			rows = h / 2;
+		}
+		len = w * (bgr24 ? 3 : 2);
+		for (r = 0; r < rows; r++) {
+			o = (vram_ofs + r * sstride) & 0xfffff;
+			if ((o & 2047) + len > 2048) {
+				// wraps horizontally, take the whole line
+				o &= ~2047;
+				memcpy(vout_thr.vram + o, vram + o, 2048);
+			}
+			else
+				memcpy(vout_thr.vram + o, vram + o, len);
+		}
+	}
+
+	// the thread is idle here, see pl_vout_flip()
+	hud_snapshot(&vout_thr.hud);
+	slock_lock(vout_thr.lock);
+	vout_thr.blank = vram == NULL;
+	vout_thr.vram_ofs = vram_ofs;
+	vout_thr.bgr24 = bgr24;
+	vout_thr.x = x;
+	vout_thr.y = y;
+	vout_thr.w = w;
+	vout_thr.h = h;
+	vout_thr.clear = clear;
+	vout_thr.state = VOUT_THR_QUEUED;
+	scond_signal(vout_thr.cond);
+	slock_unlock(vout_thr.lock);
+}
+#else
+static void pl_vout_sync(void) {}
+static void vout_thread_start(void) {}
+static void vout_thread_stop(void) {}
+#define vout_can_queue(w) 0
+#define vout_queue(vram, vram_ofs, bgr24, x, y, w, h, clear)
+#endif // HAVE_RTHREADS
+
+static void pl_vout_flip(const void *vram, int vram_ofs, int bgr24,
+	int x, int y, int w, int h, int dims_changed)
+{
+	struct hud_state hud;
+	int clear;
+
+	pcnt_start(PCNT_BLIT);
+
+	pl_vout_sync();
+	if (!(g_opts & OPT_THREAD_FLIP))
+		vout_thread_stop();
+
+	clear = vout_take_clear(vram, dims_changed);
+	if (vout_can_queue(w)) {
+		vout_queue(vram, vram_ofs, bgr24, x, y, w, h, clear);
+		pcnt_end(PCNT_BLIT);
+		return;
+	}
+
+	hud_snapshot(&hud);
+	vout_convert(vram, vram_ofs, bgr24, x, y, w, h, clear, &hud);
 
-out:
 	pcnt_end(PCNT_BLIT);
 
 	// let's flip now
@@ -526,6 +739,9 @@ static int pl_vout_open(void)
 
 	plat_gvideo_open(is_pal);
 
+	if (g_opts & OPT_THREAD_FLIP)
+		vout_thread_start();
+
 	gettimeofday(&now, 0);
 	vsync_usec_time = now.tv_usec;
 	while (vsync_usec_time >= frame_interval)
@@ -536,6 +752,7 @@ static int pl_vout_open(void)
 
 static void pl_vout_close(void)
 {
+	vout_thread_stop();
 	plat_gvideo_close();
 }
 
@@ -546,7 +763,10 @@ static void pl_set_gpu_caps(int caps)
 
 void *pl_prepare_screenshot(int *w, int *h, int *bpp)
 {
-	void *ret = plat_prepare_screenshot(w, h, bpp);
+	void *ret;
+
+	pl_vout_sync();
+	ret = plat_prepare_screenshot(w, h, bpp);
 	if (ret != NULL)
 		return ret;
 
@@ -773,18 +993,36 @@ void pl_gun_byte2(int port, unsigned char byte)
 		in_analog_left[port][1] * psx_h / 1024);
 }
 
+/* called from the pad plugin on the first read after a vsync
+ * (same thread as pl_frame_limit), so the game sees the freshest input */
+void pl_input_latch(void)
+{
+	in_latch_pending = 0;
+	update_input();
+}
+
 #define MAX_LAG_FRAMES 3
 
 #define tvdiff(tv, tv_old) \
 	((tv.tv_sec - tv_old.tv_sec) * 1000000 + tv.tv_usec - tv_old.tv_usec)
 
+static long long pl_get_usec(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
 /* called on every vsync */
 void pl_frame_limit(void)
 {
-	static struct timeval tv_old, tv_expect;
+	static struct timeval tv_old, tv_expect, tv_busy;
 	static int vsync_cnt_prev, drc_active_vsyncs;
 	struct timeval now;
-	int diff, usadj;
+	int diff, usadj, busy;
+
+	// show the frame converted while this one was emulated
+	pl_vout_sync();
 
 	if (g_emu_resetting)
 		return;
@@ -792,8 +1030,12 @@ void pl_frame_limit(void)
 	vsync_cnt++;
 
 	/* doing input here because the pad is polled
-	 * thousands of times per frame for some reason */
-	update_input();
+	 * thousands of times per frame for some reason.
+	 * With late latching it's done on the first poll instead,
+	 * here only if the game didn't poll at all during the frame. */
+	if (!(g_opts & OPT_LATE_INPUT) || in_latch_pending)
+		update_input();
+	in_latch_pending = (g_opts & OPT_LATE_INPUT) != 0;
 
 	pcnt_end(PCNT_ALL);
 	gettimeofday(&now, 0);
@@ -805,9 +1047,12 @@ void pl_frame_limit(void)
 			pl_rearmed_cbs.vsps_cur = 1000000.0f * (vsync_cnt - vsync_cnt_prev) / diff;
 		vsync_cnt_prev = vsync_cnt;
 
-		if (g_opts & OPT_SHOWFPS)
+		if (g_opts & OPT_SHOWFPS) {
 			pl_rearmed_cbs.flips_per_sec = pl_rearmed_cbs.flip_cnt;
+			fskip_per_sec = pl_rearmed_cbs.fskip.skipped;
+		}
 		pl_rearmed_cbs.flip_cnt = 0;
+		pl_rearmed_cbs.fskip.skipped = pl_rearmed_cbs.fskip.predicted = 0;
 		if (g_opts & OPT_SHOWCPU)
 			pl_rearmed_cbs.cpu_usage = get_cpu_ticks();
 
@@ -858,16 +1103,26 @@ void pl_frame_limit(void)
 		else if (diff >= 0)
 			pl_rearmed_cbs.fskip_advice = 0;
 
+		// for gpulib's cost model: busy time since the last frame was
+		// let go, and what the next one has after the sleep above
+		busy = tvdiff(now, tv_busy);
+		if (0 <= busy && busy < MAX_LAG_FRAMES * frame_interval)
+			pl_rearmed_cbs.fskip.busy_us += busy;
+		pl_rearmed_cbs.fskip.slack_us = diff < frame_interval ? diff : frame_interval;
+
 		// recompilation is not that fast and may cause frame skip on
 		// loading screens and such, resulting in flicker or glitches
 		if (ndrc_g.did_compile) {
-			if (drc_active_vsyncs < 32)
+			if (drc_active_vsyncs < 32) {
 				pl_rearmed_cbs.fskip_advice = 0;
+				pl_rearmed_cbs.fskip.slack_us = INT_MAX;
+			}
 			drc_active_vsyncs++;
 		}
 		else
 			drc_active_vsyncs = 0;
 		ndrc_g.did_compile = 0;
+		gettimeofday(&tv_busy, 0);
 	}
 
 	pcnt_start(PCNT_ALL);
@@ -914,6 +1169,7 @@ struct rearmed_cbs pl_rearmed_cbs = {
 	.munmap = pl_munmap,
 	.pl_set_gpu_caps = pl_set_gpu_caps,
 	.gpu_state_change = gpu_state_change,
+	.fskip.get_usec = pl_get_usec,
 };
 
 /* watchdog */
@@ -988,13 +1244,18 @@ void pl_start_watchdog(void)
 static void *pl_emu_mmap(unsigned long addr, size_t size,
 	enum psxMapTag tag, int *can_retry_addr)
 {
+	if (psxMapHugePages && (tag == MAP_TAG_RAM || tag == MAP_TAG_VRAM))
+		return psxMapDefault(addr, size, tag, can_retry_addr);
 	*can_retry_addr = 1;
 	return plat_mmap(addr, size, 0, 0);
 }
 
 static void pl_emu_munmap(void *ptr, size_t size, enum psxMapTag tag)
 {
-	plat_munmap(ptr, size);
+	if (psxMapHugePages && (tag == MAP_TAG_RAM || tag == MAP_TAG_VRAM))
+		psxUnmapDefault(ptr, size, tag);
+	else
+		plat_munmap(ptr, size);
 }
 
 static void *pl_mmap(unsigned int size)
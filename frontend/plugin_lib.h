@@ -26,6 +26,7 @@ extern int in_analog_left[8][2];
 extern int in_analog_right[8][2];
 extern unsigned short in_keystate[8];
 extern int in_mouse[8][2];
+extern int in_latch_pending;
 
 extern int in_adev[2], in_adev_axis[2][2];
 extern int in_adev_is_nublike[2];
@@ -44,6 +45,7 @@ void  pl_force_clear(void);
 
 void  pl_timing_prepare(int is_pal);
 void  pl_frame_limit(void);
+void  pl_input_latch(void);
 void  pl_update_layer_size(int w, int h, int fw, int fh);
 
 // for communication with gpulib
@@ -73,6 +75,16 @@ struct rearmed_cbs {
 	int   fskip_advice;
 	int   fskip_force;
 	int   fskip_dirty;
+	// auto frameskip cost model, used by gpulib when get_usec is set:
+	// the frontend adds emulation time to busy_us and sets slack_us each
+	// vsync, gpulib takes busy_us at each flip and keeps the rest
+	struct rearmed_fskip {
+		long long (*get_usec)(void);
+		int   busy_us;
+		int   slack_us;       // time the next vsync may take, <0 if late
+		int   cpu_us, gpu_us; // weighted averages per vsync
+		unsigned int skipped, predicted; // reset by frontend
+	} fskip;
 	unsigned int *gpu_frame_count;
 	unsigned int *gpu_hcnt;
 	unsigned int flip_cnt; // increment manually if not using pl_vout_flip
@@ -90,6 +102,7 @@ struct rearmed_cbs {
 		int   dwActFixes;
 		float fFrameRateHz;
 		int   dwFrameRateTicks;
+		int   threaded;
 	} gpu_peops;
 	struct {
 		int old_renderer;
@@ -97,6 +110,7 @@ struct rearmed_cbs {
 		int lighting;
 		int fast_lighting;
 		int blending;
+		int threaded;
 	} gpu_unai;
 	struct {
 		int   dwActFixes;
@@ -44,8 +44,10 @@ SOURCES_C := $(CORE_DIR)/cdriso.c \
              $(CORE_DIR)/psxdma.c \
              $(CORE_DIR)/psxevents.c \
              $(CORE_DIR)/psxhw.c \
+             $(CORE_DIR)/psxidle.c \
              $(CORE_DIR)/psxinterpreter.c \
              $(CORE_DIR)/psxmem.c \
+             $(CORE_DIR)/psxtrace.c \
              $(CORE_DIR)/r3000a.c \
              $(CORE_DIR)/sio.c \
              $(CORE_DIR)/spu.c \
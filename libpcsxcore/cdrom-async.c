@@ -11,6 +11,7 @@
  ***************************************************************************/
 
 #include <stdalign.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "system.h"
@@ -46,6 +47,23 @@ static int  rcdrom_isMediaInserted(void *stream) { return 0; }
 #ifdef HAVE_LIBRETRO
 #include "retro_timers.h"
 #endif
+#if defined(__linux__) && !defined(HAVE_LIBRETRO)
+#include <sys/mman.h>
+#endif
+
+#ifdef __GNUC__
+#define LBA_ACQ(lba_) __atomic_load_n(&(lba_), __ATOMIC_ACQUIRE)
+#define LBA_REL(lba_, v_) __atomic_store_n(&(lba_), (v_), __ATOMIC_RELEASE)
+#else
+#define LBA_ACQ(lba_) (~0u) // no lock-free reads then
+#define LBA_REL(lba_, v_) (lba_) = (v_)
+#endif
+
+// resident mode doesn't look further than this for a prefetch,
+// the background fill takes care of the rest
+#define RESIDENT_PREFETCH_MAX 1024
+// cdda sectors pinned in the cache at once
+#define CDDA_BATCH 8
 
 struct cached_buf {
    u32 lba;
@@ -59,14 +77,31 @@ static struct {
    scond_t *cond;
    struct cached_buf *buf_cache;
    u32 buf_cnt, thread_exit, do_prefetch, prefetch_failed, have_subchannel;
+   u32 buf_cnt_cfg, want_resident;
+   // resident: a slot for every sector of the disc, filled in the
+   // background, which never changes once there so can be read lock-free
+   u32 resident, fill_lba;
    u32 total_lba, prefetch_lba;
+   u32 seek_lba, seek_cnt, last_lba;
    int check_eject_delay;
 
    // single sector cache, not touched by the thread
    alignas(64) u8 buf_local[CD_FRAMESIZE_RAW_ALIGNED];
+
+   // cdda sectors lba..lba+cnt-1 are handed out from buf_cache in place,
+   // the thread doesn't replace them (changed under buf_lock only)
+   u32 cdda_lba, cdda_cnt;
+   // cdda sector read on a cache miss, not touched by the thread
+   alignas(64) u8 cdda_buf[CD_FRAMESIZE_RAW_ALIGNED];
 } acdrom;
 
-static void lbacache_do(u32 lba)
+// with buf_lock held
+static int cdda_pinned(u32 i)
+{
+   return acdrom.buf_cache[i].lba - acdrom.cdda_lba < acdrom.cdda_cnt;
+}
+
+static int lbacache_do(u32 lba)
 {
    alignas(64) unsigned char buf[CD_FRAMESIZE_RAW_ALIGNED];
    unsigned char msf[3], buf_sub[SUB_FRAMESIZE];
@@ -95,22 +130,24 @@ static void lbacache_do(u32 lba)
       acdrom.prefetch_failed = 1;
       slock_unlock(acdrom.buf_lock);
       SysPrintf("prefetch: read failed for lba %d: %d\n", lba, ret);
-      return;
+      return ret;
    }
    acdrom.prefetch_failed = 0;
    acdrom.check_eject_delay = 100;
 
-   if (lba != acdrom.buf_cache[i].lba) {
-      acdrom.buf_cache[i].lba = lba;
+   if (lba != acdrom.buf_cache[i].lba && !cdda_pinned(i)) {
+      // the lba goes last for lock-free readers of the resident mode
       memcpy(acdrom.buf_cache[i].buf, buf, sizeof(acdrom.buf_cache[i].buf));
       if (acdrom.have_subchannel)
          memcpy(acdrom.buf_cache[i].buf_sub, buf_sub, sizeof(buf_sub));
+      LBA_REL(acdrom.buf_cache[i].lba, lba);
    }
    slock_unlock(acdrom.buf_lock);
 #ifdef HAVE_LIBRETRO
    if (g_cd_handle)
       retro_sleep(0); // why does the main thread stall without this?
 #endif
+   return 0;
 }
 
 static int lbacache_get(unsigned int lba, void *buf, void *sub_buf)
@@ -131,11 +168,329 @@ static int lbacache_get(unsigned int lba, void *buf, void *sub_buf)
    return ret;
 }
 
+/*
+ * ISO9660 awareness: while idle, the thread walks the directory tree of
+ * the data track and collects the file extents. A prefetch then covers
+ * the rest of the file the game is in, the first sectors of the file it
+ * loaded next the last time (learned from seeks and saved per disc), and
+ * only then what follows on the disc. Without a filesystem it's all linear.
+ * Everything here is only touched by the thread (or with it stopped).
+ */
+#define ISO_MAX_DIRS  1024
+#define ISO_MAX_FILES 8192
+#define ISO_NEXT_SECTORS 16
+#define ISO_NONE 0xffff
+
+struct iso_extent {
+   u32 lba, cnt;
+};
+static struct {
+   struct iso_extent *files;
+   struct iso_extent *dirs;
+   u16 *next;                   // learned file that gets loaded after
+   u32 file_cnt, dir_cnt;
+   u32 dir, dir_sector;         // parse position
+   u32 parsing, dirty;
+   u32 id;                      // hash of the volume descriptor
+   u32 seek_cnt;
+   u16 last_file;
+} iso;
+static char hint_dir[MAXPATHLEN];
+
+static u32 le32(const u8 *p)
+{
+   return p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24);
+}
+
+// data (not raw) sector, for the parser
+static int iso_read_data(u32 lba, u8 *buf, const u8 **data)
+{
+   unsigned char msf[3];
+   int ret;
+
+   lba2msf(lba + 150, &msf[0], &msf[1], &msf[2]);
+   slock_lock(acdrom.read_lock);
+   if (g_cd_handle)
+      ret = rcdrom_readSector(g_cd_handle, lba, buf);
+   else
+      ret = ISOreadTrack(msf, buf);
+   slock_unlock(acdrom.read_lock);
+   *data = buf + (buf[12 + 3] == 1 ? 16 : 24);
+   return ret;
+}
+
+static int iso_cmp_extent(const void *a_, const void *b_)
+{
+   const struct iso_extent *a = a_, *b = b_;
+   if (a->lba != b->lba)
+      return a->lba < b->lba ? -1 : 1;
+   return a->cnt < b->cnt ? 1 : (a->cnt > b->cnt ? -1 : 0);
+}
+
+// file containing lba, or ISO_NONE
+static u32 iso_find(u32 lba)
+{
+   u32 lo = 0, hi = iso.file_cnt, mid;
+
+   if (iso.parsing || hi == 0)
+      return ISO_NONE;
+   while (hi - lo > 1) {
+      mid = (lo + hi) / 2;
+      if (iso.files[mid].lba <= lba)
+         lo = mid;
+      else
+         hi = mid;
+   }
+   if (lba - iso.files[lo].lba < iso.files[lo].cnt)
+      return lo;
+   return ISO_NONE;
+}
+
+static void iso_hint_path(char *buf, size_t size)
+{
+   snprintf(buf, size, "%s%s%08x.cdh", hint_dir,
+      hint_dir[strlen(hint_dir) - 1] == '/' ? "" : "/", iso.id);
+}
+
+// pairs of (extent lba of a file, extent lba of the one loaded after it)
+static void iso_hints_load(void)
+{
+   char path[MAXPATHLEN + 16];
+   u32 pair[2], a, b;
+   int loaded = 0;
+   FILE *f;
+
+   if (!hint_dir[0])
+      return;
+   iso_hint_path(path, sizeof(path));
+   f = fopen(path, "rb");
+   if (!f)
+      return;
+   while (fread(pair, sizeof(pair), 1, f) == 1) {
+      a = iso_find(pair[0]);
+      b = iso_find(pair[1]);
+      if (a != ISO_NONE && b != ISO_NONE && iso.files[a].lba == pair[0]
+          && iso.files[b].lba == pair[1]) {
+         iso.next[a] = b;
+         loaded++;
+      }
+   }
+   fclose(f);
+   SysPrintf("cdrom precache: %d learned hints\n", loaded);
+}
+
+static void iso_hints_save(void)
+{
+   char path[MAXPATHLEN + 16];
+   u32 i, pair[2];
+   FILE *f;
+
+   if (!hint_dir[0] || !iso.dirty || iso.parsing)
+      return;
+   iso.dirty = 0;
+   iso_hint_path(path, sizeof(path));
+   f = fopen(path, "wb");
+   if (!f)
+      return;
+   for (i = 0; i < iso.file_cnt; i++) {
+      if (iso.next[i] == ISO_NONE)
+         continue;
+      pair[0] = iso.files[i].lba;
+      pair[1] = iso.files[iso.next[i]].lba;
+      fwrite(pair, sizeof(pair), 1, f);
+   }
+   fclose(f);
+}
+
+static void iso_parse_done(int ok)
+{
+   u32 i, j;
+
+   iso.parsing = 0;
+   free(iso.dirs);
+   iso.dirs = NULL;
+   if (ok && iso.file_cnt)
+      iso.next = malloc(iso.file_cnt * sizeof(iso.next[0]));
+   if (!iso.next) {
+      iso.file_cnt = 0;
+      return;
+   }
+   qsort(iso.files, iso.file_cnt, sizeof(iso.files[0]), iso_cmp_extent);
+   for (i = j = 1; i < iso.file_cnt; i++)
+      if (iso.files[i].lba != iso.files[j - 1].lba)
+         iso.files[j++] = iso.files[i];
+   iso.file_cnt = j;
+   for (i = 0; i < iso.file_cnt; i++)
+      iso.next[i] = ISO_NONE;
+   iso.last_file = ISO_NONE;
+   SysPrintf("cdrom precache: %u files\n", iso.file_cnt);
+   iso_hints_load();
+}
+
+static void iso_add(struct iso_extent *list, u32 *cnt, u32 max, u32 lba, u32 size)
+{
+   u32 sectors = (size + 2047) / 2048;
+   if (*cnt >= max || sectors == 0 || lba >= acdrom.total_lba)
+      return;
+   list[*cnt].lba = lba;
+   list[*cnt].cnt = sectors;
+   (*cnt)++;
+}
+
+// reads and parses one sector of the directory tree
+static void iso_parse_step(void)
+{
+   alignas(64) u8 buf[CD_FRAMESIZE_RAW_ALIGNED];
+   const u8 *d, *rec;
+   u32 lba, o;
+   int i;
+
+   if (iso.dirs == NULL) {
+      // primary volume descriptor
+      iso.files = malloc(ISO_MAX_FILES * sizeof(iso.files[0]));
+      iso.dirs = malloc(ISO_MAX_DIRS * sizeof(iso.dirs[0]));
+      if (!iso.files || !iso.dirs || iso_read_data(16, buf, &d)
+          || d[0] != 1 || memcmp(d + 1, "CD001", 5)) {
+         iso_parse_done(0);
+         return;
+      }
+      for (i = 0, iso.id = 0x811c9dc5; i < 2048; i++)
+         iso.id = (iso.id ^ d[i]) * 0x01000193;
+      iso_add(iso.dirs, &iso.dir_cnt, ISO_MAX_DIRS, le32(d + 156 + 2),
+         le32(d + 156 + 10));
+      return;
+   }
+   if (iso.dir >= iso.dir_cnt) {
+      iso_parse_done(1);
+      return;
+   }
+
+   lba = iso.dirs[iso.dir].lba + iso.dir_sector;
+   if (++iso.dir_sector >= iso.dirs[iso.dir].cnt) {
+      iso.dir++;
+      iso.dir_sector = 0;
+   }
+   if (iso_read_data(lba, buf, &d)) {
+      iso_parse_done(0);
+      return;
+   }
+   for (o = 0; o + 34 <= 2048 && d[o] != 0; o += d[o]) {
+      rec = d + o;
+      if (rec[0] < 34 || o + rec[0] > 2048)
+         break;
+      if (rec[32] == 1 && rec[33] <= 1)
+         continue; // . and ..
+      if (rec[25] & 2) {
+         // a directory, unless it's one already seen (broken images)
+         for (i = 0; i < iso.dir_cnt; i++)
+            if (iso.dirs[i].lba == le32(rec + 2))
+               break;
+         if (i == iso.dir_cnt)
+            iso_add(iso.dirs, &iso.dir_cnt, ISO_MAX_DIRS, le32(rec + 2),
+               le32(rec + 10));
+      }
+      else
+         iso_add(iso.files, &iso.file_cnt, ISO_MAX_FILES, le32(rec + 2),
+            le32(rec + 10));
+   }
+}
+
+static void iso_free(void)
+{
+   iso_hints_save();
+   free(iso.files);
+   free(iso.dirs);
+   free(iso.next);
+   memset(&iso, 0, sizeof(iso));
+}
+
+// a game seeked to lba, remember what it loaded after the previous file
+static void iso_learn(u32 lba)
+{
+   u32 f = iso_find(lba);
+
+   if (f == ISO_NONE)
+      return;
+   if (iso.last_file != ISO_NONE && iso.last_file != f
+       && iso.next[iso.last_file] != f) {
+      iso.next[iso.last_file] = f;
+      iso.dirty = 1;
+   }
+   iso.last_file = f;
+}
+
+struct lba_range {
+   u32 from, to;
+};
+
+// what to have in the cache when the game is reading at lba
+static int prefetch_plan(u32 lba, struct lba_range *r)
+{
+   u32 budget = acdrom.buf_cnt, end, f, n, cnt;
+   const struct iso_extent *nx;
+
+   if (acdrom.resident && budget > RESIDENT_PREFETCH_MAX)
+      budget = RESIDENT_PREFETCH_MAX;
+   end = lba + budget;
+   if (end > acdrom.total_lba)
+      end = acdrom.total_lba;
+   f = iso_find(lba);
+   if (f == ISO_NONE || iso.files[f].lba + iso.files[f].cnt >= end) {
+      r[0].from = lba; r[0].to = end;
+      return 1;
+   }
+
+   r[0].from = lba;
+   r[0].to = iso.files[f].lba + iso.files[f].cnt;
+   budget -= r[0].to - lba;
+   n = 1;
+   if (iso.next[f] != ISO_NONE) {
+      nx = &iso.files[iso.next[f]];
+      cnt = nx->cnt < ISO_NEXT_SECTORS ? nx->cnt : ISO_NEXT_SECTORS;
+      if (cnt > budget)
+         cnt = budget;
+      r[n].from = nx->lba; r[n].to = nx->lba + cnt;
+      budget -= cnt;
+      n++;
+   }
+   end = r[0].to + budget;
+   if (end > acdrom.total_lba)
+      end = acdrom.total_lba;
+   r[n].from = r[0].to; r[n].to = end;
+   return n + 1;
+}
+
+// first sector of the plan not in the cache, or ~0
+static u32 prefetch_next(u32 lba)
+{
+   u32 buf_cnt = acdrom.buf_cnt, x, y;
+   struct lba_range r[3];
+   int i, j, n;
+
+   if (lba >= acdrom.total_lba)
+      return ~0;
+   n = prefetch_plan(lba, r);
+   for (i = 0; i < n; i++) {
+      for (x = r[i].from; x < r[i].to; x++) {
+         // don't evict what an earlier part of the plan has put there
+         for (j = 0; j < i; j++) {
+            y = r[j].from + (x % buf_cnt + buf_cnt - r[j].from % buf_cnt) % buf_cnt;
+            if (y < r[j].to && y != x)
+               break;
+         }
+         if (j == i && x != acdrom.buf_cache[x % buf_cnt].lba
+             && !cdda_pinned(x % buf_cnt))
+            return x;
+      }
+   }
+   return ~0;
+}
+
 // note: This has races on some vars but that's ok, main thread can deal
 // with it. Only unsafe buffer accesses and simultaneous reads are prevented.
 static STRHEAD_RET_TYPE cdra_prefetch_thread(void *unused)
 {
-   u32 buf_cnt, lba, lba_to;
+   u32 lba;
 
    slock_lock(acdrom.buf_lock);
    while (!acdrom.thread_exit)
@@ -143,21 +498,35 @@ static STRHEAD_RET_TYPE cdra_prefetch_thread(void *unused)
 #ifdef __GNUC__
       __asm__ __volatile__("":::"memory"); // barrier
 #endif
+      if (!acdrom.do_prefetch && iso.parsing) {
+         slock_unlock(acdrom.buf_lock);
+         iso_parse_step();
+         slock_lock(acdrom.buf_lock);
+         continue;
+      }
+      if (!acdrom.do_prefetch && acdrom.fill_lba < acdrom.total_lba) {
+         lba = acdrom.fill_lba++;
+         if (lba == acdrom.buf_cache[lba].lba)
+            continue;
+         slock_unlock(acdrom.buf_lock);
+         if (lbacache_do(lba))
+            acdrom.fill_lba = acdrom.total_lba; // give up
+         else if (acdrom.fill_lba == acdrom.total_lba)
+            SysPrintf("cdrom precache: whole disc in RAM\n");
+         slock_lock(acdrom.buf_lock);
+         continue;
+      }
       if (!acdrom.do_prefetch)
          scond_wait(acdrom.cond, acdrom.buf_lock);
       if (!acdrom.do_prefetch || acdrom.thread_exit)
          continue;
 
-      buf_cnt = acdrom.buf_cnt;
-      lba = acdrom.prefetch_lba;
-      lba_to = lba + buf_cnt;
-      if (lba_to > acdrom.total_lba)
-         lba_to = acdrom.total_lba;
-      for (; lba < lba_to; lba++) {
-         if (lba != acdrom.buf_cache[lba % buf_cnt].lba)
-            break;
+      if (iso.seek_cnt != acdrom.seek_cnt) {
+         iso.seek_cnt = acdrom.seek_cnt;
+         iso_learn(acdrom.seek_lba);
       }
-      if (lba == lba_to || lba >= acdrom.total_lba) {
+      lba = prefetch_next(acdrom.prefetch_lba);
+      if (lba == ~0u) {
          // caching complete
          acdrom.do_prefetch = 0;
          continue;
@@ -188,8 +557,29 @@ void cdra_stop_thread(void)
    if (acdrom.cond) { scond_free(acdrom.cond); acdrom.cond = NULL; }
    if (acdrom.buf_lock) { slock_free(acdrom.buf_lock); acdrom.buf_lock = NULL; }
    if (acdrom.read_lock) { slock_free(acdrom.read_lock); acdrom.read_lock = NULL; }
+   cdrDropCddaPtr();
+   acdrom.cdda_cnt = 0;
    free(acdrom.buf_cache);
    acdrom.buf_cache = NULL;
+   acdrom.resident = 0;
+   iso_free();
+}
+
+static void *cdra_alloc_cache(u32 count)
+{
+   void *p = calloc(count, sizeof(acdrom.buf_cache[0]));
+#if defined(__linux__) && !defined(HAVE_LIBRETRO) && defined(MADV_HUGEPAGE)
+   // large callocs are fresh mmaps, so this is just a hint for the
+   // (page aligned) part of it
+   if (p && Config.HugePages) {
+      size_t huge = 2*1024*1024, size = count * sizeof(acdrom.buf_cache[0]);
+      uintptr_t start = ((uintptr_t)p + huge - 1) & ~(huge - 1);
+      uintptr_t end = ((uintptr_t)p + size) & ~(huge - 1);
+      if (end > start)
+         madvise((void *)start, end - start, MADV_HUGEPAGE);
+   }
+#endif
+   return p;
 }
 
 // the thread is optional, if anything fails we can do direct reads
@@ -198,9 +588,26 @@ static void cdra_start_thread(void)
    cdra_stop_thread();
    acdrom.thread_exit = acdrom.prefetch_lba = acdrom.do_prefetch = 0;
    acdrom.prefetch_failed = 0;
+   acdrom.seek_cnt = 0;
+   acdrom.last_lba = ~0;
+   acdrom.buf_cnt = acdrom.buf_cnt_cfg;
+   acdrom.fill_lba = ~0;
+   if (acdrom.total_lba && (acdrom.want_resident
+       || acdrom.buf_cnt >= acdrom.total_lba)) {
+      acdrom.buf_cache = cdra_alloc_cache(acdrom.total_lba);
+      if (acdrom.buf_cache) {
+         acdrom.buf_cnt = acdrom.total_lba;
+         acdrom.resident = 1;
+         acdrom.fill_lba = 0;
+      }
+      else
+         SysPrintf("cdrom precache: no memory for the whole disc\n");
+   }
    if (acdrom.buf_cnt == 0)
       return;
-   acdrom.buf_cache = calloc(acdrom.buf_cnt, sizeof(acdrom.buf_cache[0]));
+   iso.parsing = 1;
+   if (!acdrom.buf_cache)
+      acdrom.buf_cache = cdra_alloc_cache(acdrom.buf_cnt);
    acdrom.buf_lock = slock_new();
    acdrom.read_lock = slock_new();
    acdrom.cond = scond_new();
@@ -212,8 +619,9 @@ static void cdra_start_thread(void)
          acdrom.buf_cache[i].lba = ~0;
    }
    if (acdrom.thread) {
-      SysPrintf("cdrom precache: %d buffers%s\n",
-            acdrom.buf_cnt, acdrom.have_subchannel ? " +sub" : "");
+      SysPrintf("cdrom precache: %d buffers%s%s\n",
+            acdrom.buf_cnt, acdrom.have_subchannel ? " +sub" : "",
+            acdrom.resident ? ", resident" : "");
    }
    else {
       SysPrintf("cdrom precache thread init failed.\n");
@@ -239,6 +647,7 @@ int cdra_open(void)
 
    acdrom_dbg("%s %s\n", __func__, name);
    acdrom.have_subchannel = 0;
+   acdrom.cdda_cnt = 0;
    if (!name[0] || !strncmp(name, "cdrom:", 6)) {
       g_cd_handle = rcdrom_open(name, &acdrom.total_lba, &acdrom.have_subchannel);
       if (!!g_cd_handle)
@@ -266,6 +675,8 @@ void cdra_close(void)
 {
    acdrom_dbg("%s\n", __func__);
    cdra_stop_thread();
+   acdrom.total_lba = 0;
+   acdrom.cdda_cnt = 0;
    if (g_cd_handle) {
       rcdrom_close(g_cd_handle);
       g_cd_handle = NULL;
@@ -300,6 +711,11 @@ int cdra_prefetch(unsigned char m, unsigned char s, unsigned char f)
 {
    u32 lba = MSF2SECT(m, s, f);
    int ret = 1;
+   if (lba != acdrom.last_lba + 1 && lba != acdrom.last_lba) {
+      acdrom.seek_lba = lba;
+      acdrom.seek_cnt++;
+   }
+   acdrom.last_lba = lba;
    if (acdrom.cond) {
       acdrom.prefetch_lba = lba;
       acdrom.do_prefetch = 1;
@@ -321,6 +737,15 @@ static int cdra_do_read(const unsigned char *time, int cdda,
    int hit = 0, ret = -1, read_locked = 0;
    do
    {
+      if (acdrom.resident && lba < acdrom.buf_cnt
+          && LBA_ACQ(acdrom.buf_cache[lba].lba) == lba) {
+         if (buf)
+            memcpy(buf, acdrom.buf_cache[lba].buf, CD_FRAMESIZE_RAW);
+         if (buf_sub)
+            memcpy(buf_sub, acdrom.buf_cache[lba].buf_sub, SUB_FRAMESIZE);
+         hit = 1;
+         break;
+      }
       if (acdrom.buf_lock) {
          hit = lbacache_get(lba, buf, buf_sub);
          if (hit)
@@ -364,6 +789,26 @@ static int cdra_do_read(const unsigned char *time, int cdda,
    return ret;
 }
 
+// pins lba and as many cached sectors after it as possible, unpins all
+// if lba isn't cached (~0 to just unpin), returns the number pinned
+static u32 cdda_pin(u32 lba)
+{
+   u32 n = 0, buf_cnt = acdrom.buf_cnt;
+
+   if (!acdrom.buf_lock)
+      return 0;
+   slock_lock(acdrom.buf_lock);
+   for (; n < CDDA_BATCH && n < buf_cnt / 2 && lba + n < acdrom.total_lba; n++)
+      if (acdrom.buf_cache[(lba + n) % buf_cnt].lba != lba + n)
+         break;
+   acdrom.cdda_lba = lba;
+   acdrom.cdda_cnt = n;
+   slock_unlock(acdrom.buf_lock);
+   if (n)
+      acdrom_dbg("fb %d %d\n", lba, n);
+   return n;
+}
+
 // time: msf in non-bcd format
 int cdra_readTrack(const unsigned char *time)
 {
@@ -371,6 +816,8 @@ int cdra_readTrack(const unsigned char *time)
       // just forward to ISOreadTrack to avoid extra copying
       return ISOreadTrack(time, NULL);
    }
+   if (acdrom.cdda_cnt)
+      cdda_pin(~0);
    return cdra_do_read(time, 0, acdrom.buf_local, NULL);
 }
 
@@ -379,6 +826,31 @@ int cdra_readCDDA(const unsigned char *time, void *buffer)
    return cdra_do_read(time, 1, buffer, NULL);
 }
 
+/*
+ * For cdda playback, one sector per call like cdra_readCDDA, but the
+ * returned data stays valid until the next call. Cached sectors are used
+ * in place: the ones that follow lba are pinned a batch at a time so that
+ * the thread can't replace them while they are being played, the resident
+ * mode never replaces anything. Only a cache miss is read into cdda_buf.
+ */
+const void *cdra_readCDDAptr(const unsigned char *time)
+{
+   u32 lba = MSF2SECT(time[0], time[1], time[2]);
+
+   if (acdrom.resident && lba < acdrom.buf_cnt
+       && LBA_ACQ(acdrom.buf_cache[lba].lba) == lba) {
+      acdrom.check_eject_delay = 100;
+      return acdrom.buf_cache[lba].buf;
+   }
+   if (lba - acdrom.cdda_lba < acdrom.cdda_cnt || cdda_pin(lba)) {
+      acdrom.check_eject_delay = 100;
+      return acdrom.buf_cache[lba % acdrom.buf_cnt].buf;
+   }
+   if (cdra_do_read(time, 1, acdrom.cdda_buf, NULL))
+      return NULL;
+   return acdrom.cdda_buf;
+}
+
 int cdra_readSub(const unsigned char *time, void *buffer)
 {
    if (!acdrom.thread && !g_cd_handle)
@@ -425,16 +897,37 @@ int cdra_check_eject(int *inserted)
 
 void cdra_set_buf_count(int newcount)
 {
-   if (acdrom.buf_cnt == newcount)
+   if (acdrom.buf_cnt_cfg == newcount)
       return;
    cdra_stop_thread();
-   acdrom.buf_cnt = newcount;
+   acdrom.buf_cnt_cfg = newcount;
    cdra_start_thread();
 }
 
 int cdra_get_buf_count(void)
 {
-   return acdrom.buf_cnt;
+   return acdrom.buf_cnt_cfg;
+}
+
+// keep the whole disc in RAM, filled in the background after open
+void cdra_set_resident(int enable)
+{
+   if (acdrom.want_resident == !!enable)
+      return;
+   cdra_stop_thread();
+   acdrom.want_resident = !!enable;
+   cdra_start_thread();
+}
+
+int cdra_get_resident(void)
+{
+   return acdrom.want_resident;
+}
+
+// where the learned per disc prefetch hints go, "" to not keep them
+void cdra_set_hint_dir(const char *dir)
+{
+   snprintf(hint_dir, sizeof(hint_dir), "%s", dir ? dir : "");
 }
 
 int cdra_get_buf_cached_approx(void)
@@ -444,6 +937,8 @@ int cdra_get_buf_cached_approx(void)
    u32 left = buf_cnt;
    int buf_use = 0;
 
+   if (left > acdrom.buf_cnt_cfg)
+      left = acdrom.buf_cnt_cfg;
    if (left > total)
       left = total;
    for (; lba < total && left > 0; lba++, left--)
@@ -509,6 +1004,12 @@ int cdra_readCDDA(const unsigned char *time, void *buffer)
    return ISOreadCDDA(time, buffer);
 }
 
+const void *cdra_readCDDAptr(const unsigned char *time)
+{
+   alignas(64) static u8 buf[CD_FRAMESIZE_RAW_ALIGNED];
+   return ISOreadCDDA(time, buf) ? NULL : buf;
+}
+
 int cdra_readSub(const unsigned char *time, void *buffer)
 {
    return ISOreadSub(time, buffer);
@@ -529,6 +1030,9 @@ int cdra_is_physical(void) { return 0; }
 int cdra_check_eject(int *inserted) { return 0; }
 void cdra_stop_thread(void) {}
 void cdra_set_buf_count(int newcount) {}
+void cdra_set_hint_dir(const char *dir) {}
+void cdra_set_resident(int enable) {}
+int  cdra_get_resident(void) { return 0; }
 int  cdra_get_buf_count(void) { return 0; }
 int  cdra_get_buf_cached_approx(void) { return 0; }
 
@@ -26,6 +26,7 @@ int  cdra_getTD(int track, unsigned char *rt);
 int  cdra_getStatus(struct CdrStat *stat);
 int  cdra_readTrack(const unsigned char *time);
 int  cdra_readCDDA(const unsigned char *time, void *buffer);
+const void *cdra_readCDDAptr(const unsigned char *time);
 int  cdra_readSub(const unsigned char *time, void *buffer);
 int  cdra_prefetch(unsigned char m, unsigned char s, unsigned char f);
 
@@ -35,6 +36,9 @@ void cdra_stop_thread(void);
 void cdra_set_buf_count(int count);
 int  cdra_get_buf_count(void);
 int  cdra_get_buf_cached_approx(void);
+void cdra_set_hint_dir(const char *dir);
+void cdra_set_resident(int enable);
+int  cdra_get_resident(void);
 
 void *cdra_getBuffer(void);
 
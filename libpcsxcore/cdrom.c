@@ -127,6 +127,8 @@ static struct {
 	u8 AttenuatorRightToRightT, AttenuatorRightToLeftT;
 } cdr;
 alignas(64) static s16 read_buf[CD_FRAMESIZE_RAW_ALIGNED / 2];
+// last cdda sector played, read_buf or one of cdrom-async's buffers
+static const s16 *cdda_pcm = read_buf;
 
 struct SubQ {
 	char res0[12];
@@ -558,7 +560,7 @@ static void cdrPlayInterrupt_Autopause()
 		/* 8 is a hack. For accuracy, it should be 588. */
 		for (i = 0; i < 8; i++)
 		{
-			abs_lev_max = MAX_VALUE(abs_lev_max, abs(read_buf[i * 2 + abs_lev_chselect]));
+			abs_lev_max = MAX_VALUE(abs_lev_max, abs(cdda_pcm[i * 2 + abs_lev_chselect]));
 		}
 		abs_lev_max = MIN_VALUE(abs_lev_max, 32767);
 		abs_lev_max |= abs_lev_chselect << 15;
@@ -643,7 +645,7 @@ static u32 cdrAlignTimingHack(u32 cycles)
 
 static void cdrUpdateTransferBuf(const u8 *buf);
 static void cdrReadInterrupt(void);
-static void cdrPrepCdda(s16 *buf, int samples);
+static const s16 *cdrPrepCdda(const s16 *pcm, int samples);
 
 static void msfiAdd(u8 *msfi, u32 count)
 {
@@ -712,15 +714,20 @@ void cdrPlayReadInterrupt(void)
 		cdr.DriveState = DRIVESTATE_PAUSED;
 	}
 	else {
-		cdra_readCDDA(cdr.SetSectorPlay, read_buf);
+		// no copy here, the sector is used in the cdrom cache
+		cdda_pcm = cdra_readCDDAptr(cdr.SetSectorPlay);
+		if (cdda_pcm == NULL) {
+			memset(read_buf, 0, sizeof(read_buf));
+			cdda_pcm = read_buf;
+		}
 	}
 
 	if (!cdr.IrqStat && (cdr.Mode & (MODE_AUTOPAUSE|MODE_REPORT)))
 		cdrPlayInterrupt_Autopause();
 
 	if (cdr.Play && !Config.Cdda) {
-		cdrPrepCdda(read_buf, CD_FRAMESIZE_RAW / 4);
-		SPU_playCDDAchannel(read_buf, CD_FRAMESIZE_RAW, psxRegs.cycle, 0);
+		const s16 *pcm = cdrPrepCdda(cdda_pcm, CD_FRAMESIZE_RAW / 4);
+		SPU_playCDDAchannel((short *)pcm, CD_FRAMESIZE_RAW, psxRegs.cycle, 0);
 	}
 
 	msfiAdd(cdr.SetSectorPlay, 1);
@@ -1349,14 +1356,17 @@ void cdrInterrupt(void) {
 	setIrq(IrqStat, Cmd);
 }
 
-static void cdrPrepCdda(s16 *buf, int samples)
+static const s16 *cdrPrepCdda(const s16 *pcm, int samples)
 {
 #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
 	int i;
 	for (i = 0; i < samples; i++) {
-		buf[i * 2 + 0] = SWAP16(buf[i * 2 + 0]);
-		buf[i * 2 + 1] = SWAP16(buf[i * 2 + 1]);
+		read_buf[i * 2 + 0] = SWAP16(pcm[i * 2 + 0]);
+		read_buf[i * 2 + 1] = SWAP16(pcm[i * 2 + 1]);
 	}
+	return read_buf;
+#else
+	return pcm;
 #endif
 }
 
@@ -1807,6 +1817,12 @@ void cdrReset() {
 	getCdInfo();
 }
 
+// cdrom-async is about to free the cache cdda_pcm may point into
+void cdrDropCddaPtr(void)
+{
+	cdda_pcm = read_buf;
+}
+
 int cdrFreeze(void *f, int Mode) {
 	u32 tmp;
 	u8 tmpp[3];
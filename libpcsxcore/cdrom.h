@@ -79,6 +79,7 @@ void cdrWrite1(unsigned char rt);
 void cdrWrite2(unsigned char rt);
 void cdrWrite3(unsigned char rt);
 int cdrFreeze(void *f, int Mode);
+void cdrDropCddaPtr(void);
 
 #ifdef __cplusplus
 }
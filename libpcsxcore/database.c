@@ -94,6 +94,19 @@ static const char * const f1_hack_db[] =
 	"SCES03404", "SCES03423", "SCES03424", "SCES03524",
 };
 
+/* no polling loop skipping, see psxidle.c. There is no allow list,
+ * skipping is a global opt-in and root counter polls are never skipped */
+static const char * const idle_skip_off_db[] =
+{
+	/* Internal Section - fussy about timings */
+	"SLPS01868",
+	/* Parasite Eve II - internal timer checks */
+	"SLUS01042", "SLUS01055", "SLES02558", "SLES12558",
+	"SLES02559", "SLES12559", "SLES02560", "SLES12560",
+	"SLES02561", "SLES12561", "SLES02562", "SLES12562",
+	"SCPS45467", "SCPS45468", "SLPS02480", "SLPS02481",
+};
+
 #define HACK_ENTRY(var, list) \
 	{ #var, &Config.hacks.var, list, ARRAY_SIZE(list) }
 
@@ -112,6 +125,7 @@ hack_db[] =
 	HACK_ENTRY(dualshock_init_analog, dualshock_init_analog_hack_db),
 	HACK_ENTRY(fractional_Framerate, fractional_Framerate_hack_db),
 	HACK_ENTRY(f1, f1_hack_db),
+	HACK_ENTRY(no_idle_skip, idle_skip_off_db),
 };
 
 static const struct
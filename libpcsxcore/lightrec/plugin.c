@@ -21,6 +21,8 @@
 #include "../psxinterpreter.h"
 #include "../psxhle.h"
 #include "../psxevents.h"
+#include "../psxidle.h"
+#include "../psxtrace.h"
 
 #include "../frontend/main.h"
 
@@ -178,6 +180,30 @@ static void lightrec_tansition_from_pcsx(struct lightrec_state *state)
 	}
 }
 
+/*
+ * The same hw register read again and again with the same result at a
+ * fixed interval looks like a polling loop. Make lightrec return so that
+ * psxIdleLoopAt() can check the code and skip to the next event.
+ * RAM polls are not seen here as those never leave the generated code.
+ */
+static u32 poll_mem, poll_val, poll_cycle, poll_diff;
+static bool poll_hit;
+
+static void hw_read_poll(struct lightrec_state *state, u32 mem, u32 val)
+{
+	u32 diff = psxRegs.cycle - poll_cycle;
+
+	if (mem == poll_mem && val == poll_val && diff == poll_diff
+	    && diff - 1 < 256 && psxIdleHwPollable(mem)) {
+		poll_hit = true;
+		lightrec_set_exit_flags(state, LIGHTREC_EXIT_CHECK_INTERRUPT);
+	}
+	poll_mem = mem;
+	poll_val = val;
+	poll_diff = diff;
+	poll_cycle = psxRegs.cycle;
+}
+
 static void hw_write_byte(struct lightrec_state *state,
 			  u32 op, void *host, u32 mem, u32 val)
 {
@@ -217,6 +243,7 @@ static u8 hw_read_byte(struct lightrec_state *state, u32 op, void *host, u32 mem
 	val = psxHwRead8(mem);
 
 	lightrec_tansition_from_pcsx(state);
+	hw_read_poll(state, mem, val);
 
 	return val;
 }
@@ -231,6 +258,7 @@ static u16 hw_read_half(struct lightrec_state *state,
 	val = psxHwRead16(mem);
 
 	lightrec_tansition_from_pcsx(state);
+	hw_read_poll(state, mem, val);
 
 	return val;
 }
@@ -263,6 +291,7 @@ static u32 hw_read_word(struct lightrec_state *state,
 	}
 
 	lightrec_tansition_from_pcsx(state);
+	hw_read_poll(state, mem, val);
 
 	return val;
 }
@@ -491,6 +520,8 @@ static int lightrec_plugin_init(void)
 	lightrec_map[PSX_MAP_CODE_BUFFER].address = code_buffer;
 
 	use_lightrec_interpreter = !!getenv("LIGHTREC_INTERPRETER");
+	if (LIGHTREC_ENABLE_THREADED_COMPILER && !use_lightrec_interpreter)
+		SysPrintf("lightrec: threaded compiler (build option)\n");
 
 #ifdef LIGHTREC_DEBUG
 	char *cycles = getenv("LIGHTREC_BEGIN_CYCLES");
@@ -627,6 +658,8 @@ static void lightrec_plugin_execute_internal(bool block_only)
 	u32 old_pc = psxRegs.pc;
 
 	regs = lightrec_get_registers(lightrec_state);
+	if (unlikely(psxTraceOn))
+		psxTraceStep(psxRegs.pc, psxRegs.cycle, regs->gpr, regs->cp0);
 	gen_interupt((psxCP0Regs *)regs->cp0);
 	if (!block_only && psxRegs.stop)
 		return;
@@ -681,6 +714,11 @@ static void lightrec_plugin_execute_internal(bool block_only)
 		}
 	}
 
+	if (poll_hit) {
+		poll_hit = false;
+		psxIdleLoopAt(psxRegs.pc, regs->gpr);
+	}
+
 	if (lightrec_debug && psxRegs.cycle >= lightrec_begin_cycles && psxRegs.pc != old_pc) {
 		print_for_big_ass_debugger();
 	}
@@ -731,6 +769,11 @@ static void lightrec_plugin_notify(enum R3000Anote note, void *data)
 		if (data == NULL)
 			lightrec_invalidate_all(lightrec_state);
 		break;
+	case R3000ACPU_NOTIFY_AFTER_SNAPSHOT:
+		lightrec_plugin_sync_regs_from_pcsx(true);
+		break;
+	case R3000ACPU_NOTIFY_BEFORE_LOAD:
+		break;
 	}
 }
 
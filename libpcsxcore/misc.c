@@ -26,6 +26,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <assert.h>
+#include <sys/stat.h>
 #include "misc.h"
 #include "cdrom.h"
 #include "cdrom-async.h"
@@ -702,6 +703,9 @@ struct misc_save_data {
 
 #define EX_SCREENPIC_SIZE (128 * 96 * 3)
 
+static u16 *save_thumb; // set by SaveStateIndexed()
+static void state_thumb(u16 *d, const GPUFreeze_t *gpu);
+
 int SaveState(const char *file) {
 	struct misc_save_data *misc = (void *)(psxH + 0xf000);
 	struct origin_info oi = { 0, };
@@ -770,6 +774,8 @@ int SaveState(const char *file) {
 	memset(gpufP->ulControl, 0, sizeof(gpufP->ulControl));
 	GPU_freeze(1, gpufP);
 	SaveFuncs.write(f, gpufP, sizeof(GPUFreeze_t));
+	if (save_thumb)
+		state_thumb(save_thumb, gpufP);
 	free(gpufP); gpufP = NULL;
 
 	// spu
@@ -841,6 +847,7 @@ int LoadState(const char *file) {
 	// ex-ScreenPic space
 	SaveFuncs.seek(f, EX_SCREENPIC_SIZE, SEEK_CUR);
 
+	psxCpu->Notify(R3000ACPU_NOTIFY_BEFORE_LOAD, NULL);
 	SaveFuncs.read(f, psxM, 0x00200000);
 	SaveFuncs.read(f, psxR, 0x00080000);
 	SaveFuncs.read(f, psxH, 0x00010000);
@@ -935,6 +942,340 @@ int CheckState(const char *file) {
 	return 0;
 }
 
+// In-memory state for run-ahead. The buffers are kept between calls,
+// so nothing is allocated per frame, and ram is only copied in pages
+// that differ. On load the cpu gets Clear() for just those pages, so
+// compiled code for the rest survives. Not a savestate format, only
+// valid for the running session.
+#define SNAP_PAGE 0x1000
+
+static struct {
+	u8 *ram;
+	u8 *hw;
+	GPUFreeze_t *gpu;
+	SPUFreeze_t *spu;
+	u32 spu_size;
+	u8 *buf;          // everything that goes through SaveFuncs
+	u32 buf_size, buf_alloc, pos;
+	psxRegisters regs;
+	u32 frame_counter;
+	int valid;
+} snap;
+
+static void *snap_open(const char *name, const char *mode)
+{
+	snap.pos = 0;
+	return &snap;
+}
+
+static int snap_read(void *file, void *buf, u32 len)
+{
+	if (snap.pos + len > snap.buf_size)
+		len = snap.buf_size - snap.pos;
+	memcpy(buf, snap.buf + snap.pos, len);
+	snap.pos += len;
+	return len;
+}
+
+static int snap_write(void *file, const void *buf, u32 len)
+{
+	if (snap.pos + len > snap.buf_alloc) {
+		u32 size = (snap.pos + len + 0xffff) & ~0xffff;
+		u8 *p = realloc(snap.buf, size);
+		if (p == NULL)
+			return -1;
+		snap.buf = p;
+		snap.buf_alloc = size;
+	}
+	memcpy(snap.buf + snap.pos, buf, len);
+	snap.pos += len;
+	if (snap.buf_size < snap.pos)
+		snap.buf_size = snap.pos;
+	return len;
+}
+
+static long snap_seek(void *file, long offs, int whence)
+{
+	if (whence == SEEK_CUR)
+		offs += snap.pos;
+	else if (whence != SEEK_SET)
+		return -1;
+	snap.pos = offs;
+	return offs;
+}
+
+static void snap_close(void *file)
+{
+}
+
+static const struct PcsxSaveFuncs SnapFuncs = {
+	snap_open, snap_read, snap_write, snap_seek, snap_close
+};
+
+// returns the number of pages copied
+static int snap_copy_ram(void *dst_, const void *src_, int clear)
+{
+	const u8 *src = src_;
+	u8 *dst = dst_;
+	u32 o;
+	int n = 0;
+
+	for (o = 0; o < 0x200000; o += SNAP_PAGE) {
+		if (!memcmp(dst + o, src + o, SNAP_PAGE))
+			continue;
+		if (clear)
+			psxCpu->Clear(o, SNAP_PAGE / 4);
+		memcpy(dst + o, src + o, SNAP_PAGE);
+		n++;
+	}
+	return n;
+}
+
+int SaveStateSnapshot(void) {
+	struct PcsxSaveFuncs funcs = SaveFuncs;
+	SPUFreezeHdr_t spufH;
+	void *f;
+
+	assert(!psxRegs.branching);
+	assert(!psxRegs.cpuInRecursion);
+
+	if (snap.ram == NULL) {
+		snap.ram = malloc(0x200000 + 0x10000);
+		snap.gpu = malloc(sizeof(*snap.gpu));
+		if (snap.ram == NULL || snap.gpu == NULL) {
+			FreeStateSnapshot();
+			return -1;
+		}
+		snap.hw = snap.ram + 0x200000;
+		snap.valid = 0;
+	}
+
+	psxCpu->Notify(R3000ACPU_NOTIFY_BEFORE_SAVE, NULL);
+
+	if (Config.HLE)
+		psxBiosFreeze(1);
+
+	if (snap.valid)
+		snap_copy_ram(snap.ram, psxM, 0);
+	else
+		memcpy(snap.ram, psxM, 0x200000);
+	memcpy(snap.hw, psxH, 0x10000);
+	snap.regs = psxRegs;
+	snap.frame_counter = frame_counter;
+
+	snap.gpu->ulFreezeVersion = 1;
+	GPU_freeze(1, snap.gpu);
+
+	SPU_freeze(2, (SPUFreeze_t *)&spufH, psxRegs.cycle);
+	if (snap.spu_size < spufH.Size) {
+		void *p = realloc(snap.spu, spufH.Size);
+		if (p == NULL) {
+			snap.valid = 0;
+			return -1;
+		}
+		snap.spu = p;
+		snap.spu_size = spufH.Size;
+	}
+	SPU_freeze(1, snap.spu, psxRegs.cycle);
+
+	SaveFuncs = SnapFuncs;
+	f = SaveFuncs.open(NULL, "wb");
+	snap.buf_size = 0;
+	sioFreeze(f, 1);
+	cdrFreeze(f, 1);
+	psxHwFreeze(f, 1);
+	psxRcntFreeze(f, 1);
+	mdecFreeze(f, 1);
+	padFreeze(f, 1);
+	SaveFuncs.close(f);
+	SaveFuncs = funcs;
+
+	snap.valid = 1;
+	return 0;
+}
+
+int LoadStateSnapshot(void) {
+	struct PcsxSaveFuncs funcs = SaveFuncs;
+	u32 biosBranchCheckOld = psxRegs.biosBranchCheck;
+	void *f;
+
+	if (!snap.valid)
+		return -1;
+
+	snap_copy_ram(psxM, snap.ram, 1);
+	memcpy(psxH, snap.hw, 0x10000);
+	psxRegs = snap.regs;
+	frame_counter = snap.frame_counter;
+
+	if (Config.HLE)
+		psxBiosFreeze(0);
+
+	GPU_freeze(0, snap.gpu);
+	gpuSyncPluginSR();
+
+	SPU_freeze(0, snap.spu, psxRegs.cycle);
+
+	SaveFuncs = SnapFuncs;
+	f = SaveFuncs.open(NULL, "rb");
+	sioFreeze(f, 0);
+	cdrFreeze(f, 0);
+	psxHwFreeze(f, 0);
+	psxRcntFreeze(f, 0);
+	mdecFreeze(f, 0);
+	padFreeze(f, 0);
+	SaveFuncs.close(f);
+	SaveFuncs = funcs;
+
+	events_restore();
+	if (Config.HLE)
+		psxBiosCheckExe(biosBranchCheckOld, 0x60, 1);
+
+	psxCpu->Notify(R3000ACPU_NOTIFY_AFTER_SNAPSHOT, NULL);
+	return 0;
+}
+
+void FreeStateSnapshot(void) {
+	free(snap.ram);
+	free(snap.gpu);
+	free(snap.spu);
+	free(snap.buf);
+	memset(&snap, 0, sizeof(snap));
+}
+
+#define STATE_INFO_MAGIC 0x49545350 // "PSTI"
+#define THUMB_SIZE (STATE_THUMB_W * STATE_THUMB_H * 2)
+
+// average 4 bgr555 pixels to rgb565, all channels at once:
+// r at bits 0-4, b at 10-14 and g at 21-25 leaves room for the carries
+#define SPREAD555(p) (((p) | ((u32)(p) << 16)) & 0x03e07c1f)
+
+static u16 avg555(u32 p0, u32 p1, u32 p2, u32 p3)
+{
+	u32 s = SPREAD555(p0) + SPREAD555(p1) + SPREAD555(p2) + SPREAD555(p3);
+	s = ((s + 0x00400802) >> 2) & 0x03e07c1f;
+	return ((s & 0x1f) << 11) | ((s >> 15) & 0x7c0) | ((s >> 10) & 0x1f);
+}
+
+// downscale the displayed part of vram to a STATE_THUMB_W x STATE_THUMB_H
+// rgb565 picture, 2x2 box filter at each sample point
+static void state_thumb(u16 *d, const GPUFreeze_t *gpu)
+{
+	static const int psx_widths[8] = { 256, 368, 320, 384, 512, 512, 640, 640 };
+	const u16 *vram = (const u16 *)gpu->psxVRam;
+	u32 ctrl7 = gpu->ulControl[7];
+	int x, y, w, h, ox, oy;
+	int sx[STATE_THUMB_W];
+
+	memset(d, 0, THUMB_SIZE);
+	if (gpu->ulStatus & 0x800000)
+		return; // display disabled
+
+	x = gpu->ulControl[5] & 0x3ff;
+	y = (gpu->ulControl[5] >> 10) & 0x1ff;
+	w = psx_widths[(gpu->ulStatus >> 16) & 7];
+	h = ((ctrl7 >> 10) & 0x3ff) - (ctrl7 & 0x3ff);
+	if (gpu->ulStatus & 0x80000) // doubleheight
+		h *= 2;
+	if (h <= 0 || h > 512)
+		return;
+
+	if (gpu->ulStatus & 0x200000) {
+		// 24bpp, x is in halfwords but pixels are 3 bytes
+		const u8 *v8 = gpu->psxVRam;
+		for (ox = 0; ox < STATE_THUMB_W; ox++) {
+			int v = (x * 2 + ox * w / STATE_THUMB_W * 3) & 2047;
+			sx[ox] = v < 2042 ? v : 2042; // keep both pixels in the row
+		}
+		for (oy = 0; oy < STATE_THUMB_H; oy++, d += STATE_THUMB_W) {
+			int sy = y + oy * h / STATE_THUMB_H;
+			const u8 *s0 = v8 + (sy & 511) * 2048;
+			const u8 *s1 = v8 + ((sy + 1) & 511) * 2048;
+			for (ox = 0; ox < STATE_THUMB_W; ox++) {
+				int i = sx[ox], j = sx[ox] + 3;
+				u32 r = s0[i] + s0[j] + s1[i] + s1[j];
+				u32 g = s0[i + 1] + s0[j + 1] + s1[i + 1] + s1[j + 1];
+				u32 b = s0[i + 2] + s0[j + 2] + s1[i + 2] + s1[j + 2];
+				d[ox] = ((r << 6) & 0xf800) | ((g << 1) & 0x7e0) | (b >> 5);
+			}
+		}
+		return;
+	}
+
+	for (ox = 0; ox < STATE_THUMB_W; ox++)
+		sx[ox] = x + ox * w / STATE_THUMB_W;
+	for (oy = 0; oy < STATE_THUMB_H; oy++, d += STATE_THUMB_W) {
+		int sy = y + oy * h / STATE_THUMB_H;
+		const u16 *s0 = vram + (sy & 511) * 1024;
+		const u16 *s1 = vram + ((sy + 1) & 511) * 1024;
+		for (ox = 0; ox < STATE_THUMB_W; ox++) {
+			int i = sx[ox] & 1023, j = (sx[ox] + 1) & 1023;
+			d[ox] = avg555(s0[i], s0[j], s1[i], s1[j]);
+		}
+	}
+}
+
+// like SaveState, but also updates the slot's entry in the index file
+int SaveStateIndexed(const char *file, const char *index, int slot) {
+	struct PcsxStateInfo info;
+	struct stat st;
+	u16 *thumb;
+	FILE *f;
+	int ret;
+
+	thumb = malloc(THUMB_SIZE);
+	save_thumb = thumb;
+	ret = SaveState(file);
+	save_thumb = NULL;
+	if (ret != 0 || thumb == NULL || stat(file, &st) != 0)
+		goto out;
+
+	memset(&info, 0, sizeof(info));
+	info.magic = STATE_INFO_MAGIC;
+	info.version = SaveVersion;
+	info.size = st.st_size;
+	info.mtime = st.st_mtime;
+	strncpy(info.game_id, CdromId, sizeof(info.game_id) - 1);
+
+	f = fopen(index, "r+b");
+	if (f == NULL)
+		f = fopen(index, "wb");
+	if (f == NULL)
+		goto out;
+	if (fseek(f, (long)slot * (sizeof(info) + THUMB_SIZE), SEEK_SET) == 0) {
+		fwrite(&info, 1, sizeof(info), f);
+		fwrite(thumb, 1, THUMB_SIZE, f);
+	}
+	fclose(f);
+out:
+	free(thumb);
+	return ret;
+}
+
+// thumb may be NULL when only the info is needed
+int LoadStateInfo(const char *index, int slot, struct PcsxStateInfo *info,
+		u16 *thumb) {
+	int ret = -1;
+	FILE *f;
+
+	f = fopen(index, "rb");
+	if (f == NULL)
+		return -1;
+
+	if (fseek(f, (long)slot * (sizeof(*info) + THUMB_SIZE), SEEK_SET) != 0)
+		goto out;
+	if (fread(info, 1, sizeof(*info), f) != sizeof(*info))
+		goto out;
+	if (info->magic != STATE_INFO_MAGIC || info->version != SaveVersion)
+		goto out;
+	if (thumb != NULL && fread(thumb, 1, THUMB_SIZE, f) != THUMB_SIZE)
+		goto out;
+	info->game_id[sizeof(info->game_id) - 1] = 0;
+	ret = 0;
+out:
+	fclose(f);
+	return ret;
+}
+
 // remove the leading and trailing spaces in a string
 void trim(char *str) {
 	int pos = 0;
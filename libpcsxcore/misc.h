@@ -68,6 +68,29 @@ int SaveState(const char *file);
 int LoadState(const char *file);
 int CheckState(const char *file);
 
+// in-memory state that is cheap to go back to, for run-ahead
+int SaveStateSnapshot(void);
+int LoadStateSnapshot(void);
+void FreeStateSnapshot(void);
+
+// savestate index: small uncompressed per-game file with an entry for
+// each slot, so that slots can be browsed without opening the states
+#define STATE_THUMB_W 128
+#define STATE_THUMB_H 96
+
+struct PcsxStateInfo {
+	u32 magic;
+	u32 version;      // of the state format
+	u32 size;         // size and mtime of the state file when saved,
+	u32 mtime;        // an entry not matching them is stale
+	char game_id[16]; // CdromId
+	u32 reserved[8];
+};
+
+int SaveStateIndexed(const char *file, const char *index, int slot);
+int LoadStateInfo(const char *index, int slot, struct PcsxStateInfo *info,
+		u16 *thumb);
+
 void trim(char *str);
 u16 calcCrc(const u8 *d, int len);
 
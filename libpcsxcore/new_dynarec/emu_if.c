@@ -6,15 +6,19 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 
 #include "emu_if.h"
+#include "new_dynarec_config.h"
 #include "pcsxmem.h"
 #include "../psxhle.h"
 #include "../psxinterpreter.h"
 #include "../psxcounters.h"
 #include "../psxevents.h"
+#include "../psxidle.h"
 #include "../psxbios.h"
+#include "../psxtrace.h"
 #include "../r3000a.h"
 #include "../gte_arm.h"
 #include "../gte_neon.h"
@@ -97,6 +101,25 @@ void ndrc_clear_full(void)
 static void ari64_thread_init(void);
 static int  ari64_thread_check_range(unsigned int start, unsigned int end);
 
+// drop the blocks of pages that took a write fault since the last time
+static void ari64_smc_flush(void)
+{
+	if (unlikely(new_dynarec_smc_pending())) {
+		ari64_thread_sync();
+		new_dynarec_smc_flush();
+	}
+}
+
+// cc_interrupt, psxRegs.pc is where execution is about to continue
+void ndrc_gen_interupt(psxCP0Regs *cp0)
+{
+	ari64_smc_flush();
+	if (unlikely(psxTraceOn))
+		psxTraceStep(psxRegs.pc, psxRegs.cycle, psxRegs.GPR.r, psxRegs.CP0.r);
+	new_dynarec_hot_sample(psxRegs.pc);
+	gen_interupt(cp0);
+}
+
 void pcsx_mtc0(psxRegisters *regs, u32 reg, u32 val)
 {
 	evprintf("MTC0 %d #%x @%08x %u\n", reg, val, regs->pc, regs->cycle);
@@ -219,6 +242,16 @@ static void ari64_reset()
 	new_dyna_pcsx_mem_load_state();
 }
 
+// savestate load, unlike a reset only ram contents changed
+// and blocks of code that's still the same stay usable
+static void ari64_after_load(void)
+{
+	ari64_thread_sync();
+	new_dyna_pcsx_mem_reset();
+	new_dynarec_invalidate_changed();
+	new_dyna_pcsx_mem_load_state();
+}
+
 // execute until predefined leave points
 // (HLE softcall exit and BIOS fastboot end)
 static void ari64_execute_until(psxRegisters *regs)
@@ -229,6 +262,7 @@ static void ari64_execute_until(psxRegisters *regs)
 	evprintf("+exec %08x, %u->%u (%d)\n", regs->pc, regs->cycle,
 		regs->next_interupt, regs->next_interupt - regs->cycle);
 
+	ari64_smc_flush();
 	new_dyna_start(drc_local);
 
 	evprintf("-exec %08x, %u->%u (%d) stop %d \n", regs->pc, regs->cycle,
@@ -262,6 +296,8 @@ static void ari64_clear(u32 addr, u32 size)
 
 	evprintf("ari64_clear %08x %04x\n", addr, size * 4);
 
+	// the dma faulted on the protected pages it wrote
+	ari64_smc_flush();
 	if (!new_dynarec_quick_check_range(addr, end) &&
 	    !ari64_thread_check_range(addr, end))
 		return;
@@ -287,12 +323,74 @@ static void ari64_notify(enum R3000Anote note, void *data) {
 		break;
 	case R3000ACPU_NOTIFY_BEFORE_SAVE:
 		break;
+	case R3000ACPU_NOTIFY_BEFORE_LOAD:
+		ari64_thread_sync();
+		new_dynarec_smc_flush();
+		new_dynarec_smc_unprotect();
+		break;
 	case R3000ACPU_NOTIFY_AFTER_LOAD:
-		ari64_on_ext_change(data == NULL, 0);
+		if (data == NULL)
+			ari64_after_load();
 		psxInt.Notify(note, data);
 		break;
+	case R3000ACPU_NOTIFY_AFTER_SNAPSHOT:
+		// code in changed ram was dropped by ari64_clear()
+		ari64_thread_sync();
+		new_dyna_pcsx_mem_reset();
+		new_dyna_pcsx_mem_load_state();
+		psxInt.Notify(note, data);
+		break;
+	}
+}
+
+#ifdef NDRC_SMC_MPROTECT
+#include <signal.h>
+
+static struct sigaction smc_sa_old;
+static int smc_sa_installed;
+
+// Must stay async-signal-safe: this only unprotects the page, the blocks
+// are dropped before the next block lookup (see new_dynarec_smc_fault()).
+// Until then the rest of the current block, blocks linked to it by direct
+// branches and mini_ht return hits run the old code, unlike with store
+// checks.
+static void ari64_smc_handler(int sig, siginfo_t *si, void *uc)
+{
+	if (new_dynarec_smc_fault(si->si_addr))
+		return;
+	// not ours
+	if (smc_sa_old.sa_flags & SA_SIGINFO)
+		smc_sa_old.sa_sigaction(sig, si, uc);
+	else if (smc_sa_old.sa_handler != SIG_DFL && smc_sa_old.sa_handler != SIG_IGN)
+		smc_sa_old.sa_handler(sig);
+	else
+		// the faulting insn runs again and gets the default action
+		sigaction(sig, &smc_sa_old, NULL);
+}
+
+static void ari64_smc_handler_install(int enable)
+{
+	struct sigaction sa;
+
+	if (!enable == !smc_sa_installed)
+		return;
+	if (!enable) {
+		sigaction(SIGSEGV, &smc_sa_old, NULL);
+		smc_sa_installed = 0;
+		return;
 	}
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_sigaction = ari64_smc_handler;
+	sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGSEGV, &sa, &smc_sa_old) != 0)
+		SysPrintf("smc: sigaction failed\n");
+	else
+		smc_sa_installed = 1;
 }
+#else
+#define ari64_smc_handler_install(enable)
+#endif
 
 static void ari64_apply_config()
 {
@@ -306,6 +404,13 @@ static void ari64_apply_config()
 	else
 		ndrc_g.hacks &= ~NDHACK_NO_STALLS;
 
+	// blocks compiled with polling loops sent to the interpreter
+	// must go when the skip is turned off, for this game or at all
+	if (psxIdleSkipOn())
+		ndrc_g.hacks |= NDHACK_IDLE_SKIP;
+	else
+		ndrc_g.hacks &= ~NDHACK_IDLE_SKIP;
+
 	thread_changed = ((ndrc_g.hacks | ndrc_g.hacks_pergame) ^ ndrc_g.hacks_old)
 		& (NDHACK_THREAD_FORCE | NDHACK_THREAD_FORCE_ON);
 	if (Config.cycle_multiplier != ndrc_g.cycle_multiplier_old
@@ -313,11 +418,16 @@ static void ari64_apply_config()
 	{
 		new_dynarec_clear_full();
 	}
+	ari64_smc_handler_install(
+		(ndrc_g.hacks | ndrc_g.hacks_pergame) & NDHACK_SMC_MPROTECT);
 	if (thread_changed)
 		ari64_thread_init();
 }
 
 #ifdef NDRC_THREAD
+// speculative compiles per miss, at most
+#define NDRC_SPEC_MAX 8
+
 static void clear_local_cache(void)
 {
 #if defined(__arm__) || defined(__aarch64__)
@@ -366,13 +476,22 @@ static R3000Acpu psxMixedCpu = {
 	NULL /* ApplyConfig */,	NULL /* Shutdown */
 };
 
+// nothing requested and no speculation running in the thread
+static int ari64_thread_idle(void)
+{
+	// spec_active is set before busy_addr is released
+	return __atomic_load_n(&ndrc_g.thread.busy_addr, __ATOMIC_ACQUIRE) == ~0u
+		&& !__atomic_load_n(&ndrc_g.thread.spec_active, __ATOMIC_ACQUIRE);
+}
+
 static noinline void ari64_execute_threaded_slow(struct psxRegisters *regs,
 	enum blockExecCaller block_caller)
 {
-	if (ndrc_g.thread.busy_addr == ~0u) {
+	if (ari64_thread_idle()) {
 		memcpy(ndrc_smrv_regs, regs->GPR.r, sizeof(ndrc_smrv_regs));
 		slock_lock(ndrc_g.thread.lock);
 		ndrc_g.thread.busy_addr = regs->pc;
+		__atomic_store_n(&ndrc_g.thread.spec_stop, 0, __ATOMIC_RELAXED);
 		slock_unlock(ndrc_g.thread.lock);
 		scond_signal(ndrc_g.thread.cond);
 	}
@@ -385,8 +504,13 @@ static noinline void ari64_execute_threaded_slow(struct psxRegisters *regs,
 	{
 		mixed_execute_block(regs, block_caller);
 
-		if (ndrc_g.thread.busy_addr == ~0u)
-			break;
+		if (ndrc_g.thread.busy_addr == ~0u) {
+			// the block is there, only wait for the speculative
+			// compile that is already running
+			__atomic_store_n(&ndrc_g.thread.spec_stop, 1, __ATOMIC_RELEASE);
+			if (ari64_thread_idle())
+				break;
+		}
 		if (block_caller == EXEC_CALLER_HLE) {
 			if (!psxBiosSoftcallEnded())
 				continue;
@@ -415,7 +539,7 @@ static void ari64_execute_threaded_once(struct psxRegisters *regs,
 		*(void **)((char *)drc_local + LO_hash_table_ptr);
 	void *target;
 
-	if (likely(ndrc_g.thread.busy_addr == ~0u)) {
+	if (likely(ari64_thread_idle())) {
 		target = ndrc_get_addr_ht_param(hash_table, regs->pc,
 				ndrc_cm_no_compile);
 		if (target) {
@@ -459,20 +583,20 @@ static void ari64_execute_threaded_block(struct psxRegisters *regs,
 
 static void ari64_thread_sync(void)
 {
-	if (!ndrc_g.thread.lock || ndrc_g.thread.busy_addr == ~0u)
+	if (!ndrc_g.thread.lock || ari64_thread_idle())
 		return;
+	__atomic_store_n(&ndrc_g.thread.spec_stop, 1, __ATOMIC_RELEASE);
 	for (;;) {
 		slock_lock(ndrc_g.thread.lock);
 		slock_unlock(ndrc_g.thread.lock);
-		if (ndrc_g.thread.busy_addr == ~0)
+		if (ari64_thread_idle())
 			break;
 		retro_sleep(0);
 	}
 }
 
-static int ari64_thread_check_range(unsigned int start, unsigned int end)
+static int thread_range_hit(u32 addr, u32 start, u32 end)
 {
-	u32 addr = ndrc_g.thread.busy_addr;
 	if (addr == ~0u)
 		return 0;
 
@@ -488,6 +612,41 @@ static int ari64_thread_check_range(unsigned int start, unsigned int end)
 	return 1;
 }
 
+static int ari64_thread_check_range(unsigned int start, unsigned int end)
+{
+	u32 addr = ndrc_g.thread.busy_addr;
+	if (ari64_thread_idle())
+		return 0;
+
+	// the write must be seen before the thread picks its next spec_addr
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	return thread_range_hit(addr, start, end)
+		|| thread_range_hit(__atomic_load_n(&ndrc_g.thread.spec_addr,
+			__ATOMIC_RELAXED), start, end);
+}
+
+// Compile some of the blocks the last compiles lead to. The requested
+// block is already released, but nothing else in the dynarec is thread
+// safe, so the main thread stays in the interpreter until spec_active
+// drops. It sets spec_stop as soon as it sees the release, so that is
+// at most the one compile that is in progress.
+static void ari64_thread_speculate(void)
+{
+	struct ht_entry *hash_table =
+		*(void **)((char *)dynarec_local + LO_hash_table_ptr);
+	int count = 0;
+	u32 addr;
+
+	while (count++ < NDRC_SPEC_MAX
+	       && !__atomic_load_n(&ndrc_g.thread.spec_stop, __ATOMIC_ACQUIRE)
+	       && !ndrc_g.thread.exit && new_dynarec_spec_pop(&addr))
+	{
+		__atomic_store_n(&ndrc_g.thread.spec_addr, addr, __ATOMIC_SEQ_CST);
+		ndrc_get_addr_ht_param(hash_table, addr, ndrc_cm_compile_in_thread);
+	}
+	__atomic_store_n(&ndrc_g.thread.spec_addr, ~0u, __ATOMIC_SEQ_CST);
+}
+
 static STRHEAD_RET_TYPE ari64_compile_thread(void *unused)
 {
 	struct ht_entry *hash_table =
@@ -508,7 +667,10 @@ static STRHEAD_RET_TYPE ari64_compile_thread(void *unused)
 		target = ndrc_get_addr_ht_param(hash_table, addr,
 				ndrc_cm_compile_in_thread);
 		//printf("c  %08x -> %p\n", addr, target);
-		ndrc_g.thread.busy_addr = ~0u;
+		__atomic_store_n(&ndrc_g.thread.spec_active, 1, __ATOMIC_SEQ_CST);
+		__atomic_store_n(&ndrc_g.thread.busy_addr, ~0u, __ATOMIC_SEQ_CST);
+		ari64_thread_speculate();
+		__atomic_store_n(&ndrc_g.thread.spec_active, 0, __ATOMIC_RELEASE);
 	}
 	slock_unlock(ndrc_g.thread.lock);
 	(void)target;
@@ -540,6 +702,8 @@ static void ari64_thread_shutdown(void)
 		ndrc_g.thread.lock = NULL;
 	}
 	ndrc_g.thread.busy_addr = ~0u;
+	ndrc_g.thread.spec_addr = ~0u;
+	ndrc_g.thread.spec_active = 0;
 }
 
 static void ari64_thread_init(void)
@@ -565,6 +729,8 @@ static void ari64_thread_init(void)
 	ari64_thread_shutdown();
 	ndrc_g.thread.exit = 0;
 	ndrc_g.thread.busy_addr = ~0u;
+	ndrc_g.thread.spec_addr = ~0u;
+	ndrc_g.thread.spec_active = 0;
 
 	if (enable) {
 		ndrc_g.thread.lock = slock_new();
@@ -630,8 +796,13 @@ static int ari64_init()
 
 static void ari64_shutdown()
 {
+	const char *hot = getenv("NDRC_HOT_BLOCKS");
+
 	ari64_thread_shutdown();
+	if (hot)
+		new_dynarec_print_hot_blocks(atoi(hot) > 0 ? atoi(hot) : 16);
 	new_dynarec_cleanup();
+	ari64_smc_handler_install(0);
 	new_dyna_pcsx_mem_shutdown();
 }
 
@@ -654,6 +825,7 @@ void new_dyna_start(void *context) {}
 void new_dynarec_cleanup() {}
 void new_dynarec_clear_full() {}
 void new_dynarec_invalidate_all_pages() {}
+void new_dynarec_invalidate_changed(void) {}
 void new_dynarec_invalidate_range(unsigned int start, unsigned int end) {}
 void new_dyna_pcsx_mem_init(void) {}
 void new_dyna_pcsx_mem_reset(void) {}
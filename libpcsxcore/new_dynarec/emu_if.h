@@ -70,6 +70,8 @@ extern u32 next_interupt;
 
 /* called by drc */
 struct psxRegisters;
+union psxCP0Regs_;
+void ndrc_gen_interupt(union psxCP0Regs_ *cp0);
 void pcsx_mtc0(struct psxRegisters *regs, u32 reg, u32 val);
 void pcsx_mtc0_ds(struct psxRegisters *regs, u32 reg, u32 val);
 
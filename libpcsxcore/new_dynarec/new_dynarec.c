@@ -40,6 +40,7 @@ static Jit g_jit;
 #include "../psxhle.h"
 #include "../psxinterpreter.h"
 #include "../psxcounters.h"
+#include "../psxidle.h"
 #include "../gte.h"
 #include "emu_if.h" // emulator interface
 #include "linkage_offsets.h"
@@ -110,6 +111,14 @@ extern uintptr_t mini_ht[32][2];
 #define EXPIRITY_OFFSET (MAX_OUTPUT_BLOCK_SIZE * 2)
 #define PAGE_COUNT 1024
 
+// block_info.tier
+#define SB_TIER_NORMAL 0
+#define SB_TIER_SUPER 1    // compiled as a superblock
+#define SB_TIER_REPLACED 2 // dropped for a superblock, never restored
+#define SB_HOT_SAMPLES 64  // samples before a block gets recompiled
+#define TC_SURVIVOR_SAMPLES 4 // expiring blocks this hot are compiled again
+#define TC_SURVIVOR_BUDGET 2  // of them per miss, the rest waits for later
+
 #if defined(HAVE_CONDITIONAL_CALL) && !defined(DESTRUCTIVE_SHIFT)
 #define INVALIDATE_USE_COND_CALL
 #endif
@@ -229,7 +238,9 @@ struct block_info
   u_int reg_sv_flags;
   u_char is_dirty;
   u_char inv_near_misses;
+  u_char tier; // SB_TIER_*
   u_short jump_in_cnt;
+  u_int samples; // see new_dynarec_hot_sample
   struct {
     u_int vaddr;
     void *addr;
@@ -285,6 +296,9 @@ static struct compile_info
 
   static u_char *out;
   static char invalid_code[0x100000];
+  // ram code presence at 64 byte granularity (a superset of what clean
+  // blocks cover), lets writes next to code skip invalidate_range()
+  static u_int code_bits[0x200000 / 64 / 32];
   static struct ht_entry hash_table[65536];
   static struct block_info *blocks[PAGE_COUNT];
   static struct jump_info *jumps[PAGE_COUNT];
@@ -321,6 +335,20 @@ static struct compile_info
   static void *copy;
   static u_int expirep;
   static u_int stop_after_jal;
+  static u_int sb_hot[256]; // block starts to be recompiled as superblocks
+  static u_int sb_mode;     // current block is a superblock
+  // blocks that were still in use when the cache wrapped onto them,
+  // see pass10_expire_blocks()
+  static u_int tc_survivors[64];
+  static u_int tc_survivor_cnt;
+  static u_int tc_survivors_busy;
+  // ram code dropped by expiry (at 4 byte granularity), for did_recompile
+  static u_int tc_expired[0x200000 / 4 / 32];
+#ifdef NDRC_THREAD
+  // predicted next blocks for the compile thread, newest last
+  static u_int spec_queue[32];
+  static u_int spec_cnt;
+#endif
   static u_int ni_count;
   static u_int err_print_count;
   static u_int f1_hack;
@@ -335,6 +363,14 @@ static struct compile_info
   static int stat_restore_compares;
   static int stat_inv_addr_calls;
   static int stat_inv_hits;
+  static int stat_load_kept;
+  static int stat_load_inv;
+  static int stat_smc_faults;
+  static int stat_inv_bits_skips;
+  static int stat_sb_compiles;
+  static int stat_tc_survivors;
+  static int stat_tc_lost;
+  static int stat_spec_compiles;
   static int stat_blocks;
   static int stat_links;
   #define stat_inc(s) s++
@@ -446,6 +482,7 @@ static void cop2_do_stall_check(u_int op, int i, const struct regstat *i_regs, u
 static void pass_args(int a0, int a1);
 static void emit_far_jump(const void *f);
 static void emit_far_call(const void *f);
+static int pgsize(void);
 
 #ifdef VITA
 #include <psp2/kernel/sysmem.h>
@@ -734,6 +771,113 @@ static void mini_ht_clear(void)
 #endif
 }
 
+#ifdef NDRC_SMC_MPROTECT
+// Alternative to checking invalid_code[] on every store: host pages of
+// ram that have clean blocks are made read-only, so ordinary stores run
+// unchecked and the first write to such a page traps (from compiled code
+// or any C code, like DMA). See new_dynarec_smc_fault().
+static struct {
+  int active;
+  u_int pg_shift;
+  u_char prot[0x200000 >> 12]; // per host page
+  // faulted pages whose blocks new_dynarec_smc_flush() still has to drop
+  u_int pending[(0x200000 >> 12) / 32];
+  int pending_any;
+} smc_prot;
+
+static int smc_prot_mprotect(u_int hpage, int prot)
+{
+  size_t size = (size_t)1 << smc_prot.pg_shift;
+  return mprotect(psxM + hpage * size, size,
+                  PROT_READ | (prot ? 0 : PROT_WRITE));
+}
+
+static int smc_prot_set(u_int hpage, int prot)
+{
+  if (smc_prot.prot[hpage] == prot)
+    return 0;
+  if (smc_prot_mprotect(hpage, prot) != 0) {
+    SysPrintf("smc mprotect(%d) failed: %s\n", prot, strerror(errno));
+    return -1;
+  }
+  __atomic_store_n(&smc_prot.prot[hpage], prot, __ATOMIC_RELAXED);
+  return 0;
+}
+
+static void smc_prot_code(u_int vaddr, u_int len)
+{
+  u_int vaddr_m = vaddr & 0x1fffffff;
+  u_int p, offs, end;
+
+  if (!smc_prot.active || vaddr_m >= 0x800000) // ram only
+    return;
+  offs = vaddr_m & 0x1fffff; // the mirrors share host memory
+  end = min(offs + len, 0x200000u) - 1;
+  for (p = offs >> smc_prot.pg_shift; p <= end >> smc_prot.pg_shift; p++)
+    smc_prot_set(p, 1);
+}
+
+static void smc_prot_unprotect_all(void)
+{
+  u_int p;
+  for (p = 0; p < (0x200000u >> smc_prot.pg_shift); p++)
+    smc_prot_set(p, 0);
+}
+
+static void smc_prot_reset(int enable)
+{
+  u_int pg = pgsize();
+
+  if (smc_prot.pg_shift)
+    smc_prot_unprotect_all();
+  for (smc_prot.pg_shift = 12; (1u << smc_prot.pg_shift) < pg; )
+    smc_prot.pg_shift++;
+  smc_prot.active = 0;
+  memset(smc_prot.pending, 0, sizeof(smc_prot.pending));
+  smc_prot.pending_any = 0;
+  if (!enable || psxM == NULL)
+    return;
+  // hugetlb ram or some such
+  if (smc_prot_set(0, 1) != 0 || smc_prot_set(0, 0) != 0) {
+    SysPrintf("smc: page protection unavailable, using store checks\n");
+    return;
+  }
+  smc_prot.active = 1;
+}
+#else
+#define smc_prot_code(vaddr, len)
+#endif
+
+// ram offset of a vaddr, or ~0 if it's not ram
+static u_int ram_offs(u_int vaddr)
+{
+  vaddr &= 0x1fffffff;
+  return vaddr < 0x800000 ? (vaddr & 0x1fffff) : ~0u;
+}
+
+static void code_bits_set(u_int offs, u_int len)
+{
+  u_int i, end = (min(offs + len, 0x200000u) - 1) >> 6;
+  if (len == 0)
+    return;
+  for (i = offs >> 6; i <= end; i++)
+    code_bits[i >> 5] |= 1u << (i & 31);
+}
+
+// any code in [offs, offs + len)?
+static int code_bits_test(u_int offs, u_int len)
+{
+  u_int i, end = (offs + len - 1) >> 6;
+  if (len == 0)
+    return 0;
+  if (offs + len > 0x200000) // wraps to the next mirror
+    return 1;
+  for (i = offs >> 6; i <= end; i++)
+    if (code_bits[i >> 5] & (1u << (i & 31)))
+      return 1;
+  return 0;
+}
+
 static void mark_invalid_code(u_int vaddr, u_int len, char invalid)
 {
   u_int vaddr_m = vaddr & 0x1fffffff;
@@ -746,8 +890,15 @@ static void mark_invalid_code(u_int vaddr, u_int len, char invalid)
       invalid_code[(i|j|0xa0000000u) >> 12] = invalid;
     }
   }
-  if (!invalid && vaddr + len > inv_code_start && vaddr <= inv_code_end)
+  // the range may be in another mirror
+  if (!invalid && inv_code_start != ~0u && pmmask(vaddr) + len > pmmask(inv_code_start)
+      && pmmask(vaddr) <= pmmask(inv_code_end))
     inv_code_start = inv_code_end = ~0;
+  if (!invalid) {
+    if (ram_offs(vaddr) != ~0u)
+      code_bits_set(ram_offs(vaddr), len);
+    smc_prot_code(vaddr, len);
+  }
 }
 
 static int doesnt_expire_soon(u_char *tcaddr)
@@ -791,6 +942,8 @@ static void *try_restore_block(u_int vaddr, u_int start_page, u_int end_page)
         break;
       if (!block->is_dirty || vaddr >= block->start + block->len)
         continue;
+      if (block->tier == SB_TIER_REPLACED)
+        continue;
       for (i = 0; i < block->jump_in_cnt; i++)
         if (block->jump_in[i].vaddr == vaddr)
           break;
@@ -885,11 +1038,21 @@ static void noinline *get_addr(struct ht_entry *ht, const u_int vaddr,
   return NULL;
 }
 
+#ifdef NDRC_SMC_MPROTECT
+static int smc_prot_pending(void);
+static void smc_prot_flush_lookup(void);
+#else
+#define smc_prot_pending() 0
+#define smc_prot_flush_lookup()
+#endif
+
 // Look up address in hash table first
 void *ndrc_get_addr_ht_param(struct ht_entry *ht, unsigned int vaddr,
   enum ndrc_compile_mode compile_mode)
 {
   //check_for_block_changes(vaddr, vaddr + MAXBLOCK);
+  if (unlikely(smc_prot_pending()))
+    smc_prot_flush_lookup();
   const struct ht_entry *ht_bin = hash_table_get_p(ht, vaddr);
   u_int vaddr_a = vaddr & ~3;
   stat_inc(stat_ht_lookups);
@@ -1274,7 +1437,6 @@ static void host_tempreg_release(void) {}
 #endif
 
 #ifdef ASSEM_PRINT
-extern void gen_interupt();
 extern void do_insn_cmp();
 #define FUNCNAME(f) { f, " " #f }
 static const struct {
@@ -1282,7 +1444,7 @@ static const struct {
   const char *name;
 } function_names[] = {
   FUNCNAME(cc_interrupt),
-  FUNCNAME(gen_interupt),
+  FUNCNAME(ndrc_gen_interupt),
   FUNCNAME(ndrc_get_addr_ht),
   FUNCNAME(ndrc_get_addr_ht_param),
   FUNCNAME(jump_handler_read8),
@@ -1500,6 +1662,26 @@ static void blocks_clear(struct block_info **head)
   }
 }
 
+// remember an expiring block, if it was in use it gets compiled again
+// right away at the other end of the cache instead of on the next miss
+static void tc_expire_note(const struct block_info *block)
+{
+  u_int offs;
+
+  if (!block->source || block->is_dirty)
+    return;
+  if (block->samples >= TC_SURVIVOR_SAMPLES) {
+    if (tc_survivor_cnt < ARRAY_SIZE(tc_survivors)) {
+      tc_survivors[tc_survivor_cnt++] = block->start;
+      return;
+    }
+    stat_inc(stat_tc_lost);
+  }
+  offs = ram_offs(block->start);
+  if (offs != ~0u)
+    tc_expired[offs >> 7] |= 1u << ((offs >> 2) & 31);
+}
+
 static int blocks_remove_matching_addrs(struct block_info **head,
   u_int base_offs, int shift)
 {
@@ -1508,6 +1690,7 @@ static int blocks_remove_matching_addrs(struct block_info **head,
   while (*head) {
     if ((((*head)->tc_offs ^ base_offs) >> shift) == 0) {
       inv_debug("EXP: rm block %08x (tc_offs %x)\n", (*head)->start, (*head)->tc_offs);
+      tc_expire_note(*head);
       invalidate_block(*head);
       next = (*head)->next;
       free(*head);
@@ -1589,6 +1772,117 @@ static void invalidate_block(struct block_info *block)
     hash_table_remove(block->jump_in[i].vaddr);
 }
 
+// would a superblock compile of this block get any longer?
+// (it can only continue past the jump the block ends with)
+static int sb_can_extend(const struct block_info *block)
+{
+  const u_int *src = block->source;
+  u_int n = block->len / 4, ds, t;
+
+  if (!src || n < 2 || n > MAXBLOCK - 64)
+    return 0;
+  ds = block->start + (n - 1) * 4;
+  switch (src[n - 2] >> 26) {
+  case 2: // J - only short forward ones
+    t = (ds & 0xf0000000) | ((src[n - 2] & 0x03ffffff) << 2);
+    return t - ds - 4 < 63 * 4;
+  case 3: // JAL - the return path after it
+    return 1;
+  }
+  return 0;
+}
+
+// Called from cc_interrupt with the pc execution continues at, which
+// is a cheap sample of where the time goes. Blocks that keep showing
+// up get dropped and compiled again as a superblock on the next lookup.
+void new_dynarec_hot_sample(u_int vaddr)
+{
+  u_int page, start_page = get_page_prev(vaddr), end_page = get_page(vaddr);
+
+  for (page = start_page; page <= end_page; page++) {
+    struct block_info *block;
+    for (block = blocks[page]; block != NULL; block = block->next) {
+      if (vaddr < block->start)
+        break;
+      if (block->is_dirty || vaddr >= block->start + block->len)
+        continue;
+      if (++block->samples != SB_HOT_SAMPLES)
+        return;
+      if (block->tier != SB_TIER_NORMAL || !HACK_ENABLED(NDHACK_SUPERBLOCKS)
+          || !sb_can_extend(block))
+        return;
+      inv_debug("SB: hot block %08x-%08x\n", block->start, block->start + block->len);
+      sb_hot[(block->start >> 2) % ARRAY_SIZE(sb_hot)] = block->start;
+      block->tier = SB_TIER_REPLACED;
+      invalidate_block(block);
+      do_clear_cache();
+      mini_ht_clear();
+      return;
+    }
+  }
+}
+
+static int hot_cmp(const void *p1_, const void *p2_)
+{
+  const struct block_info * const *p1 = p1_, * const *p2 = p2_;
+  // most samples first
+  return ((*p1)->samples < (*p2)->samples) - ((*p1)->samples > (*p2)->samples);
+}
+
+void new_dynarec_print_hot_blocks(int count)
+{
+  const struct block_info *top[64], *block;
+  unsigned long long total = 0;
+  int i, n = 0;
+
+  if (count > ARRAY_SIZE(top))
+    count = ARRAY_SIZE(top);
+  for (i = 0; i < ARRAY_SIZE(blocks); i++) {
+    for (block = blocks[i]; block != NULL; block = block->next) {
+      if (!block->samples || block->tier == SB_TIER_REPLACED)
+        continue;
+      total += block->samples;
+      if (n < count)
+        top[n++] = block;
+      else if (count > 0 && block->samples > top[n-1]->samples)
+        top[n-1] = block;
+      else
+        continue;
+      qsort(top, n, sizeof(top[0]), hot_cmp);
+    }
+  }
+  for (i = 0; i < n; i++)
+    SysPrintf("hot %2d: %08x-%08x %8u %5.1f%%%s%s\n", i, top[i]->start,
+      top[i]->start + top[i]->len, top[i]->samples,
+      top[i]->samples * 100.0 / total,
+      top[i]->tier == SB_TIER_SUPER ? " sb" : "",
+      top[i]->is_dirty ? " dirty" : "");
+}
+
+// recompute code_bits[] of a ram page from the clean blocks touching it
+static void code_bits_rebuild(u_int offs)
+{
+  u_int page = get_page(0x80000000 | offs);
+  u_int p, b_s, b_e;
+
+  offs &= ~0xfff;
+  code_bits[offs >> 11] = code_bits[(offs >> 11) + 1] = 0;
+  for (p = get_page_prev(0x80000000 | offs); p <= page; p++) {
+    const struct block_info *block;
+    for (block = blocks[p]; block != NULL; block = block->next) {
+      if (block->is_dirty || !block->source)
+        continue;
+      b_s = ram_offs(block->start);
+      if (b_s == ~0u)
+        continue;
+      b_e = min(b_s + block->len, offs + 0x1000);
+      b_s = max(b_s, offs);
+      if (b_s < b_e)
+        code_bits_set(b_s, b_e - b_s);
+    }
+  }
+}
+
 static int invalidate_range(u_int start, u_int end,
   u32 *inv_start_ret, u32 *inv_end_ret)
 {
@@ -1642,8 +1936,12 @@ static int invalidate_range(u_int start, u_int end,
     }
   }
   if (hit) {
+    u_int offs = ram_offs(start), o;
     do_clear_cache();
     mini_ht_clear();
+    if (offs != ~0u)
+      for (o = offs & ~0xfff; o < offs + (end - start) && o < 0x200000; o += 0x1000)
+        code_bits_rebuild(o);
   }
 
   if (inv_start <= (start_m & ~0xfff) && inv_end >= (start_m | 0xfff))
@@ -1669,6 +1967,8 @@ int new_dynarec_quick_check_range(unsigned int start, unsigned int end)
 
   if (inv_code_start <= start && end <= inv_code_end)
     return 0;
+  if (ram_offs(start) != ~0u && !code_bits_test(ram_offs(start), end - start))
+    return 0;
   for (page = start_page; page <= end_page; page++) {
     if (blocks[page]) {
       //SysPrintf("quick hit %x-%x\n", start, end);
@@ -1678,10 +1978,33 @@ int new_dynarec_quick_check_range(unsigned int start, unsigned int end)
   return 0;
 }
 
+// the write didn't touch code, widen inv_code_start/end to the codeless
+// area around it (in the same mirror) so that the next writes stay out
+static void code_bits_miss(u_int start, u_int offs)
+{
+  u_int c = offs >> 6, lo = c, hi = c, pg = c & ~63;
+
+  while (lo > pg && !(code_bits[(lo - 1) >> 5] & (1u << ((lo - 1) & 31))))
+    lo--;
+  while (hi < pg + 63 && !(code_bits[(hi + 1) >> 5] & (1u << ((hi + 1) & 31))))
+    hi++;
+  if (lo == pg && hi == pg + 63)
+    mark_invalid_code(start, 1, 1);
+  inv_code_start = (start & ~0x1fffff) | (lo << 6);
+  inv_code_end = (start & ~0x1fffff) | ((hi << 6) + 63);
+}
+
 static void ndrc_write_invalidate_many(u_int start, u_int end)
 {
+  u_int offs = ram_offs(start);
+
   // this check is done by the caller
   //if (inv_code_start<=addr&&addr<=inv_code_end) { rhits++; return; }
+  if (offs != ~0u && !code_bits_test(offs, end - start)) {
+    stat_inc(stat_inv_bits_skips);
+    code_bits_miss(start, offs);
+    return;
+  }
   int ret = invalidate_range(start, end, &inv_code_start, &inv_code_end);
 #ifdef INV_DEBUG_W
   int invc = invalid_code[start >> 12];
@@ -1702,8 +2025,94 @@ void ndrc_write_invalidate_one(u_int addr)
   ndrc_write_invalidate_many(addr, addr + 4);
 }
 
-// This is called when loading a save state.
-// Anything could have changed, so invalidate everything.
+#ifdef NDRC_SMC_MPROTECT
+// Called from the SIGSEGV handler, so only async-signal-safe things here:
+// the page is made writable and recorded, its blocks are dropped later by
+// new_dynarec_smc_flush() (on the next block lookup, invalidation or
+// cc_interrupt, whatever comes first). The written size is
+// unknown, so that's everything in the host page, and the page stays
+// writable until code is compiled from it again. Returns 0 if the fault
+// is not ours.
+int new_dynarec_smc_fault(const void *host_addr)
+{
+  size_t offs = (const char *)host_addr - (const char *)psxM;
+  u_int p;
+
+  if (!smc_prot.active || offs >= 0x200000)
+    return 0;
+  p = offs >> smc_prot.pg_shift;
+  if (smc_prot_mprotect(p, 0) != 0)
+    return 0;
+  __atomic_store_n(&smc_prot.prot[p], 0, __ATOMIC_RELAXED);
+  __atomic_fetch_or(&smc_prot.pending[p >> 5], 1u << (p & 31), __ATOMIC_RELAXED);
+  __atomic_store_n(&smc_prot.pending_any, 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+static int smc_prot_pending(void)
+{
+  return __atomic_load_n(&smc_prot.pending_any, __ATOMIC_ACQUIRE);
+}
+
+int new_dynarec_smc_pending(void)
+{
+  return smc_prot_pending();
+}
+
+// Indirect jumps (except mini_ht hits), the linker and cc_interrupt all
+// look blocks up here, so those don't enter a written page's old code
+// once the fault is taken. The compile thread looks up blocks too, but
+// only the main thread may invalidate, and only while that one is idle.
+static void smc_prot_flush_lookup(void)
+{
+#ifdef NDRC_THREAD
+  if (ndrc_g.thread.handle
+      && (__atomic_load_n(&ndrc_g.thread.busy_addr, __ATOMIC_ACQUIRE) != ~0u
+          || __atomic_load_n(&ndrc_g.thread.spec_active, __ATOMIC_ACQUIRE)))
+    return;
+#endif
+  new_dynarec_smc_flush();
+}
+
+// the compile thread must be idle
+void new_dynarec_smc_flush(void)
+{
+  u_int size = 1u << smc_prot.pg_shift;
+  u_int w, p, a, bits;
+
+  if (!__atomic_exchange_n(&smc_prot.pending_any, 0, __ATOMIC_ACQUIRE))
+    return;
+  for (w = 0; w < ARRAY_SIZE(smc_prot.pending); w++) {
+    bits = __atomic_exchange_n(&smc_prot.pending[w], 0, __ATOMIC_ACQUIRE);
+    for (; bits; bits &= bits - 1) {
+      p = w * 32 + __builtin_ctz(bits);
+      stat_inc(stat_smc_faults);
+      // by 4K so that invalidate_range() can see the pages emptied
+      for (a = p * size; a < (p + 1) * size; a += 0x1000)
+        invalidate_range(0x80000000 | a, 0x80001000 | a, NULL, NULL);
+      // the compile thread may have protected it again while the fault
+      // was handled, leaving prot[] stale
+      smc_prot.prot[p] = 1;
+      smc_prot_set(p, 0);
+    }
+  }
+}
+
+// ram is about to be replaced (savestate load), which is handled by
+// new_dynarec_invalidate_changed() instead of faulting on each page
+void new_dynarec_smc_unprotect(void)
+{
+  if (smc_prot.active)
+    smc_prot_unprotect_all();
+}
+#else
+int new_dynarec_smc_fault(const void *host_addr) { return 0; }
+int new_dynarec_smc_pending(void) { return 0; }
+void new_dynarec_smc_flush(void) {}
+void new_dynarec_smc_unprotect(void) {}
+#endif
+
+// Reset or anything that could have changed everything.
 void new_dynarec_invalidate_all_pages(void)
 {
   struct block_info *block;
@@ -1717,11 +2126,46 @@ void new_dynarec_invalidate_all_pages(void)
       invalidate_block(block);
     }
   }
+  memset(code_bits, 0, sizeof(code_bits));
 
   do_clear_cache();
   mini_ht_clear();
 }
 
+// This is called when loading a save state. Typically (run-ahead,
+// rewind) most of the code is the same, so only drop the blocks whose
+// source no longer matches the shadow copy. The others keep their links
+// and need no lookups. Anything already dirty is left to try_restore_block.
+void new_dynarec_invalidate_changed(void)
+{
+  struct block_info *block;
+  u_int page;
+  int hit = 0;
+
+  for (page = 0; page < ARRAY_SIZE(blocks); page++) {
+    for (block = blocks[page]; block != NULL; block = block->next) {
+      if (block->is_dirty)
+        continue;
+      if (!block->source) // hack block?
+        continue;
+      assert(block->copy);
+      if (!memcmp(block->source, block->copy, block->len)) {
+        smc_prot_code(block->start, block->len);
+        stat_inc(stat_load_kept);
+        continue;
+      }
+      invalidate_block(block);
+      stat_inc(stat_load_inv);
+      hit++;
+    }
+  }
+  inv_debug("invalidate_changed: %d blocks\n", hit);
+
+  if (hit)
+    do_clear_cache();
+  mini_ht_clear();
+}
+
 // Add an entry to jump_out after making a link
 // stub should point to stub code by emit_extjump()
 static void ndrc_add_jump_out(u_int vaddr, void *stub)
@@ -3356,6 +3800,10 @@ static void do_store_smc_check(int i, const struct regstat *i_regs, u_int reglis
 {
   if (HACK_ENABLED(NDHACK_NO_SMC_CHECK))
     return;
+#ifdef NDRC_SMC_MPROTECT
+  if (smc_prot.active)
+    return;
+#endif
   // this can't be used any more since we started to check exact
   // block boundaries in invalidate_range()
   //if (i_regs->waswritten & (1<<dops[i].rs1))
@@ -6348,6 +6796,13 @@ void new_dynarec_clear_full(void)
   int n;
   out = ndrc->translation_cache;
   memset(invalid_code,1,sizeof(invalid_code));
+  memset(code_bits,0,sizeof(code_bits));
+  memset(sb_hot,0xff,sizeof(sb_hot));
+  memset(tc_expired,0,sizeof(tc_expired));
+  tc_survivor_cnt = 0;
+#ifdef NDRC_THREAD
+  spec_cnt = 0;
+#endif
   memset(shadow,0,sizeof(shadow));
   hash_table_clear();
   mini_ht_clear();
@@ -6368,6 +6823,9 @@ void new_dynarec_clear_full(void)
   }
   stat_clear(stat_blocks);
   stat_clear(stat_links);
+#ifdef NDRC_SMC_MPROTECT
+  smc_prot_reset(HACK_ENABLED(NDHACK_SMC_MPROTECT));
+#endif
 
   if (ndrc_g.cycle_multiplier_old != Config.cycle_multiplier
       || ndrc_g.hacks_old != (ndrc_g.hacks | ndrc_g.hacks_pergame))
@@ -6502,6 +6960,9 @@ void new_dynarec_cleanup(void)
   }
   stat_clear(stat_blocks);
   stat_clear(stat_links);
+#ifdef NDRC_SMC_MPROTECT
+  smc_prot_reset(0);
+#endif
   new_dynarec_print_stats();
 }
 
@@ -6614,7 +7075,7 @@ void new_dynarec_load_blocks(const void *save, int size)
   // restore clean blocks, if any
   for (page = 0, b = i = 0; page < ARRAY_SIZE(blocks); page++) {
     for (block = blocks[page]; block != NULL; block = block->next, b++) {
-      if (!block->is_dirty)
+      if (!block->is_dirty || block->tier == SB_TIER_REPLACED)
         continue;
       assert(block->source && block->copy);
       if (memcmp(block->source, block->copy, block->len))
@@ -6653,14 +7114,28 @@ void new_dynarec_load_blocks(const void *save, int size)
 void new_dynarec_print_stats(void)
 {
 #ifdef STAT_PRINT
-  printf("cc %3d,%3d,%3d lu%6d,%3d,%3d c%3d inv%3d,%3d tc_offs %zu b %u,%u\n",
+  printf("cc %3d,%3d,%3d lu%6d,%3d,%3d c%3d inv%3d,%3d ld%5d,%3d tc_offs %zu b %u,%u\n",
     stat_bc_pre, stat_bc_direct, stat_bc_restore,
     stat_ht_lookups, stat_jump_in_lookups, stat_restore_tries,
     stat_restore_compares, stat_inv_addr_calls, stat_inv_hits,
+    stat_load_kept, stat_load_inv,
     out - ndrc->translation_cache, stat_blocks, stat_links);
+  if (stat_smc_faults)
+    printf("smc faults %d\n", stat_smc_faults);
+  if (stat_inv_bits_skips)
+    printf("inv bitmap skips %d\n", stat_inv_bits_skips);
+  if (stat_sb_compiles)
+    printf("superblocks %d\n", stat_sb_compiles);
+  if (stat_tc_survivors || stat_tc_lost)
+    printf("tc survivors %d, lost %d\n", stat_tc_survivors, stat_tc_lost);
+  if (stat_spec_compiles)
+    printf("speculative compiles %d\n", stat_spec_compiles);
   stat_bc_direct = stat_bc_pre = stat_bc_restore =
   stat_ht_lookups = stat_jump_in_lookups = stat_restore_tries =
-  stat_restore_compares = stat_inv_addr_calls = stat_inv_hits = 0;
+  stat_restore_compares = stat_inv_addr_calls = stat_inv_hits =
+  stat_load_kept = stat_load_inv = stat_smc_faults =
+  stat_inv_bits_skips = stat_sb_compiles =
+  stat_tc_survivors = stat_tc_lost = stat_spec_compiles = 0;
 #endif
 }
 
@@ -7094,6 +7569,31 @@ static void disassemble_one(int i, u_int src)
     }
 }
 
+// short side effect free polling loop closed by the branch at i?
+// If so, the interpreter runs the branch and can skip to the next event.
+static int is_poll_loop(int i)
+{
+  struct psxIdleLoop loop;
+  int t, k;
+
+  if (!HACK_ENABLED(NDHACK_IDLE_SKIP))
+    return 0;
+  if (dops[i].itype == RJUMP || cinfo[i].ba < start)
+    return 0;
+  t = (cinfo[i].ba - start) / 4;
+  if (t > i || i + 2 - t > IDLE_LOOP_MAX_INSNS)
+    return 0;
+  if (t == i && source[i+1] == 0)
+    return 0; // plain idle loop, do_cc() handles it
+  if (!psxIdleAnalyze(&loop, &source[t], i + 2 - t))
+    return 0;
+  // register contents are unknown here, so only lui+lw style addresses
+  for (k = 0; k < loop.load_cnt; k++)
+    if (loop.load_rs[k] != 0)
+      return 0;
+  return psxIdleAddrsOk(&loop, psxRegs.GPR.r); // reads only r0
+}
+
 static noinline void pass1a_disassemble(u_int pagelimit)
 {
   int i, j, done = 0;
@@ -7188,6 +7688,11 @@ static noinline void pass1a_disassemble(u_int pagelimit)
           force_j_to_interpreter = 1;
         }
       }
+      if (!force_j_to_interpreter && is_poll_loop(j)) {
+        assem_debug("polling loop @%08x\n", cinfo[j].ba);
+        force_j_to_interpreter = 1;
+        dops[(cinfo[j].ba - start) / 4].bt = 1; // return from interpreter
+      }
     }
     else if (i > 0 && dops[i-1].is_delay_load
              && is_ld_use_hazard(&dops[i-1], &dops[i])
@@ -7220,7 +7725,8 @@ static noinline void pass1a_disassemble(u_int pagelimit)
     /* Is this the end of the block? */
     if (i > 0 && dops[i-1].is_ujump) {
       // Don't recompile stuff that's already compiled
-      if (check_addr(start + i*4+4)) {
+      // (superblocks want it anyway, to keep the registers)
+      if (!sb_mode && check_addr(start + i*4+4)) {
         done = 1;
         continue;
       }
@@ -7245,13 +7751,17 @@ static noinline void pass1a_disassemble(u_int pagelimit)
             }
           }
         }
+        // superblock: take in short forward jumps too,
+        // the jump becomes internal once the target is reached
+        if (sb_mode && (u_int)(t - i) < 64 && start + (t+1)*4 < pagelimit)
+          found_bbranch = 1;
         if (!found_bbranch)
           done = 2;
       }
       else {
         // jal(r) - continue or perf may suffer for platforms without
         // runtime block linking (like in crash3)
-        if (stop_after_jal)
+        if (stop_after_jal && !sb_mode)
           done = 2;
       }
     }
@@ -9139,6 +9649,111 @@ static noinline void pass10_expire_blocks(void)
   }
 }
 
+// count compiles of code that was lost to expiry before
+static void tc_count_recompile(u_int vaddr)
+{
+  u_int offs = ram_offs(vaddr), bit;
+
+  if (tc_survivors_busy) {
+    ndrc_g.did_recompile++;
+    return;
+  }
+  if (offs == ~0u)
+    return;
+  bit = 1u << ((offs >> 2) & 31);
+  if (tc_expired[offs >> 7] & bit) {
+    tc_expired[offs >> 7] &= ~bit;
+    ndrc_g.did_recompile++;
+  }
+}
+
+// Hot code would otherwise be thrown away every time the cache wraps
+// and then compiled again one miss at a time. Compiled code can't be
+// moved (pc relative branches, literals, links), so the survivors are
+// compiled again at the young end instead. A wrap can expire dozens of
+// them at once, so only a few go per miss, nested compiles only queue.
+// With the compile thread they are left to new_dynarec_spec_pop().
+static noinline void pass10_recompile_survivors(void)
+{
+  u_int addr, n = 0;
+
+#ifdef NDRC_THREAD
+  if (ndrc_g.thread.handle)
+    return;
+#endif
+  if (tc_survivors_busy)
+    return;
+  tc_survivors_busy = 1;
+  while (tc_survivor_cnt > 0 && n++ < TC_SURVIVOR_BUDGET) {
+    addr = tc_survivors[--tc_survivor_cnt];
+    ndrc_get_addr_ht_param(hash_table, addr, ndrc_cm_compile_offline);
+    stat_inc(stat_tc_survivors);
+  }
+  tc_survivors_busy = 0;
+}
+
+#ifdef NDRC_THREAD
+static void spec_push(u_int vaddr)
+{
+  u_int a = vaddr & 0x1fffffff;
+
+  if ((vaddr & 3) || (a >= 0x800000 && a - 0x1fc00000 >= 0x80000))
+    return;
+  if (spec_cnt == ARRAY_SIZE(spec_queue)) {
+    memmove(spec_queue, spec_queue + 1, sizeof(spec_queue) - sizeof(spec_queue[0]));
+    spec_cnt--;
+  }
+  spec_queue[spec_cnt++] = vaddr;
+}
+
+// static branch targets and return addresses leading out of the block,
+// the end of the block ends up on top
+static noinline void pass10_spec_targets(void)
+{
+  int i;
+
+  if (!ndrc_g.thread.handle || tc_survivors_busy)
+    return;
+  for (i = 0; i < slen; i++) {
+    if (!dops[i].is_jump)
+      continue;
+    if (dops[i].itype != RJUMP && !internal_branch(cinfo[i].ba))
+      spec_push(cinfo[i].ba);
+    if (dops[i].rt1 == 31 && i + 2 >= slen)
+      spec_push(start + i*4 + 8);
+  }
+  if (slen < 2 || !dops[slen-2].is_ujump)
+    spec_push(start + slen*4);
+}
+
+// next predicted block that isn't compiled yet (compile thread only),
+// expired hot blocks first as they are known to be needed again
+int new_dynarec_spec_pop(unsigned int *vaddr)
+{
+  while (tc_survivor_cnt > 0) {
+    u_int addr = tc_survivors[--tc_survivor_cnt];
+    u_int offs = ram_offs(addr);
+    if (ndrc_get_addr_ht_param(hash_table, addr, ndrc_cm_no_compile))
+      continue;
+    // for tc_count_recompile()
+    if (offs != ~0u)
+      tc_expired[offs >> 7] |= 1u << ((offs >> 2) & 31);
+    stat_inc(stat_tc_survivors);
+    *vaddr = addr;
+    return 1;
+  }
+  while (spec_cnt > 0) {
+    u_int addr = spec_queue[--spec_cnt];
+    if (ndrc_get_addr_ht_param(hash_table, addr, ndrc_cm_no_compile))
+      continue;
+    stat_inc(stat_spec_compiles);
+    *vaddr = addr;
+    return 1;
+  }
+  return 0;
+}
+#endif
+
 static struct block_info *new_block_info(u_int start, u_int len,
   const void *source, const void *copy, u_char *beginning, u_short jump_in_count)
 {
@@ -9158,7 +9773,9 @@ static struct block_info *new_block_info(u_int start, u_int len,
   //block->tc_len = out - beginning;
   block->is_dirty = 0;
   block->inv_near_misses = 0;
+  block->tier = SB_TIER_NORMAL;
   block->jump_in_cnt = jump_in_count;
+  block->samples = 0;
 
   // insert sorted by start mirror-unmasked vaddr
   for (b_pptr = &blocks[page]; ; b_pptr = &((*b_pptr)->next)) {
@@ -9196,6 +9813,8 @@ static int noinline new_recompile_block(u_int addr)
 
   start = addr;
   ndrc_g.did_compile++;
+  sb_mode = HACK_ENABLED(NDHACK_SUPERBLOCKS)
+    && sb_hot[(addr >> 2) % ARRAY_SIZE(sb_hot)] == addr;
   if (Config.HLE && start == 0x80001000) // hlecall
   {
     void *beginning = start_block();
@@ -9553,6 +10172,11 @@ static int noinline new_recompile_block(u_int addr)
   struct block_info *block =
     new_block_info(start, slen * 4, source, copy, beginning, jump_in_count);
   block->reg_sv_flags = state_rflags;
+  if (sb_mode) {
+    block->tier = SB_TIER_SUPER;
+    stat_inc(stat_sb_compiles);
+  }
+  tc_count_recompile(start);
 
   int jump_in_i = 0;
   for (i = 0; i < slen; i++)
@@ -9598,9 +10222,14 @@ static int noinline new_recompile_block(u_int addr)
   // Trap writes to any of the pages we compiled
   mark_invalid_code(start, slen*4, 0);
 
+#ifdef NDRC_THREAD
+  pass10_spec_targets();
+#endif
+
   /* Pass 10 - Free memory by expiring oldest blocks */
 
   pass10_expire_blocks();
+  pass10_recompile_survivors();
 
 #ifdef ASSEM_PRINT
   fflush(stdout);
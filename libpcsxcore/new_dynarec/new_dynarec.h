@@ -10,6 +10,9 @@
 #define NDHACK_NO_COMPAT_HACKS	(1<<5)
 #define NDHACK_THREAD_FORCE   	(1<<6)
 #define NDHACK_THREAD_FORCE_ON	(1<<7)
+#define NDHACK_SMC_MPROTECT	(1<<8)
+#define NDHACK_SUPERBLOCKS	(1<<9)
+#define NDHACK_IDLE_SKIP	(1<<10) // set from psxIdleSkipOn()
 
 struct ndrc_globals
 {
@@ -17,6 +20,7 @@ struct ndrc_globals
 	int hacks_pergame;
 	int hacks_old;
 	int did_compile;
+	int did_recompile; // of code that expired from the cache
 	int cycle_multiplier_old;
 	struct {
 		void *handle;
@@ -25,6 +29,9 @@ struct ndrc_globals
 		void *dirty_start;
 		void *dirty_end;
 		unsigned int busy_addr; // 0 is valid, ~0 == none
+		unsigned int spec_addr; // speculative compile, ~0 == none
+		int spec_active; // speculating after busy_addr was released
+		int spec_stop; // main thread -> compile thread, __atomic_* only
 		int exit;
 	} thread;
 };
@@ -36,10 +43,18 @@ void new_dynarec_clear_full(void);
 int  new_dynarec_save_blocks(void *save, int size);
 void new_dynarec_load_blocks(const void *save, int size);
 void new_dynarec_print_stats(void);
+void new_dynarec_hot_sample(unsigned int vaddr);
+void new_dynarec_print_hot_blocks(int count);
 
 int  new_dynarec_quick_check_range(unsigned int start, unsigned int end);
 void new_dynarec_invalidate_range(unsigned int start, unsigned int end);
 void new_dynarec_invalidate_all_pages(void);
+void new_dynarec_invalidate_changed(void);
+int  new_dynarec_smc_fault(const void *host_addr);
+int  new_dynarec_smc_pending(void);
+void new_dynarec_smc_flush(void);
+int  new_dynarec_spec_pop(unsigned int *vaddr);
+void new_dynarec_smc_unprotect(void);
 void new_dyna_clear_cache(void *start, void *end);
 
 void new_dyna_start(void *context);
@@ -11,6 +11,7 @@
 //#define BASE_ADDR_DYNAMIC 1
 //#define TC_WRITE_OFFSET 1
 //#define NDRC_CACHE_FLUSH_ALL 1
+//#define NDRC_SMC_MPROTECT 1 // allow NDHACK_SMC_MPROTECT
 
 #if defined(__MACH__) || defined(HAVE_LIBNX)
 #define NO_WRITE_EXEC 1
@@ -24,3 +25,6 @@
 #if defined(_3DS)
 #define NDRC_CACHE_FLUSH_ALL 1
 #endif
+#if defined(__linux__)
+#define NDRC_SMC_MPROTECT 1
+#endif
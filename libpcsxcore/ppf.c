@@ -26,161 +26,141 @@
 #include "misc.h"
 #include "cdrom.h"
 
-typedef struct tagPPF_DATA {
+typedef struct {
 	s32					addr;
 	s32					pos;
 	s32					anz;
-	struct tagPPF_DATA	*pNext;
-} PPF_DATA;
-
-typedef struct tagPPF_CACHE {
-	s32					addr;
-	struct tagPPF_DATA	*pNext;
-} PPF_CACHE;
+	u32					data;	// offset of the patch bytes
+} PPF_PATCH;
+
+// compiled patch table, one allocation holding the sector index,
+// the patch records and the patch bytes
+static struct {
+	void				*arena;
+	const u32			*index;		// first patch per sector, sector_cnt + 1 entries
+	const PPF_PATCH		*patches;
+	const u8			*data;
+	s32					first_sector;
+	s32					sector_cnt;
+} ppf;
+
+// load-time staging, in file order
+static PPF_PATCH		*ppfTmp = NULL;
+static u8				*ppfTmpData = NULL;
+static int				ppfTmpCnt, ppfTmpAlloc;
+static u32				ppfTmpDataLen, ppfTmpDataAlloc;
+
+static void FreePPFTmp() {
+	free(ppfTmp);
+	free(ppfTmpData);
+	ppfTmp = NULL;
+	ppfTmpData = NULL;
+	ppfTmpCnt = ppfTmpAlloc = 0;
+	ppfTmpDataLen = ppfTmpDataAlloc = 0;
+}
 
-static PPF_CACHE		*ppfCache = NULL;
-static PPF_DATA			*ppfHead = NULL, *ppfLast = NULL;
-static int				iPPFNum = 0;
+static int ppf_patch_cmp(const void *p1_, const void *p2_) {
+	const PPF_PATCH *p1 = p1_, *p2 = p2_;
+	if (p1->addr != p2->addr)
+		return p1->addr < p2->addr ? -1 : 1;
+	if (p1->pos != p2->pos)
+		return p1->pos < p2->pos ? -1 : 1;
+	// same spot: the later patch goes first, like the old list insertion did
+	return (p1->data < p2->data) - (p1->data > p2->data);
+}
 
-// using a linked data list, and address array
+// sort the staged patches and build the per-sector index
 static void FillPPFCache() {
-	PPF_DATA		*p;
-	PPF_CACHE		*pc;
-	s32				lastaddr;
-
-	p = ppfHead;
-	lastaddr = -1;
-	iPPFNum = 0;
-
-	while (p != NULL) {
-		if (p->addr != lastaddr) iPPFNum++;
-		lastaddr = p->addr;
-		p = p->pNext;
-	}
+	size_t index_size, patches_size;
+	u32 *index;
+	PPF_PATCH *patches;
+	u8 *arena;
+	s32 i, sect;
 
-	if (iPPFNum <= 0) return;
+	if (ppfTmpCnt <= 0) return;
 
-	pc = ppfCache = (PPF_CACHE *)malloc(iPPFNum * sizeof(PPF_CACHE));
-	if (pc == NULL) return;
+	qsort(ppfTmp, ppfTmpCnt, sizeof(ppfTmp[0]), ppf_patch_cmp);
 
-	iPPFNum--;
-	p = ppfHead;
-	lastaddr = -1;
+	ppf.first_sector = ppfTmp[0].addr;
+	ppf.sector_cnt = ppfTmp[ppfTmpCnt - 1].addr - ppf.first_sector + 1;
 
-	while (p != NULL) {
-		if (p->addr != lastaddr) {
-			pc->addr = p->addr;
-			pc->pNext = p;
-			pc++;
-		}
-		lastaddr = p->addr;
-		p = p->pNext;
+	index_size = (ppf.sector_cnt + 1) * sizeof(index[0]);
+	patches_size = ppfTmpCnt * sizeof(patches[0]);
+	arena = malloc(index_size + patches_size + ppfTmpDataLen);
+	if (arena == NULL) {
+		ppf.sector_cnt = 0;
+		return;
 	}
+	index = (u32 *)arena;
+	patches = (PPF_PATCH *)(arena + index_size);
+	memcpy(patches, ppfTmp, patches_size);
+	memcpy(arena + index_size + patches_size, ppfTmpData, ppfTmpDataLen);
+
+	for (i = sect = 0; sect < ppf.sector_cnt; sect++) {
+		index[sect] = i;
+		while (i < ppfTmpCnt && patches[i].addr == ppf.first_sector + sect)
+			i++;
+	}
+	index[sect] = i;
+
+	ppf.arena = arena;
+	ppf.index = index;
+	ppf.patches = patches;
+	ppf.data = arena + index_size + patches_size;
 }
 
 void FreePPFCache() {
-	PPF_DATA *p = ppfHead;
-	void *pn;
-
-	while (p != NULL) {
-		pn = p->pNext;
-		free(p);
-		p = (PPF_DATA *)pn;
-	}
-	ppfHead = NULL;
-	ppfLast = NULL;
-
-	if (ppfCache != NULL) free(ppfCache);
-	ppfCache = NULL;
+	FreePPFTmp();
+	free(ppf.arena);
+	memset(&ppf, 0, sizeof(ppf));
 }
 
 void CheckPPFCache(unsigned char *pB, unsigned char m, unsigned char s, unsigned char f) {
-	PPF_CACHE *pcstart, *pcend, *pcpos;
-	int addr = MSF2SECT(m, s, f), pos, anz, start;
-
-	if (ppfCache == NULL) return;
-
-	pcstart = ppfCache;
-	if (addr < pcstart->addr) return;
-	pcend = ppfCache + iPPFNum;
-	if (addr > pcend->addr) return;
-
-	while (1) {
-		if (addr == pcend->addr) { pcpos = pcend; break; }
-
-		pcpos = pcstart + (pcend - pcstart) / 2;
-		if (pcpos == pcstart) break;
-		if (addr < pcpos->addr) {
-			pcend = pcpos;
-			continue;
-		}
-		if (addr > pcpos->addr) {
-			pcstart = pcpos;
-			continue;
-		}
-		break;
-	}
-
-	if (addr == pcpos->addr) {
-		PPF_DATA *p = pcpos->pNext;
-		while (p != NULL && p->addr == addr) {
-			pos = p->pos - (CD_FRAMESIZE_RAW - DATA_SIZE);
-			anz = p->anz;
-			if (pos < 0) { start = -pos; pos = 0; anz -= start; }
-			else start = 0;
-			memcpy(pB + pos, (unsigned char *)(p + 1) + start, anz);
-			p = p->pNext;
-		}
+	u32 sect = MSF2SECT(m, s, f) - ppf.first_sector;
+	int pos, anz, start;
+	u32 i;
+
+	if (sect >= (u32)ppf.sector_cnt) return;
+
+	for (i = ppf.index[sect]; i < ppf.index[sect + 1]; i++) {
+		const PPF_PATCH *p = &ppf.patches[i];
+		pos = p->pos - (CD_FRAMESIZE_RAW - DATA_SIZE);
+		anz = p->anz;
+		if (pos < 0) { start = -pos; pos = 0; anz -= start; }
+		else start = 0;
+		if (anz > 0)
+			memcpy(pB + pos, ppf.data + p->data + start, anz);
 	}
 }
 
 static void AddToPPF(s32 ladr, s32 pos, s32 anz, unsigned char *ppfmem) {
-	if (ppfHead == NULL) {
-		ppfHead = (PPF_DATA *)malloc(sizeof(PPF_DATA) + anz);
-		if (ppfHead == NULL) return;
-		ppfHead->addr = ladr;
-		ppfHead->pNext = NULL;
-		ppfHead->pos = pos;
-		ppfHead->anz = anz;
-		memcpy(ppfHead + 1, ppfmem, anz);
-		iPPFNum = 1;
-		ppfLast = ppfHead;
-	} else {
-		PPF_DATA *p = ppfHead;
-		PPF_DATA *plast = NULL;
-		PPF_DATA *padd;
-
-		if (ladr > ppfLast->addr || (ladr == ppfLast->addr && pos > ppfLast->pos)) {
-			p = NULL;
-			plast = ppfLast;
-		} else {
-			while (p != NULL) {
-				if (ladr < p->addr) break;
-				if (ladr == p->addr) {
-					while (p && ladr == p->addr && pos > p->pos) {
-						plast = p;
-						p = p->pNext;
-					}
-					break;
-				}
-				plast = p;
-				p = p->pNext;
-			}
-		}
-
-		padd = (PPF_DATA *)malloc(sizeof(PPF_DATA) + anz);
-		if (padd == NULL) return;
-		padd->addr = ladr;
-		padd->pNext = p;
-		padd->pos = pos;
-		padd->anz = anz;
-		memcpy(padd + 1, ppfmem, anz);
-		iPPFNum++;
-		if (plast == NULL) ppfHead = padd;
-		else plast->pNext = padd;
-
-		if (padd->pNext == NULL) ppfLast = padd;
+	PPF_PATCH *p;
+
+	if (ppfTmpCnt >= ppfTmpAlloc) {
+		int alloc = ppfTmpAlloc ? ppfTmpAlloc * 2 : 256;
+		p = realloc(ppfTmp, alloc * sizeof(ppfTmp[0]));
+		if (p == NULL) return;
+		ppfTmp = p;
+		ppfTmpAlloc = alloc;
+	}
+	if (ppfTmpDataLen + anz > ppfTmpDataAlloc) {
+		u32 alloc = ppfTmpDataAlloc ? ppfTmpDataAlloc * 2 : 16 * 1024;
+		u8 *d;
+		while (ppfTmpDataLen + anz > alloc)
+			alloc *= 2;
+		d = realloc(ppfTmpData, alloc);
+		if (d == NULL) return;
+		ppfTmpData = d;
+		ppfTmpDataAlloc = alloc;
 	}
+
+	p = &ppfTmp[ppfTmpCnt++];
+	p->addr = ladr;
+	p->pos = pos;
+	p->anz = anz;
+	p->data = ppfTmpDataLen;
+	memcpy(ppfTmpData + ppfTmpDataLen, ppfmem, anz);
+	ppfTmpDataLen += anz;
 }
 
 void BuildPPFCache(const char *fname) {
@@ -348,7 +328,8 @@ void BuildPPFCache(const char *fname) {
 
 	fclose(ppffile);
 
-	FillPPFCache(); // build address array
+	FillPPFCache(); // build the sector index
+	FreePPFTmp();
 
 	SysPrintf(_("Loaded PPF %d.0 patch: %s.\n"), method + 1, fname);
 	return;
@@ -358,6 +339,7 @@ fail_io:
 	SysPrintf(_("File IO error in <%s:%s>.\n"), __FILE__, __func__);
 #endif
 	fclose(ppffile);
+	FreePPFTmp();
 }
 
 // redump.org SBI files, slightly different handling from PCSX-Reloaded
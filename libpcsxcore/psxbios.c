@@ -375,6 +375,13 @@ static void storeRam32(u32 addr, u32 d)
 	*((u32 *)psxM + ((addr & 0x1fffff) >> 2)) = SWAP32(d);
 }
 
+// number of bytes from addr up to the end of its 64k mem LUT page, at most len
+static u32 lut_span(u32 addr, u32 len)
+{
+	u32 left = 0x10000 - (addr & 0xffff);
+	return len < left ? len : left;
+}
+
 static void mips_return(u32 val)
 {
 	v0 = val;
@@ -875,15 +882,36 @@ void psxBios_strncmp() { // 0x18
 }
 
 void psxBios_strcpy() { // 0x19
-	char *p1 = (char *)Ra0, *p2 = (char *)Ra1;
-	PSXBIOS_LOG("psxBios_%s %x, %s (%x)\n", biosA0n[0x19], a0, p2, a1);
+	u32 d = a0, s = a1;
+	PSXBIOS_LOG("psxBios_%s %x, %s (%x)\n", biosA0n[0x19], a0, Ra1, a1);
 	if (a0 == 0 || a1 == 0)
 	{
 		v0 = 0;
 		pc0 = ra;
 		return;
 	}
-	while ((*p1++ = *p2++) != '\0');
+	for (;;) {
+		u32 n = lut_span(d, lut_span(s, 0x10000));
+		const char *p2 = PSXM(s), *end;
+		char *p1 = PSXM(d);
+		if (p1 == INVALID_PTR || p2 == INVALID_PTR)
+			break;
+		end = memchr(p2, 0, n);
+		if (end)
+			n = end - p2 + 1;
+		if (p2 < p1 && p1 < p2 + n) {
+			u32 i;
+			for (i = 0; i < n; i++)
+				p1[i] = p2[i];
+		}
+		else
+			memmove(p1, p2, n);
+		d += n;
+		s += n;
+		if (end)
+			break;
+	}
+	psxCpu->Clear(a0, (d - a0 + 3) / 4);
 
 	v0 = a0; pc0 = ra;
 }
@@ -1056,32 +1084,68 @@ void psxBios_tolower() { // 0x26
 
 static void do_memset(u32 dst, u32 v, s32 len)
 {
-	u32 d = dst;
-	s32 l = len;
-	while (l-- > 0) {
+	u32 d = dst, l = len > 0 ? len : 0;
+	while (l > 0) {
+		u32 n = lut_span(d, l);
 		u8 *db = PSXM(d);
 		if (db != INVALID_PTR)
-			*db = v;
-		d++;
+			memset(db, v, n);
+		d += n;
+		l -= n;
 	}
 	psxCpu->Clear(dst, (len + 3) / 4);
 }
 
 static void do_memcpy(u32 dst, u32 src, s32 len)
 {
-	u32 d = dst, s = src;
-	s32 l = len;
-	while (l-- > 0) {
-		const u8 *sb = PSXM(s);
-		u8 *db = PSXM(d);
-		if (db != INVALID_PTR && sb != INVALID_PTR)
-			*db = *sb;
-		d++;
-		s++;
+	u32 d = dst, s = src, l = len > 0 ? len : 0;
+	while (l > 0) {
+		u32 n = lut_span(d, l);
+		const u8 *sb;
+		u8 *db;
+		n = lut_span(s, n);
+		sb = PSXM(s);
+		db = PSXM(d);
+		if (db != INVALID_PTR && sb != INVALID_PTR) {
+			if (sb < db && db < sb + n) {
+				// forward overlap, games may rely on the pattern fill
+				u32 i;
+				for (i = 0; i < n; i++)
+					db[i] = sb[i];
+			}
+			else
+				memmove(db, sb, n);
+		}
+		d += n;
+		s += n;
+		l -= n;
 	}
 	psxCpu->Clear(dst, (len + 3) / 4);
 }
 
+// backwards copy of len bytes ending at (and including) dst_end/src_end
+static void do_memcpy_back(u32 dst_end, u32 src_end, u32 len)
+{
+	u32 d = dst_end, s = src_end, l = len;
+	while (l > 0) {
+		u32 n = (d & 0xffff) + 1;
+		const u8 *sb;
+		u8 *db;
+		if (n > (s & 0xffff) + 1)
+			n = (s & 0xffff) + 1;
+		if (n > l)
+			n = l;
+		sb = PSXM(s - n + 1);
+		db = PSXM(d - n + 1);
+		if (db != INVALID_PTR && sb != INVALID_PTR)
+			memmove(db, sb, n);
+		d -= n;
+		s -= n;
+		l -= n;
+	}
+	psxCpu->Clear(dst_end - len + 1, (len + 3) / 4);
+}
+
 static void psxBios_memcpy();
 
 static void psxBios_bcopy() { // 0x27 - memcpy with args swapped
@@ -1120,17 +1184,31 @@ static void psxBios_bzero() { // 0x28
 }
 
 void psxBios_bcmp() { // 0x29
-	char *p1 = (char *)Ra0, *p2 = (char *)Ra1;
+	u32 len = (s32)a2 > 0 ? a2 : 0, done = 0;
 
 	if (a0 == 0 || a1 == 0) { v0 = 0; pc0 = ra; return; }
 
-	while ((s32)a2-- > 0) {
-		if (*p1++ != *p2++) {
-			v0 = *p1 - *p2; // BUG: compare the NEXT byte
+	while (done < len) {
+		u32 n = lut_span(a1 + done, lut_span(a0 + done, len - done));
+		const char *p1 = PSXM(a0 + done), *p2 = PSXM(a1 + done);
+		if (p1 == INVALID_PTR || p2 == INVALID_PTR)
+			break;
+		if (memcmp(p1, p2, n) != 0) {
+			while (*p1 == *p2)
+				p1++, p2++, done++;
+			a2 -= done + 1;
+			// BUG: compare the NEXT byte
+			p1 = PSXM(a0 + done + 1);
+			p2 = PSXM(a1 + done + 1);
+			v0 = 0;
+			if (p1 != INVALID_PTR && p2 != INVALID_PTR)
+				v0 = *p1 - *p2;
 			pc0 = ra;
 			return;
 		}
+		done += n;
 	}
+	a2 -= len + 1;
 
 	v0 = 0; pc0 = ra;
 }
@@ -1177,19 +1255,11 @@ void psxBios_memmove() { // 0x2c
 	}
 	v1 = a0;
 	if ((s32)a2 > 0 && a0 > a1 && a0 < a1 + a2) {
-		u32 dst = a0, len = a2 + 1;
-		a0 += a2;
-		a1 += a2;
-		while ((s32)a2 >= 0) { // BUG: copies one more byte here
-			const u8 *sb = PSXM(a1);
-			u8 *db = PSXM(a0);
-			if (db != INVALID_PTR && sb != INVALID_PTR)
-				*db = *sb;
-			a0--;
-			a1--;
-			a2--;
-		}
-		psxCpu->Clear(dst, (len + 3) / 4);
+		u32 len = a2 + 1; // BUG: copies one more byte here
+		do_memcpy_back(a0 + a2, a1 + a2, len);
+		a0--;
+		a1--;
+		a2 = -1;
 		cycles = 10 + len * 8;
 	} else if ((s32)a2 > 0) {
 		do_memcpy(a0, a1, a2);
@@ -1237,12 +1307,13 @@ static void psxBios_srand() { // 0x30
 }
 
 static u32 qscmpfunc, qswidth;
+static char *qsbase;
 
 static inline int qscmp(char *a, char *b) {
 	u32 sa0 = a0;
 
-	a0 = sa0 + (a - (char *)PSXM(sa0));
-	a1 = sa0 + (b - (char *)PSXM(sa0));
+	a0 = sa0 + (a - qsbase);
+	a1 = sa0 + (b - qsbase);
 
 	softCall(qscmpfunc);
 
@@ -1251,26 +1322,30 @@ static inline int qscmp(char *a, char *b) {
 }
 
 static inline void qexchange(char *i, char *j) {
-	char t;
-	int n = qswidth;
+	char t[64];
+	u32 n, left = qswidth;
 
 	do {
-		t = *i;
-		*i++ = *j;
-		*j++ = t;
-	} while (--n);
+		n = left < sizeof(t) ? left : sizeof(t);
+		memcpy(t, i, n);
+		memcpy(i, j, n);
+		memcpy(j, t, n);
+		i += n; j += n;
+	} while (left -= n);
 }
 
 static inline void q3exchange(char *i, char *j, char *k) {
-	char t;
-	int n = qswidth;
+	char t[64];
+	u32 n, left = qswidth;
 
 	do {
-		t = *i;
-		*i++ = *k;
-		*k++ = *j;
-		*j++ = t;
-	} while (--n);
+		n = left < sizeof(t) ? left : sizeof(t);
+		memcpy(t, i, n);
+		memcpy(i, k, n);
+		memcpy(k, j, n);
+		memcpy(j, t, n);
+		i += n; j += n; k += n;
+	} while (left -= n);
 }
 
 static void qsort_main(char *a, char *l) {
@@ -1337,7 +1412,9 @@ loop:
 void psxBios_qsort() { // 0x31
 	qswidth = a2;
 	qscmpfunc = a3;
-	qsort_main((char *)Ra0, (char *)Ra0 + a1 * a2);
+	qsbase = Ra0;
+	if (qsbase != INVALID_PTR && a2 != 0)
+		qsort_main(qsbase, qsbase + a1 * a2);
 
 	pc0 = ra;
 }
@@ -129,6 +129,8 @@ typedef struct {
 	boolean DisableStalls;
 	boolean PreciseExceptions;
 	boolean TurboCD;
+	boolean HugePages; // huge page backed RAM/VRAM, applied on next start
+	boolean IdleSkip; // skip side effect free polling loops, see psxidle.c
 	int cycle_multiplier; // 100 for 1.0
 	int cycle_multiplier_override;
 	int gpu_timing_override;
@@ -143,6 +145,7 @@ typedef struct {
 		boolean dualshock_init_analog;
 		boolean fractional_Framerate;
 		boolean f1;
+		boolean no_idle_skip;
 	} hacks;
 } PcsxConfig;
 
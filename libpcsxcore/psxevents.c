@@ -5,6 +5,7 @@
 #include "psxdma.h"
 #include "mdec.h"
 #include "psxevents.h"
+#include "psxtrace.h"
 
 //#define evprintf printf
 #define evprintf(...)
@@ -73,6 +74,8 @@ void irq_test(psxCP0Regs *cp0)
 		if ((s32)(cycle - regs->event_cycles[irq]) >= 0) {
 			// note: irq_funcs() also modify regs->interrupt
 			regs->interrupt &= ~(1u << irq);
+			if (psxTraceOn)
+				psxTraceEvent(regs->pc, cycle, irq);
 			irq_funcs[irq]();
 		}
 	}
@@ -80,8 +83,11 @@ void irq_test(psxCP0Regs *cp0)
 	cp0->n.Cause &= ~0x400;
 	if (psxHu32(0x1070) & psxHu32(0x1074))
 		cp0->n.Cause |= 0x400;
-	if (((cp0->n.Cause | 1) & cp0->n.SR & 0x401) == 0x401)
+	if (((cp0->n.Cause | 1) & cp0->n.SR & 0x401) == 0x401) {
+		if (psxTraceOn)
+			psxTraceEvent(regs->pc, cycle, PSXTR_EV_IRQ);
 		psxException(0, 0, cp0);
+	}
 }
 
 void gen_interupt(psxCP0Regs *cp0)
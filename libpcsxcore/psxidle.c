@@ -0,0 +1,346 @@
+/*
+ * Polling loop detection.
+ *
+ * Games often spin on a VSync flag in RAM, I_STAT, GPUSTAT or DMA
+ * registers waiting for something that only happens on an event
+ * (irq, dma completion, ...). If such a loop is short and has no side
+ * effects, every iteration until the next event does exactly the same
+ * thing, so the cycle counter can be moved to that event right away.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "r3000a.h"
+#include "psxmem.h"
+#include "psxidle.h"
+
+struct psxIdleStats psxIdleStats;
+
+enum { IT_BAD, IT_ALU, IT_LOAD, IT_BRANCH };
+
+// what can change between events without the CPU doing anything
+enum { AC_NONE, AC_STATIC, AC_GPUSTAT };
+
+#define RS(c) (((c) >> 21) & 0x1f)
+#define RT(c) (((c) >> 16) & 0x1f)
+#define RD(c) (((c) >> 11) & 0x1f)
+
+static int insn_type(u32 c, u32 *reads, u32 *write)
+{
+	u32 rs = 1u << RS(c), rt = 1u << RT(c), rd = 1u << RD(c);
+	int type = IT_BAD;
+
+	*reads = *write = 0;
+	switch (c >> 26) {
+	case 0x00:
+		switch (c & 0x3f) {
+		case 0x00: case 0x02: case 0x03: // SLL SRL SRA
+			*reads = rt; *write = rd; type = IT_ALU;
+			break;
+		case 0x04: case 0x06: case 0x07: // SLLV SRLV SRAV
+		case 0x21: case 0x23: case 0x24: case 0x25: // ADDU SUBU AND OR
+		case 0x26: case 0x27: case 0x2a: case 0x2b: // XOR NOR SLT SLTU
+			*reads = rs | rt; *write = rd; type = IT_ALU;
+			break;
+		case 0x10: case 0x12: // MFHI MFLO
+			*write = rd; type = IT_ALU;
+			break;
+		}
+		break;
+	case 0x01: // BLTZ BGEZ, but not the linking variants
+		if (RT(c) <= 1) {
+			*reads = rs; type = IT_BRANCH;
+		}
+		break;
+	case 0x02: // J
+		type = IT_BRANCH;
+		break;
+	case 0x04: case 0x05: // BEQ BNE
+		*reads = rs | rt; type = IT_BRANCH;
+		break;
+	case 0x06: case 0x07: // BLEZ BGTZ
+		*reads = rs; type = IT_BRANCH;
+		break;
+	case 0x09: case 0x0a: case 0x0b: // ADDIU SLTI SLTIU
+	case 0x0c: case 0x0d: case 0x0e: // ANDI ORI XORI
+		*reads = rs; *write = rt; type = IT_ALU;
+		break;
+	case 0x0f: // LUI
+		*write = rt; type = IT_ALU;
+		break;
+	case 0x20: case 0x21: case 0x23: case 0x24: case 0x25: // LB LH LW LBU LHU
+		*reads = rs; *write = rt; type = IT_LOAD;
+		break;
+	}
+	*reads &= ~1u;
+	*write &= ~1u;
+	return type;
+}
+
+/*
+ * code[] is the loop from its head to the delay slot of the backward branch
+ * (which is assumed to target the head). Accept it only if it's made of
+ * loads and simple ALU ops and nothing carries over from one iteration to
+ * the next, so that the outcome depends only on what the loads return.
+ */
+int psxIdleAnalyze(struct psxIdleLoop *loop, const u32 *code, int count)
+{
+	u32 reads, write, loop_writes = 0, written = 0;
+	u32 cmask = 0, cval[32], writes_after[IDLE_LOOP_MAX_INSNS + 1];
+	u32 prev_load = 0;
+	int i, type;
+
+	loop->load_cnt = 0;
+	if (count < 2 || count > IDLE_LOOP_MAX_INSNS)
+		return 0;
+
+	writes_after[count] = 0;
+	for (i = count - 1; i >= 0; i--) {
+		type = insn_type(code[i], &reads, &write);
+		if (type == IT_BAD || (type == IT_BRANCH) != (i == count - 2))
+			return 0;
+		loop_writes |= write;
+		writes_after[i] = writes_after[i + 1] | write;
+	}
+
+	for (i = 0; i < count; i++) {
+		u32 c = code[i], imm = (u32)(s16)c;
+		type = insn_type(c, &reads, &write);
+		// loop carried dependency (possibly through a load delay slot)
+		if (reads & ((loop_writes & ~written) | prev_load))
+			return 0;
+		written |= write;
+		prev_load = 0;
+
+		if (type == IT_LOAD) {
+			int n = loop->load_cnt;
+			if (n >= IDLE_LOOP_MAX_LOADS)
+				return 0;
+			loop->load_rs[n] = RS(c);
+			loop->load_ofs[n] = imm;
+			if (cmask & (1u << RS(c))) {
+				loop->load_rs[n] = 0;
+				loop->load_ofs[n] += cval[RS(c)];
+			}
+			// the address gets recomputed from the registers as they
+			// are at the end of the loop, so the base must stay put
+			else if (writes_after[i] & (1u << RS(c)))
+				return 0;
+			loop->load_cnt++;
+			prev_load = write;
+		}
+
+		// track constants for lui+lw style hw accesses
+		cmask &= ~write;
+		if ((c >> 26) == 0x0f)
+			cval[RT(c)] = c << 16;
+		else if ((c >> 26) == 0x09 && (cmask & (1u << RS(c))))
+			cval[RT(c)] = cval[RS(c)] + imm;
+		else if ((c >> 26) == 0x0d && (cmask & (1u << RS(c))))
+			cval[RT(c)] = cval[RS(c)] | (c & 0xffff);
+		else
+			continue;
+		cmask |= write;
+	}
+	return 1;
+}
+
+static int addr_class(u32 addr)
+{
+	u32 a = addr & 0x1fffffff;
+
+	if (a < 0x00800000)                 // ram and its mirrors
+		return AC_STATIC;
+	if (a - 0x1f800000 < 0x400)         // scratchpad
+		return AC_STATIC;
+	if (a - 0x1fc00000 < 0x80000)       // bios
+		return AC_STATIC;
+	if (a - 0x1f801070 < 8)             // I_STAT, I_MASK
+		return AC_STATIC;
+	if (a - 0x1f801080 < 0x80)          // dma
+		return AC_STATIC;
+	if ((a & ~3) == 0x1f801814)
+		return AC_GPUSTAT;
+	// not root counters, they advance with cycles and skipping
+	// may overshoot what the game is waiting for
+	return AC_NONE;
+}
+
+// the speed hack is on and the game isn't on the database's deny list
+int psxIdleSkipOn(void)
+{
+	return Config.IdleSkip && !Config.hacks.no_idle_skip;
+}
+
+int psxIdleHwPollable(u32 addr)
+{
+	return psxIdleSkipOn() && (addr & 0x1fffe000) == 0x1f800000
+		&& addr_class(addr) != AC_NONE;
+}
+
+int psxIdleAddrsOk(const struct psxIdleLoop *loop, const u32 *gpr)
+{
+	int i;
+
+	if (!psxIdleSkipOn())
+		return 0;
+	for (i = 0; i < loop->load_cnt; i++)
+		if (addr_class(gpr[loop->load_rs[i]] + loop->load_ofs[i]) == AC_NONE)
+			return 0;
+	return 1;
+}
+
+static u32 next_event(void)
+{
+	u32 c = psxRegs.cycle, irqs = psxRegs.interrupt, i;
+	s32 min = psxRegs.psxNextsCounter + psxRegs.psxNextCounter - c, dif;
+
+	dif = psxRegs.next_interupt - c;
+	if (0 < dif && dif < min)
+		min = dif;
+	for (i = 0; irqs != 0; i++, irqs >>= 1) {
+		if (!(irqs & 1))
+			continue;
+		dif = psxRegs.event_cycles[i] - c;
+		if (dif < min)
+			min = dif;
+	}
+	return min > 0 ? c + min : c;
+}
+
+static void skip_loop(const struct psxIdleLoop *loop, const u32 *gpr)
+{
+	u32 c = psxRegs.cycle, target = next_event();
+	u32 lcf = (c | 2047) + 1;
+	int i, cls;
+
+	for (i = 0; i < loop->load_cnt; i++) {
+		cls = addr_class(gpr[loop->load_rs[i]] + loop->load_ofs[i]);
+		if (cls == AC_NONE)
+			return;
+		if (cls != AC_GPUSTAT)
+			continue;
+		// the busy and LCF bits are derived from the cycle counter
+		if ((s32)(psxRegs.gpuIdleAfter - c) > 0
+		    && (s32)(psxRegs.gpuIdleAfter - target) < 0)
+			target = psxRegs.gpuIdleAfter;
+		if ((s32)(lcf - target) < 0)
+			target = lcf;
+	}
+	if ((s32)(target - c) <= 0)
+		return;
+
+	psxIdleStats.skips++;
+	psxIdleStats.cycles += target - c;
+	psxRegs.cycle = target;
+}
+
+static int fetch_loop(u32 *code, u32 head, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		const u32 *p = (const u32 *)PSXM(head + i * 4);
+		if (p == INVALID_PTR)
+			return 0;
+		code[i] = SWAP32(*p);
+	}
+	return 1;
+}
+
+static struct idle_cache_entry {
+	u32 pc, sum;
+	int ok;
+	struct psxIdleLoop loop;
+} idle_cache[32];
+static u32 idle_last_pc;
+
+/*
+ * Called by the interpreter for taken backward branches close to their
+ * target. Analysis results are cached per branch. Only positive results
+ * are validated against the code, a stale negative one costs nothing
+ * but a missed skip.
+ */
+void psxIdleBranch(u32 head, u32 branch_pc, const u32 *gpr)
+{
+	u32 code[IDLE_LOOP_MAX_INSNS], sum = 0;
+	int i, count = (branch_pc - head) / 4 + 2;
+	struct idle_cache_entry *e;
+
+	if (!psxIdleSkipOn())
+		return;
+	// must go around at least twice
+	if (branch_pc != idle_last_pc) {
+		idle_last_pc = branch_pc;
+		return;
+	}
+
+	e = &idle_cache[(branch_pc >> 2) & 31];
+	if (e->pc == branch_pc && !e->ok)
+		return;
+	if (!fetch_loop(code, head, count))
+		return;
+	for (i = 0; i < count; i++)
+		sum = sum * 31 + code[i];
+	if (e->pc != branch_pc || e->sum != sum) {
+		e->pc = branch_pc;
+		e->sum = sum;
+		e->ok = psxIdleAnalyze(&e->loop, code, count);
+		psxIdleStats.loops += e->ok;
+		if (!e->ok)
+			return;
+	}
+	skip_loop(&e->loop, gpr);
+}
+
+/*
+ * For recompilers that only know that execution is somewhere in a loop:
+ * find the branch that closes it and skip if the loop qualifies.
+ */
+void psxIdleLoopAt(u32 pc, const u32 *gpr)
+{
+	u32 code[IDLE_LOOP_MAX_INSNS], reads, write, c, bpc, head;
+	struct psxIdleLoop loop;
+	int i;
+
+	if (!psxIdleSkipOn())
+		return;
+	for (i = 0; i < IDLE_LOOP_MAX_INSNS - 1; i++) {
+		const u32 *p = (const u32 *)PSXM(pc + i * 4);
+		if (p == INVALID_PTR)
+			return;
+		c = SWAP32(*p);
+		if (insn_type(c, &reads, &write) == IT_BRANCH)
+			break;
+	}
+	if (i == IDLE_LOOP_MAX_INSNS - 1)
+		return;
+
+	bpc = pc + i * 4;
+	if ((c >> 26) == 0x02)
+		head = (bpc & 0xf0000000) | ((c & 0x03ffffff) << 2);
+	else
+		head = bpc + 4 + ((s32)(s16)c << 2);
+	if (head > pc || bpc - head > (IDLE_LOOP_MAX_INSNS - 2) * 4)
+		return;
+	if (!fetch_loop(code, head, (bpc - head) / 4 + 2))
+		return;
+	if (!psxIdleAnalyze(&loop, code, (bpc - head) / 4 + 2))
+		return;
+	psxIdleStats.loops++;
+	skip_loop(&loop, gpr);
+}
+
+void psxIdleReset(void)
+{
+	memset(idle_cache, 0, sizeof(idle_cache));
+	idle_last_pc = 0;
+}
+
+void psxIdlePrintStats(void)
+{
+	if (psxIdleStats.skips)
+		SysPrintf("idle loops: %u found, %u skips, %llu cycles skipped\n",
+			psxIdleStats.loops, psxIdleStats.skips,
+			(unsigned long long)psxIdleStats.cycles);
+}
@@ -0,0 +1,33 @@
+#ifndef __PSXIDLE_H__
+#define __PSXIDLE_H__
+
+#include "psxcommon.h"
+
+// longest polling loop considered, including the branch delay slot
+#define IDLE_LOOP_MAX_INSNS 16
+#define IDLE_LOOP_MAX_LOADS 4
+
+struct psxIdleLoop {
+	u8 load_cnt;
+	u8 load_rs[IDLE_LOOP_MAX_LOADS];  // 0 if the address is a constant
+	u32 load_ofs[IDLE_LOOP_MAX_LOADS];
+};
+
+struct psxIdleStats {
+	u32 loops;      // polling loops found
+	u32 skips;      // times the cycle counter was fast-forwarded
+	u64 cycles;     // total cycles skipped
+};
+
+extern struct psxIdleStats psxIdleStats;
+
+int  psxIdleSkipOn(void);
+int  psxIdleAnalyze(struct psxIdleLoop *loop, const u32 *code, int count);
+int  psxIdleAddrsOk(const struct psxIdleLoop *loop, const u32 *gpr);
+int  psxIdleHwPollable(u32 addr);
+void psxIdleBranch(u32 head, u32 branch_pc, const u32 *gpr);
+void psxIdleLoopAt(u32 pc, const u32 *gpr);
+void psxIdleReset(void);
+void psxIdlePrintStats(void);
+
+#endif // __PSXIDLE_H__
@@ -27,6 +27,7 @@
 #include "gte.h"
 #include "psxhle.h"
 #include "psxinterpreter.h"
+#include "psxidle.h"
 #include <stddef.h>
 #include <assert.h>
 #include "../include/compiler_features.h"
@@ -434,8 +435,13 @@ static void doBranch(psxRegisters *regs, u32 tar, enum R3000Abdt taken) {
 	dloadStep(regs);
 	psxBSC[code >> 26](regs, code);
 
-	if (likely(regs->branching != R3000A_BRANCH_NONE_OR_EXCEPTION))
+	if (likely(regs->branching != R3000A_BRANCH_NONE_OR_EXCEPTION)) {
 		regs->pc = pc_final;
+		// short loop back to itself, maybe just polling something?
+		if (taken == R3000A_BRANCH_TAKEN && fetch == fetchNoCache
+		    && pc - 4 - tar <= (IDLE_LOOP_MAX_INSNS - 2) * 4)
+			psxIdleBranch(tar, pc - 4, regs->GPR.r);
+	}
 	else
 		regs->CP0.n.Target = pc_final;
 	regs->branching = 0;
@@ -1243,15 +1249,18 @@ static void intNotify(enum R3000Anote note, void *data) {
 		dloadFlush(&psxRegs);
 		break;
 	case R3000ACPU_NOTIFY_AFTER_LOAD:
+	case R3000ACPU_NOTIFY_AFTER_SNAPSHOT:
 		dloadClear(&psxRegs);
 		psxRegs.subCycle = 0;
 		setupCop(psxRegs.CP0.n.SR);
 		// fallthrough
 	case R3000ACPU_NOTIFY_CACHE_ISOLATED: // Armored Core?
+		psxIdleReset();
 		if (fetch == fetchICache)
 			memset(&ICache, 0xff, sizeof(ICache));
 		break;
 	case R3000ACPU_NOTIFY_CACHE_UNISOLATED:
+	case R3000ACPU_NOTIFY_BEFORE_LOAD:
 		break;
 	}
 }
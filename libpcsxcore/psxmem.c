@@ -42,8 +42,21 @@
 #define MAP_ANONYMOUS MAP_ANON
 #endif
 
-static void * psxMapDefault(unsigned long addr, size_t size,
-			    enum psxMapTag tag, int *can_retry_addr)
+#define HUGE_PAGE_SIZE (2*1024*1024)
+
+int psxMapHugePages;
+
+// in huge page mode large maps are rounded up to whole huge pages
+// so that unmap can use the same length for both hugetlb and regular maps
+static size_t psxMapSize(size_t size)
+{
+	if (psxMapHugePages && size >= HUGE_PAGE_SIZE)
+		size = (size + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1);
+	return size;
+}
+
+void * psxMapDefault(unsigned long addr, size_t size,
+		     enum psxMapTag tag, int *can_retry_addr)
 {
 	void *ptr;
 #if !P_HAVE_MMAP
@@ -54,14 +67,26 @@ static void * psxMapDefault(unsigned long addr, size_t size,
 	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
 
 	*can_retry_addr = 1;
+	size = psxMapSize(size);
+#ifdef MAP_HUGETLB
+	if (psxMapHugePages && size >= HUGE_PAGE_SIZE) {
+		// needs a reserved pool (vm.nr_hugepages), else fall through
+		ptr = mmap((void *)(uintptr_t)addr, size, PROT_READ | PROT_WRITE,
+			   flags | MAP_HUGETLB, -1, 0);
+		if (ptr != MAP_FAILED) {
+			SysPrintf("psxMap: %zx bytes at %p using hugetlb\n", size, ptr);
+			return ptr;
+		}
+	}
+#endif
 	ptr = mmap((void *)(uintptr_t)addr, size,
 		    PROT_READ | PROT_WRITE, flags, -1, 0);
 #ifdef MADV_HUGEPAGE
-	if (size >= 2*1024*1024) {
-		if (ptr != MAP_FAILED && ((uintptr_t)ptr & (2*1024*1024 - 1))) {
+	if (size >= HUGE_PAGE_SIZE) {
+		if (ptr != MAP_FAILED && ((uintptr_t)ptr & (HUGE_PAGE_SIZE - 1))) {
 			// try to manually realign assuming decreasing addr alloc
 			munmap(ptr, size);
-			addr = (uintptr_t)ptr & ~(2*1024*1024 - 1);
+			addr = (uintptr_t)ptr & ~(HUGE_PAGE_SIZE - 1);
 			ptr = mmap((void *)(uintptr_t)addr, size,
 				PROT_READ | PROT_WRITE, flags, -1, 0);
 		}
@@ -73,12 +98,12 @@ static void * psxMapDefault(unsigned long addr, size_t size,
 #endif
 }
 
-static void psxUnmapDefault(void *ptr, size_t size, enum psxMapTag tag)
+void psxUnmapDefault(void *ptr, size_t size, enum psxMapTag tag)
 {
 #if !P_HAVE_MMAP
 	free(ptr);
 #else
-	munmap(ptr, size);
+	munmap(ptr, psxMapSize(size));
 #endif
 }
 
@@ -200,6 +225,9 @@ int psxMemInit(void)
 	unsigned int i;
 	int ret;
 
+	// lightrec's own map already tries hugetlb
+	psxMapHugePages = Config.HugePages && !LIGHTREC_CUSTOM_MAP;
+
 	if (LIGHTREC_CUSTOM_MAP)
 		ret = lightrec_init_mmap();
 	else
@@ -33,6 +33,14 @@ extern void *(*psxMapHook)(unsigned long addr, size_t size,
 	enum psxMapTag tag, int *can_retry_addr);
 extern void (*psxUnmapHook)(void *ptr, size_t size, enum psxMapTag tag);
 
+// latched from Config.HugePages by psxMemInit()
+extern int psxMapHugePages;
+
+// the built-in mmap/munmap implementation, may be used by the hooks
+void *psxMapDefault(unsigned long addr, size_t size,
+	enum psxMapTag tag, int *can_retry_addr);
+void psxUnmapDefault(void *ptr, size_t size, enum psxMapTag tag);
+
 void *psxMap(unsigned long addr, size_t size, int is_fixed,
 		enum psxMapTag tag);
 void psxUnmap(void *ptr, size_t size, enum psxMapTag tag);
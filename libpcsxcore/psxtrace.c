@@ -0,0 +1,144 @@
+/*
+ * Execution trace recorder, see psxtrace.h for the format.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "psxcommon.h"
+#include "psxmem.h"
+#include "psxtrace.h"
+
+int psxTraceOn;
+
+static FILE *trace_f;
+static int trace_flags;
+static u32 trace_regs[PSXTR_REG_COUNT];
+static u8 trace_buf[64 * 1024];
+static u32 trace_pos;
+
+static void trace_flush(void)
+{
+	if (trace_pos && trace_f)
+		fwrite(trace_buf, 1, trace_pos, trace_f);
+	trace_pos = 0;
+}
+
+// make room for a record of up to len bytes
+static u8 *trace_reserve(u32 len)
+{
+	if (trace_pos + len > sizeof(trace_buf))
+		trace_flush();
+	return trace_buf + trace_pos;
+}
+
+static u8 *put32(u8 *p, u32 v)
+{
+	p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+	return p + 4;
+}
+
+static u32 hash_mem(const void *mem, u32 len)
+{
+	u32 l[4] = { 0x811c9dc5, 0x3b9aca07, 0x2545f491, 0x9e3779b9 };
+	const u8 *p = mem;
+	u32 i, k;
+
+	for (i = 0; i + 16 <= len; i += 16)
+		for (k = 0; k < 4; k++)
+			l[k] = (l[k] ^ (p[i+k*4] | (p[i+k*4+1] << 8)
+				| (p[i+k*4+2] << 16) | ((u32)p[i+k*4+3] << 24))) * 0x01000193;
+	for (; i < len; i++)
+		l[0] = (l[0] ^ p[i]) * 0x01000193;
+	return l[0] ^ (l[1] >> 7) ^ (l[2] << 5) ^ (l[3] >> 13);
+}
+
+int psxTraceStart(const char *fname, int flags)
+{
+	struct psxTraceHeader hdr;
+
+	psxTraceStop();
+	trace_f = fopen(fname, "wb");
+	if (trace_f == NULL) {
+		SysPrintf("trace: can't open %s\n", fname);
+		return -1;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, PSXTR_MAGIC, sizeof(hdr.magic));
+	put32((u8 *)&hdr.version, PSXTR_VERSION);
+	put32((u8 *)&hdr.flags, flags);
+#ifdef LIGHTREC
+	strcpy(hdr.core, Config.Cpu == CPU_INTERPRETER ? "interpreter" : "lightrec");
+#else
+	strcpy(hdr.core, Config.Cpu == CPU_INTERPRETER ? "interpreter" : "new_dynarec");
+#endif
+	fwrite(&hdr, 1, sizeof(hdr), trace_f);
+
+	// deltas start from all zeroes, as in the diff tool
+	memset(trace_regs, 0, sizeof(trace_regs));
+	trace_flags = flags;
+	trace_pos = 0;
+	psxTraceOn = 1;
+	SysPrintf("trace: recording %s to %s\n", hdr.core, fname);
+	return 0;
+}
+
+void psxTraceStop(void)
+{
+	if (trace_f == NULL)
+		return;
+	trace_flush();
+	fclose(trace_f);
+	trace_f = NULL;
+	psxTraceOn = 0;
+}
+
+void psxTraceStep(u32 pc, u32 cycle, const u32 *gpr, const u32 *cp0)
+{
+	u32 regs[PSXTR_REG_COUNT];
+	u8 *p = trace_reserve(1 + 4 + 4 + 8 + PSXTR_REG_COUNT * 4);
+	u8 *pmask;
+	u64 mask = 0;
+	int i;
+
+	memcpy(regs, gpr, 34 * 4);
+	regs[PSXTR_REG_SR] = cp0[12];
+	regs[PSXTR_REG_CAUSE] = cp0[13];
+	regs[PSXTR_REG_EPC] = cp0[14];
+
+	*p++ = PSXTR_STEP;
+	p = put32(p, pc);
+	p = put32(p, cycle);
+	pmask = p;
+	p += 8;
+	for (i = 0; i < PSXTR_REG_COUNT; i++) {
+		if (regs[i] == trace_regs[i])
+			continue;
+		trace_regs[i] = regs[i];
+		mask |= (u64)1 << i;
+		p = put32(p, regs[i]);
+	}
+	put32(pmask, mask);
+	put32(pmask + 4, mask >> 32);
+	trace_pos = p - trace_buf;
+}
+
+void psxTraceEvent(u32 pc, u32 cycle, int event)
+{
+	u8 *p = trace_reserve(1 + 4 + 4 + 1 + 4 + 1 + 4 * 3);
+
+	*p++ = PSXTR_EVENT;
+	p = put32(p, pc);
+	p = put32(p, cycle);
+	*p++ = event;
+	p = put32(p, psxHu32(0x1070));
+
+	// costs 2MB of hashing per event, so only when asked for
+	if (trace_flags & PSXTR_F_MEM) {
+		*p++ = PSXTR_MEM;
+		p = put32(p, cycle);
+		p = put32(p, hash_mem(psxM, 0x200000));
+		p = put32(p, hash_mem(psxH, 0x400));
+	}
+	trace_pos = p - trace_buf;
+}
@@ -0,0 +1,62 @@
+#ifndef __PSXTRACE_H__
+#define __PSXTRACE_H__
+
+/*
+ * Binary execution trace, for finding where two cpu cores (or two builds
+ * of one) start to disagree, see tools/psxtrace_diff.c.
+ * All values are little endian. After the header come records, each
+ * starting with a type byte:
+ *
+ * PSXTR_STEP  u32 pc, u32 cycle, u64 mask, u32 value for each mask bit
+ *             set: the registers (PSXTR_REG_*) that changed since the
+ *             previous step of the same trace
+ * PSXTR_EVENT u32 pc, u32 cycle, u8 event (PSXINT_* or PSXTR_EV_IRQ),
+ *             u32 I_STAT
+ * PSXTR_MEM   u32 cycle, u32 ram hash, u32 scratchpad hash, written after
+ *             each event when the trace was started with PSXTR_F_MEM
+ *
+ * Steps are written where a core passes a block boundary: after every
+ * branch by the interpreter, on cycle checks by new_dynarec and on
+ * block exits by lightrec. They are compared where both traces have a
+ * step with the same pc and cycle. Events and memory hashes happen at
+ * the same points in every core and are compared in order.
+ */
+
+#define PSXTR_MAGIC "PSXTRACE"
+#define PSXTR_VERSION 1
+
+#define PSXTR_F_MEM 1
+
+enum {
+	PSXTR_STEP = 1,
+	PSXTR_EVENT,
+	PSXTR_MEM,
+};
+
+#define PSXTR_EV_IRQ 0xff // interrupt exception taken
+
+// register numbering in PSXTR_STEP masks
+#define PSXTR_REG_LO 32
+#define PSXTR_REG_HI 33
+#define PSXTR_REG_SR 34
+#define PSXTR_REG_CAUSE 35
+#define PSXTR_REG_EPC 36
+#define PSXTR_REG_COUNT 37
+
+struct psxTraceHeader {
+	char magic[8];
+	unsigned int version;
+	unsigned int flags;
+	char core[16];
+};
+
+extern int psxTraceOn;
+
+int  psxTraceStart(const char *fname, int flags);
+void psxTraceStop(void);
+// gpr: r0-r31, lo, hi; cp0: the 32 cop0 registers
+void psxTraceStep(unsigned int pc, unsigned int cycle,
+		  const unsigned int *gpr, const unsigned int *cp0);
+void psxTraceEvent(unsigned int pc, unsigned int cycle, int event);
+
+#endif // __PSXTRACE_H__
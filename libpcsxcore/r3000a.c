@@ -28,6 +28,8 @@
 #include "psxinterpreter.h"
 #include "psxbios.h"
 #include "psxevents.h"
+#include "psxidle.h"
+#include "psxtrace.h"
 #include "../include/compiler_features.h"
 #include <assert.h>
 
@@ -82,6 +84,7 @@ void psxReset() {
 	}
 	psxCpu->ApplyConfig();
 	psxCpu->Reset();
+	psxIdleReset();
 
 	psxHwReset();
 	psxBiosInit();
@@ -97,6 +100,8 @@ void psxReset() {
 }
 
 void psxShutdown() {
+	psxTraceStop();
+	psxIdlePrintStats();
 	psxBiosShutdown();
 
 	psxCpu->Shutdown();
@@ -134,6 +139,9 @@ void psxException(u32 cause, enum R3000Abdt bdt, psxCP0Regs *cp0) {
 }
 
 void psxBranchTest() {
+	if (unlikely(psxTraceOn))
+		psxTraceStep(psxRegs.pc, psxRegs.cycle, psxRegs.GPR.r, psxRegs.CP0.r);
+
 	if ((psxRegs.cycle - psxRegs.psxNextsCounter) >= psxRegs.psxNextCounter)
 		psxRcntUpdate();
 
@@ -44,6 +44,8 @@ enum R3000Anote {
 	R3000ACPU_NOTIFY_CACHE_UNISOLATED = 1,
 	R3000ACPU_NOTIFY_BEFORE_SAVE,  // data arg - hle if non-null
 	R3000ACPU_NOTIFY_AFTER_LOAD,
+	R3000ACPU_NOTIFY_BEFORE_LOAD,
+	R3000ACPU_NOTIFY_AFTER_SNAPSHOT, // changed ram already went to Clear()
 };
 
 enum blockExecCaller {
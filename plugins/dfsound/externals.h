@@ -239,6 +239,7 @@ typedef struct
 
  unsigned char * pSpuBuffer;
  short         * pS;
+ unsigned char * pOutBuffer;           // pSpuBuffer after rate control
 
  SPUCHAN       * s_chan;
  REVERBInfo    * rvb;
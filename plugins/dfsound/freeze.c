@@ -332,6 +332,7 @@ long DoFreeze(unsigned int ulFreezeMode, SPUFreeze_t * pF,
  memcpy(spu.spuMem, pF->SPURam, 0x80000);              // get ram
  memcpy(spu.regArea, pF->SPUPorts, 0x200);
  spu.bMemDirty = 1;
+ spu.pS = (short *)spu.pSpuBuffer;                     // unfed output is from before the load
  spu.spuCtrl = regAreaGet(H_SPUctrl);
  spu.spuStat = regAreaGet(H_SPUstat);
 
@@ -7,6 +7,7 @@ struct out_driver {
 	void (*finish)(void);
 	int (*busy)(void);
 	void (*feed)(void *data, int bytes);
+	int (*fill)(void);	// buffer fill in %, -1 if unknown, optional
 };
 
 extern struct out_driver *out_current;
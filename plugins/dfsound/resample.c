@@ -0,0 +1,178 @@
+/***************************************************************************
+ * Windowed sinc resampler for the XA stream and the output rate control.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version. See also the license.txt file for
+ * additional informations.
+ ***************************************************************************/
+
+#include "stdafx.h"
+#include <math.h>
+
+#define _IN_RESAMPLE
+
+// will be included from spu.c
+#ifdef _IN_SPU
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+// a polyphase filter: RS_PHASES sets of RS_TAPS s1.14 coefficients,
+// output frames between two input frames use the nearest phase
+#define RS_TAPS        8
+#define RS_PHASE_BITS  7
+#define RS_PHASES      (1 << RS_PHASE_BITS)
+#define RS_BLOCK       1024            // input frames taken in per pass
+
+struct resampler {
+ unsigned int pos;                     // 16.16, from in[][0]
+ unsigned int step;                    // input frames per output frame, 16.16
+ int count;                            // frames in in[][]
+ short in[2][RS_BLOCK + RS_TAPS];      // planar, so taps are contiguous
+};
+
+static short rs_coefs[RS_PHASES][RS_TAPS];
+static int rs_coefs_done;
+
+static void rs_make_coefs(void)
+{
+ // cutoff a bit below the input nyquist, 8 taps don't give a steep slope
+ const double fc = 0.9;
+ double h[RS_TAPS], sum, x;
+ int p, k, total;
+
+ for (p = 0; p < RS_PHASES; p++)
+ {
+  sum = 0;
+  for (k = 0; k < RS_TAPS; k++)
+  {
+   // tap k is input frame k, the output lies between frames 3 and 4
+   x = k - (RS_TAPS / 2 - 1) - (double)p / RS_PHASES;
+   h[k] = x == 0 ? 1.0 : sin(M_PI * fc * x) / (M_PI * fc * x);
+   // blackman, reaches 0 at +-RS_TAPS/2
+   h[k] *= 0.42 + 0.5 * cos(M_PI * x / (RS_TAPS / 2))
+         + 0.08 * cos(2 * M_PI * x / (RS_TAPS / 2));
+   sum += h[k];
+  }
+  // unity gain at dc in every phase, rounding error goes to the center
+  for (k = total = 0; k < RS_TAPS; k++)
+  {
+   rs_coefs[p][k] = (short)floor(h[k] / sum * 16384.0 + 0.5);
+   total += rs_coefs[p][k];
+  }
+  rs_coefs[p][RS_TAPS / 2 - 1 + (p >= RS_PHASES / 2)] += 16384 - total;
+ }
+ rs_coefs_done = 1;
+}
+
+static void resampler_reset(struct resampler *rs, unsigned int step)
+{
+ if (!rs_coefs_done)
+  rs_make_coefs();
+ memset(rs, 0, sizeof(*rs));
+ // the zeroes that come before the first frame at the center tap
+ rs->count = RS_TAPS / 2 - 1;
+ rs->step = step;
+}
+
+// both channels of one output frame
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+INLINE void rs_dot(const short *c, const short *l, const short *r, int *out)
+{
+ int16x8_t vc = vld1q_s16(c);
+ int32x4_t al = vmull_s16(vget_low_s16(vc), vld1_s16(l));
+ int32x4_t ar = vmull_s16(vget_low_s16(vc), vld1_s16(r));
+ int32x2_t s;
+
+ al = vmlal_s16(al, vget_high_s16(vc), vld1_s16(l + 4));
+ ar = vmlal_s16(ar, vget_high_s16(vc), vld1_s16(r + 4));
+ s = vpadd_s32(vadd_s32(vget_low_s32(al), vget_high_s32(al)),
+               vadd_s32(vget_low_s32(ar), vget_high_s32(ar)));
+ out[0] = vget_lane_s32(s, 0);
+ out[1] = vget_lane_s32(s, 1);
+}
+
+#else
+
+// fixed trip count, the compiler turns this into simd multiply-adds
+INLINE void rs_dot(const short *c, const short *l, const short *r, int *out)
+{
+ int sl = 0, sr = 0, k;
+
+ for (k = 0; k < RS_TAPS; k++)
+ {
+  sl += c[k] * l[k];
+  sr += c[k] * r[k];
+ }
+ out[0] = sl;
+ out[1] = sr;
+}
+
+#endif
+
+// src: interleaved s16 frames of 1 or 2 channels, out: stereo s16.
+// Returns the number of frames written, once max_out is reached the
+// rest of src is dropped.
+static int resampler_run(struct resampler *rs, const short *src, int frames,
+  int channels, short *out, int max_out)
+{
+ int done = 0, idx, n, i;
+ int s[2];
+
+ while (frames > 0 && done < max_out)
+ {
+  n = RS_BLOCK + RS_TAPS - rs->count;
+  if (n > frames)
+   n = frames;
+  for (i = 0; i < n; i++, src += channels)
+  {
+   rs->in[0][rs->count + i] = src[0];
+   rs->in[1][rs->count + i] = src[channels - 1];
+  }
+  rs->count += n;
+  frames -= n;
+
+  if (rs->step == 0x10000 && !(rs->pos & 0xffff))
+  {
+   // whole frames at 1:1, the filter would only color the sound
+   while ((idx = rs->pos >> 16) + RS_TAPS <= rs->count && done < max_out)
+   {
+    out[done * 2 + 0] = rs->in[0][idx + RS_TAPS / 2 - 1];
+    out[done * 2 + 1] = rs->in[1][idx + RS_TAPS / 2 - 1];
+    done++;
+    rs->pos += 0x10000;
+   }
+  }
+  else while ((idx = rs->pos >> 16) + RS_TAPS <= rs->count && done < max_out)
+  {
+   rs_dot(rs_coefs[(rs->pos >> (16 - RS_PHASE_BITS)) & (RS_PHASES - 1)],
+     rs->in[0] + idx, rs->in[1] + idx, s);
+   s[0] >>= 14;
+   s[1] >>= 14;
+   ssat32_to_16(s[0]);
+   ssat32_to_16(s[1]);
+   out[done * 2 + 0] = s[0];
+   out[done * 2 + 1] = s[1];
+   done++;
+   rs->pos += rs->step;
+  }
+
+  // keep what the next output frames still need
+  idx = rs->pos >> 16;
+  if (idx > rs->count)
+   idx = rs->count;
+  rs->count -= idx;
+  rs->pos -= idx << 16;
+  memmove(rs->in[0], rs->in[0] + idx, rs->count * sizeof(rs->in[0][0]));
+  memmove(rs->in[1], rs->in[1] + idx, rs->count * sizeof(rs->in[1][0]));
+ }
+
+ return done;
+}
+
+#endif
+// vim:shiftwidth=1:expandtab
@@ -116,6 +116,17 @@ static int sdl_busy(void) {
 	return 0;
 }
 
+static int sdl_fill(void) {
+	int size;
+
+	if (pSndBuffer == NULL) return -1;
+
+	size = iWritePos - iReadPos;
+	if (size < 0) size += iBufSize;
+
+	return size * 100 / iBufSize;
+}
+
 static void sdl_feed(void *pSound, int lBytes) {
 	short *p = (short *)pSound;
 
@@ -140,4 +151,5 @@ void out_register_sdl(struct out_driver *drv)
 	drv->finish = sdl_finish;
 	drv->busy = sdl_busy;
 	drv->feed = sdl_feed;
+	drv->fill = sdl_fill;
 }
@@ -76,6 +76,7 @@ static int RVB[NSSIZE * 2];
 int ChanBuf[NSSIZE];
 
 #define CDDA_BUFFER_SIZE (16384 * sizeof(uint32_t)) // must be power of 2
+#define OUT_BUFFER_SIZE  (32768 + 256)    // mixing buffer, +0.5% and change
 
 ////////////////////////////////////////////////////////////////////////
 // CODE AREA
@@ -197,6 +198,7 @@ static void InterpolateDown(sample_buf *sb, int sinc)
 ////////////////////////////////////////////////////////////////////////
 
 #include "gauss_i.h"
+#include "resample.c"
 #include "xa.c"
 
 static void do_irq(int cycles_after)
@@ -1342,6 +1344,44 @@ void schedule_next_irq(void)
 
 // rearmed: called dynamically now
 
+static struct resampler out_rs;
+
+// when the driver can tell how full its buffer is, play slightly
+// faster or slower (at most 0.5%, inaudible) to keep it half full.
+// Near half full it's exactly 1:1, where the resampler passes the
+// samples through unfiltered.
+static void feed_output(void)
+{
+ int bytes = (unsigned char *)spu.pS - spu.pSpuBuffer;
+ int fill = -1, target, n, d;
+
+ if (spu_config.iRateControl && out_current->fill)
+  fill = out_current->fill();
+ if (fill < 0) {
+  out_current->feed(spu.pSpuBuffer, bytes);
+  return;
+ }
+
+ if (fill > 100)
+  fill = 100;
+ target = 0x10000;
+ if (fill < 40 || fill > 60)
+  target += (fill - 50) * 328 / 50;
+ d = target - (int)out_rs.step;
+ if (-8 < d && d < 8) {
+  if (target == 0x10000 && out_rs.step != 0x10000)
+   // back on whole frames, a jump of at most half a frame
+   out_rs.pos = (out_rs.pos + 0x8000) & ~0xffff;
+  out_rs.step = target;
+ }
+ else
+  out_rs.step += d / 8;
+
+ n = resampler_run(&out_rs, (short *)spu.pSpuBuffer, bytes / 4, 2,
+   (short *)spu.pOutBuffer, OUT_BUFFER_SIZE / 4);
+ out_current->feed(spu.pOutBuffer, n * 4);
+}
+
 void CALLBACK SPUasync(unsigned int cycle, unsigned int flags)
 {
  do_samples(cycle, 0);
@@ -1350,7 +1390,7 @@ void CALLBACK SPUasync(unsigned int cycle, unsigned int flags)
   schedule_next_irq();
 
  if (flags & 1) {
-  out_current->feed(spu.pSpuBuffer, (unsigned char *)spu.pS - spu.pSpuBuffer);
+  feed_output();
   spu.pS = (short *)spu.pSpuBuffer;
 
   if (spu_config.iTempo) {
@@ -1382,8 +1422,10 @@ void CALLBACK SPUplayADPCMchannel(xa_decode_t *xap, unsigned int cycle, int is_s
  if(!xap)       return;
  if(!xap->freq) return;                // no xa freq ? bye
 
- if (is_start)
+ if (is_start) {
   spu.XAPlay = spu.XAFeed = spu.XAStart;
+  resampler_reset(&xa_rs, 0);
+ }
  if (spu.XAPlay == spu.XAFeed)
   do_samples(cycle, 1);                // catch up to prevent source underflows later
 
@@ -1429,6 +1471,9 @@ static void SetupStreams(void)
 { 
  spu.pSpuBuffer = (unsigned char *)malloc(32768);      // alloc mixing buffer
  spu.SSumLR = calloc(NSSIZE * 2, sizeof(spu.SSumLR[0]));
+ spu.pOutBuffer = malloc(OUT_BUFFER_SIZE);             // after rate control
+ resampler_reset(&out_rs, 0x10000);
+ resampler_reset(&xa_rs, 0);
 
  spu.XAStart = malloc(44100 * sizeof(uint32_t));       // alloc xa buffer
  spu.XAEnd   = spu.XAStart + 44100;
@@ -1450,6 +1495,8 @@ static void RemoveStreams(void)
  spu.pSpuBuffer = NULL;
  free(spu.SSumLR);
  spu.SSumLR = NULL;
+ free(spu.pOutBuffer);
+ spu.pOutBuffer = NULL;
  free(spu.XAStart);                                    // free XA buffer
  spu.XAStart = NULL;
  free(spu.CDDAStart);                                  // free CDDA buffer
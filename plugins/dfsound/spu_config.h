@@ -10,6 +10,7 @@ typedef struct
  int        iUseReverb;
  int        iUseInterpolation;
  int        iTempo;
+ int        iRateControl;
  int        iUseThread;
 
  // status
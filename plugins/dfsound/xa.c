@@ -28,13 +28,7 @@
 // XA GLOBALS
 ////////////////////////////////////////////////////////////////////////
 
-static int gauss_ptr = 0;
-static int gauss_window[8] = {0, 0, 0, 0, 0, 0, 0, 0};
-
-#define gvall0 gauss_window[gauss_ptr]
-#define gvall(x) gauss_window[(gauss_ptr+x)&3]
-#define gvalr0 gauss_window[4+gauss_ptr]
-#define gvalr(x) gauss_window[4+((gauss_ptr+x)&3)]
+static struct resampler xa_rs;          // XA rate to 44100
 
 ////////////////////////////////////////////////////////////////////////
 // MIX XA & CDDA
@@ -165,42 +159,21 @@ INLINE void MixCD(int *SSumLR, int *RVB, int ns_to, int decode_pos)
  }
 }
 
-////////////////////////////////////////////////////////////////////////
-// small linux time helper... only used for watchdog
-////////////////////////////////////////////////////////////////////////
-
-#if 0
-static unsigned long timeGetTime_spu()
-{
-#if defined(NO_OS)
- return 0;
-#elif defined(_WIN32)
- return GetTickCount();
-#else
- struct timeval tv;
- gettimeofday(&tv, 0);                                 // well, maybe there are better ways
- return tv.tv_sec * 1000 + tv.tv_usec/1000;            // to do that, but at least it works
-#endif
-}
-#endif
-
 ////////////////////////////////////////////////////////////////////////
 // FEED XA 
 ////////////////////////////////////////////////////////////////////////
 
 void FeedXA(const xa_decode_t *xap)
 {
- int sinc,spos,i,iSize,iPlace,vl,vr;
+ static uint32_t buf[44100 * 4032 / 18900 + 16];    // a sector at 18900Hz mono
+ int sinc,spos,i,iSize,iPlace;
+ uint32_t l;
 
  if(!spu.bSPUIsOpen) return;
 
  spu.XARepeat  = 3;                                    // set up repeat
 
-#if 0//def XA_HACK
- iSize=((45500*xap->nsamples)/xap->freq);              // get size
-#else
  iSize=((44100*xap->nsamples)/xap->freq);              // get size
-#endif
  if(!iSize) return;                                    // none? bye
 
  if(spu.XAFeed<spu.XAPlay) iPlace=spu.XAPlay-spu.XAFeed; // how much space in my buf?
@@ -208,257 +181,80 @@ void FeedXA(const xa_decode_t *xap)
 
  if(iPlace==0) return;                                 // no place at all
 
- //----------------------------------------------------//
-#if 0
- if(spu_config.iXAPitch)                               // pitch change option?
+ if(spu_config.iUseInterpolation)
   {
-   static DWORD dwLT=0;
-   static DWORD dwFPS=0;
-   static int   iFPSCnt=0;
-   static int   iLastSize=0;
-   static DWORD dwL1=0;
-   DWORD dw=timeGetTime_spu(),dw1,dw2;
-
-   iPlace=iSize;
-
-   dwFPS+=dw-dwLT;iFPSCnt++;
-
-   dwLT=dw;
-                                       
-   if(iFPSCnt>=10)
+   // the filter keeps its phase across sectors, so the size may be +-1
+   xa_rs.step = ((unsigned int)xap->freq << 16) / 44100;
+   if(iSize >= (int)(sizeof(buf) / sizeof(buf[0])))
+    iSize = sizeof(buf) / sizeof(buf[0]) - 1;
+   iSize = resampler_run(&xa_rs, xap->pcm, xap->nsamples,
+     xap->stereo ? 2 : 1, (short *)buf, iSize + 1);
+   for(i=0;i<iSize;i++)
     {
-     if(!dwFPS) dwFPS=1;
-     dw1=1000000/dwFPS; 
-     if(dw1>=(dwL1-100) && dw1<=(dwL1+100)) dw1=dwL1;
-     else dwL1=dw1;
-     dw2=(xap->freq*100/xap->nsamples);
-     if((!dw1)||((dw2+100)>=dw1)) iLastSize=0;
-     else
+     *spu.XAFeed++=buf[i];
+
+     if(spu.XAFeed==spu.XAEnd) spu.XAFeed=spu.XAStart;
+     if(spu.XAFeed==spu.XAPlay)
       {
-       iLastSize=iSize*dw2/dw1;
-       if(iLastSize>iPlace) iLastSize=iPlace;
-       iSize=iLastSize;
+       if(spu.XAPlay!=spu.XAStart) spu.XAFeed=spu.XAPlay-1;
+       break;
       }
-     iFPSCnt=0;dwFPS=0;
-    }
-   else
-    {
-     if(iLastSize) iSize=iLastSize;
     }
+   return;
   }
-#endif
- //----------------------------------------------------//
 
  spos=0x10000L;
  sinc = (xap->nsamples << 16) / iSize;                 // calc freq by num / size
 
  if(xap->stereo)
-{
+  {
    uint32_t * pS=(uint32_t *)xap->pcm;
-   uint32_t l=0;
+   l=0;
 
-#if 0
-   if(spu_config.iXAPitch)
+   for(i=0;i<iSize;i++)
     {
-     int32_t l1,l2;short s;
-     for(i=0;i<iSize;i++)
+     while(spos>=0x10000L)
       {
-       if(spu_config.iUseInterpolation==2)
-        {
-         while(spos>=0x10000L)
-          {
-           l = *pS++;
-           gauss_window[gauss_ptr] = (short)LOWORD(l);
-           gauss_window[4+gauss_ptr] = (short)HIWORD(l);
-           gauss_ptr = (gauss_ptr+1) & 3;
-           spos -= 0x10000L;
-          }
-         vl = (spos >> 6) & ~3;
-         vr=(gauss[vl]*gvall0) >> 15;
-         vr+=(gauss[vl+1]*gvall(1)) >> 15;
-         vr+=(gauss[vl+2]*gvall(2)) >> 15;
-         vr+=(gauss[vl+3]*gvall(3)) >> 15;
-         l= vr & 0xffff;
-         vr=(gauss[vl]*gvalr0) >> 15;
-         vr+=(gauss[vl+1]*gvalr(1)) >> 15;
-         vr+=(gauss[vl+2]*gvalr(2)) >> 15;
-         vr+=(gauss[vl+3]*gvalr(3)) >> 15;
-         l |= vr << 16;
-        }
-       else
-        {
-         while(spos>=0x10000L)
-          {
-           l = *pS++;
-           spos -= 0x10000L;
-          }
-        }
-
-       s=(short)LOWORD(l);
-       l1=s;
-       l1=(l1*iPlace)/iSize;
-       ssat32_to_16(l1);
-       s=(short)HIWORD(l);
-       l2=s;
-       l2=(l2*iPlace)/iSize;
-       ssat32_to_16(l2);
-       l=(l1&0xffff)|(l2<<16);
-
-       *spu.XAFeed++=l;
-
-       if(spu.XAFeed==spu.XAEnd) spu.XAFeed=spu.XAStart;
-       if(spu.XAFeed==spu.XAPlay)
-        {
-         if(spu.XAPlay!=spu.XAStart) spu.XAFeed=spu.XAPlay-1;
-         break;
-        }
-
-       spos += sinc;
+       l = *pS++;
+       spos -= 0x10000L;
       }
-    }
-   else
-#endif
-    {
-     for(i=0;i<iSize;i++)
+
+     *spu.XAFeed++=l;
+
+     if(spu.XAFeed==spu.XAEnd) spu.XAFeed=spu.XAStart;
+     if(spu.XAFeed==spu.XAPlay)
       {
-       if(spu_config.iUseInterpolation==2)
-        {
-         while(spos>=0x10000L)
-          {
-           l = *pS++;
-           gauss_window[gauss_ptr] = (short)LOWORD(l);
-           gauss_window[4+gauss_ptr] = (short)HIWORD(l);
-           gauss_ptr = (gauss_ptr+1) & 3;
-           spos -= 0x10000L;
-          }
-         vl = (spos >> 6) & ~3;
-         vr=(gauss[vl]*gvall0) >> 15;
-         vr+=(gauss[vl+1]*gvall(1)) >> 15;
-         vr+=(gauss[vl+2]*gvall(2)) >> 15;
-         vr+=(gauss[vl+3]*gvall(3)) >> 15;
-         l= vr & 0xffff;
-         vr=(gauss[vl]*gvalr0) >> 15;
-         vr+=(gauss[vl+1]*gvalr(1)) >> 15;
-         vr+=(gauss[vl+2]*gvalr(2)) >> 15;
-         vr+=(gauss[vl+3]*gvalr(3)) >> 15;
-         l |= vr << 16;
-        }
-       else
-        {
-         while(spos>=0x10000L)
-          {
-           l = *pS++;
-           spos -= 0x10000L;
-          }
-        }
-
-       *spu.XAFeed++=l;
-
-       if(spu.XAFeed==spu.XAEnd) spu.XAFeed=spu.XAStart;
-       if(spu.XAFeed==spu.XAPlay)
-        {
-         if(spu.XAPlay!=spu.XAStart) spu.XAFeed=spu.XAPlay-1;
-         break;
-        }
-
-       spos += sinc;
+       if(spu.XAPlay!=spu.XAStart) spu.XAFeed=spu.XAPlay-1;
+       break;
       }
+
+     spos += sinc;
     }
   }
  else
   {
    unsigned short * pS=(unsigned short *)xap->pcm;
-   uint32_t l;short s=0;
+   short s=0;
 
-#if 0
-   if(spu_config.iXAPitch)
+   for(i=0;i<iSize;i++)
     {
-     int32_t l1;
-     for(i=0;i<iSize;i++)
+     while(spos>=0x10000L)
       {
-       if(spu_config.iUseInterpolation==2)
-        {
-         while(spos>=0x10000L)
-          {
-           gauss_window[gauss_ptr] = (short)*pS++;
-           gauss_ptr = (gauss_ptr+1) & 3;
-           spos -= 0x10000L;
-          }
-         vl = (spos >> 6) & ~3;
-         vr=(gauss[vl]*gvall0) >> 15;
-         vr+=(gauss[vl+1]*gvall(1)) >> 15;
-         vr+=(gauss[vl+2]*gvall(2)) >> 15;
-         vr+=(gauss[vl+3]*gvall(3)) >> 15;
-         l1=s= vr;
-         l1 &= 0xffff;
-        }
-       else
-        {
-         while(spos>=0x10000L)
-          {
-           s = *pS++;
-           spos -= 0x10000L;
-          }
-         l1=s;
-        }
-
-       l1=(l1*iPlace)/iSize;
-       ssat32_to_16(l1);
-       l=(l1&0xffff)|(l1<<16);
-       *spu.XAFeed++=l;
-
-       if(spu.XAFeed==spu.XAEnd) spu.XAFeed=spu.XAStart;
-       if(spu.XAFeed==spu.XAPlay)
-        {
-         if(spu.XAPlay!=spu.XAStart) spu.XAFeed=spu.XAPlay-1;
-         break;
-        }
-
-       spos += sinc;
+       s = *pS++;
+       spos -= 0x10000L;
       }
-    }
-   else
-#endif
-    {
-     for(i=0;i<iSize;i++)
+
+     l = s & 0xffff;
+     *spu.XAFeed++=(l|(l<<16));
+
+     if(spu.XAFeed==spu.XAEnd) spu.XAFeed=spu.XAStart;
+     if(spu.XAFeed==spu.XAPlay)
       {
-       if(spu_config.iUseInterpolation==2)
-        {
-         while(spos>=0x10000L)
-          {
-           gauss_window[gauss_ptr] = (short)*pS++;
-           gauss_ptr = (gauss_ptr+1) & 3;
-           spos -= 0x10000L;
-          }
-         vl = (spos >> 6) & ~3;
-         vr=(gauss[vl]*gvall0) >> 15;
-         vr+=(gauss[vl+1]*gvall(1)) >> 15;
-         vr+=(gauss[vl+2]*gvall(2)) >> 15;
-         vr+=(gauss[vl+3]*gvall(3)) >> 15;
-         l=s= vr;
-        }
-       else
-        {
-         while(spos>=0x10000L)
-          {
-           s = *pS++;
-           spos -= 0x10000L;
-          }
-         l=s;
-        }
-
-       l &= 0xffff;
-       *spu.XAFeed++=(l|(l<<16));
-
-       if(spu.XAFeed==spu.XAEnd) spu.XAFeed=spu.XAStart;
-       if(spu.XAFeed==spu.XAPlay)
-        {
-         if(spu.XAPlay!=spu.XAStart) spu.XAFeed=spu.XAPlay-1;
-         break;
-        }
-
-       spos += sinc;
+       if(spu.XAPlay!=spu.XAStart) spu.XAFeed=spu.XAPlay-1;
+       break;
       }
+
+     spos += sinc;
     }
   }
 }
@@ -16,6 +16,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "../gpulib/gpu.h"
+#include "../gpulib/gpu_worker.h"
 #include "../../include/arm_features.h"
 
 #if defined(__GNUC__) && (__GNUC__ >= 6 || (defined(__clang_major__) && __clang_major__ >= 10))
@@ -263,6 +264,8 @@ long           lLowerpart;
 
 /////////////////////////////////////////////////////////////////////////////
 
+#ifndef GPU_PEOPS_WORKER
+
 static void set_vram(void *vram)
 {
  psxVub=vram;
@@ -293,16 +296,272 @@ int renderer_init(void)
 
 void renderer_finish(void)
 {
+#ifdef GPU_PEOPS_THREADS
+ gpu_worker_stop();
+#endif
 }
 
 void renderer_notify_screen_change(const struct psx_gpu_screen *screen)
 {
 }
 
+#endif // !GPU_PEOPS_WORKER
+
 #include "../gpulib/gpu_timing.h"
 extern const unsigned char cmd_lengths[256];
 
-int renderer_do_cmd_list(uint32_t *list, int list_len, uint32_t *ex_regs,
+#ifdef GPU_PEOPS_THREADS
+/*
+ * Threaded mode: a long enough list is run by two threads at once, one
+ * drawing the lines above a split line and the other the ones below, by
+ * clipping the drawing area to their band. The renderer state is global,
+ * so the second thread runs a copy of this file (gpulib_if_worker.c) with
+ * globals of its own, which get a copy of the main ones before each list.
+ * Both threads go through all the commands, so their state stays the same;
+ * they only need to wait for each other when one could read (as a texture)
+ * or overwrite what the other has drawn in this list. Lines, y-mirrored
+ * sprites and prims texturing from their own drawing area would come out
+ * different if clipped at the split, so those are drawn by thread 0 alone.
+ */
+
+static struct {
+  int on, part;
+  int serial;              // thread 0 draws everything
+  int area_y0, area_y1;    // drawY, drawH as set by the game
+  int split;               // first line of thread 1's band
+  int syncs;
+  struct gpu_rect wr, rd; // vram drawn / read as textures since the last sync
+} band;
+
+// sync counts of both threads
+extern int peops_band_syncs[2];
+
+// renderer state that lasts from one command to the next
+#define BAND_STATE(X) \
+  X(GlobalTextAddrX) X(GlobalTextAddrY) X(GlobalTextTP) X(GlobalTextABR) \
+  X(GlobalTextPAGE) X(lLowerpart) X(bUsingTWin) X(TWin) X(usMirror) \
+  X(iDither) X(iUseDither) X(dwActFixes) X(drawX) X(drawY) X(drawW) \
+  X(drawH) X(bCheckMask) X(sSetMask) X(lSetMask) X(PSXDisplay) \
+  X(lGPUstatusRet) X(lGPUInfoVals) X(psxVub) X(psxVuw) X(psxVuw_eom)
+
+#define BAND_STATE_SIZE_(v) + sizeof(v)
+enum { BAND_STATE_SIZE = 0 BAND_STATE(BAND_STATE_SIZE_) };
+
+#ifndef GPU_PEOPS_WORKER
+static void band_state_save(unsigned char *p)
+{
+#define BAND_STATE_SAVE(v) memcpy(p, &v, sizeof(v)); p += sizeof(v);
+  BAND_STATE(BAND_STATE_SAVE)
+}
+#else
+static void band_state_load(const unsigned char *p)
+{
+#define BAND_STATE_LOAD(v) memcpy(&v, p, sizeof(v)); p += sizeof(v);
+  BAND_STATE(BAND_STATE_LOAD)
+}
+#endif
+
+static void tex_rects(struct gpu_rect *tex, struct gpu_rect *clut,
+ uint32_t tpage, uint32_t cbp)
+{
+  int tp = (tpage >> 7) & 3;
+
+  tex->x0 = (tpage << 6) & 0x3c0;
+  tex->y0 = (tpage << 4) & 0x100;
+  tex->x1 = tex->x0 + (64 << (tp < 2 ? tp : 2));
+  tex->y1 = tex->y0 + 256;
+  gpu_rect_wrap(tex);
+
+  memset(clut, 0, sizeof(*clut));
+  if (tp < 2) {
+    clut->x0 = (cbp << 4) & 0x3f0;
+    clut->y0 = (cbp >> 6) & 0x1ff;
+    clut->x1 = clut->x0 + (tp ? 256 : 16);
+    clut->y1 = clut->y0 + 1;
+    gpu_rect_wrap(clut);
+  }
+}
+
+static void band_clip(void)
+{
+  drawY = band.area_y0;
+  drawH = band.area_y1;
+  if (band.serial)
+    return;
+  if (band.part == 0) {
+    if (drawH > band.split - 1)
+      drawH = band.split - 1;
+  }
+  else if (drawY < band.split)
+    drawY = band.split;
+}
+
+// does this thread have any lines of the drawing area
+static int band_mine(void)
+{
+  if (band.serial)
+    return band.part == 0;
+  return band.part == 0 || band.split <= band.area_y1;
+}
+
+static void band_sync(void)
+{
+  int n = ++band.syncs;
+  __atomic_store_n(&peops_band_syncs[band.part], n, __ATOMIC_RELEASE);
+  while (__atomic_load_n(&peops_band_syncs[band.part ^ 1], __ATOMIC_ACQUIRE) < n)
+    CPU_RELAX();
+  memset(&band.wr, 0, sizeof(band.wr));
+  memset(&band.rd, 0, sizeof(band.rd));
+}
+
+static void band_set_serial(int serial)
+{
+  if (band.serial == serial)
+    return;
+  band_sync();
+  band.serial = serial;
+  band_clip();
+}
+
+// split the drawing area in the middle, unless it's too small
+static void band_set_split(int can_sync)
+{
+  int y0 = band.area_y0, y1 = band.area_y1;
+  int split = y1 - y0 >= 3 ? (y0 + y1 + 1) / 2 : 1024;
+
+  if (split != band.split && can_sync && band.wr.x0 < band.wr.x1)
+    band_sync(); // lines drawn so far change hands
+  band.split = split;
+  band_clip();
+}
+
+static void band_begin(int part)
+{
+  memset(&band, 0, sizeof(band));
+  band.on = 1;
+  band.part = part;
+  band.area_y0 = drawY;
+  band.area_y1 = drawH;
+  band_set_split(0);
+}
+
+static void band_end(void)
+{
+  drawY = band.area_y0;
+  drawH = band.area_y1;
+  band.on = 0;
+}
+
+// block fills ignore the drawing area, each thread does its lines
+static void band_fill(uint32_t *list)
+{
+  short *slist = (short *)list;
+  int y = GETLEs16(&slist[3]), h = GETLEs16(&slist[5]) & 0x3ff;
+  uint32_t part[3];
+
+  if (h >= 1023) h = 1024;
+  h += y;
+  if (y < 0) y = 0;
+  if (h > 512) h = 512;
+  if (band.part == 0) {
+    if (h > band.split) h = band.split;
+  }
+  else if (y < band.split)
+    y = band.split;
+  if (y >= h)
+    return;
+
+  part[0] = list[0];
+  part[1] = HOST2LE32((GETLE32(&list[1]) & 0xffff) | (y << 16));
+  part[2] = HOST2LE32((GETLE32(&list[2]) & 0xffff) | ((h - y) << 16));
+  primTableJ[0x02]((void *)part);
+}
+
+// what a prim drawn by the other thread still has to do here
+static void band_skip(unsigned int cmd, uint32_t *list)
+{
+  if ((cmd & 0xe4) == 0x24) {
+    lLowerpart = GETLE32(&list[(cmd & 0x10) ? 5 : 4]) >> 16;
+    UpdateGlobalTP((unsigned short)lLowerpart);
+  }
+}
+
+static void band_cmd(unsigned int cmd, uint32_t *list)
+{
+  struct gpu_rect dst, tex, clut;
+  int textured = 0;
+
+  switch (cmd) {
+    case 0x02: {
+      short *slist = (short *)list;
+      band_set_serial(0);
+      dst.x0 = 0; dst.x1 = 1024;
+      dst.y0 = GETLEs16(&slist[3]);
+      dst.y1 = dst.y0 + (GETLEs16(&slist[5]) & 0x3ff) + 1;
+      if (gpu_rect_hit(&dst, &band.rd))
+        band_sync();
+      gpu_rect_add(&band.wr, &dst);
+      band_fill(list);
+      return;
+    }
+    case 0x20 ... 0x3f:
+      textured = cmd & 4;
+      if (textured)
+        tex_rects(&tex, &clut, GETLE32(&list[(cmd & 0x10) ? 5 : 4]) >> 16,
+          GETLE32(&list[2]) >> 16);
+      break;
+    case 0x40 ... 0x5f:
+      band_set_serial(1);
+      if (band.part == 0)
+        primTableJ[cmd]((void *)list);
+      return;
+    case 0x60 ... 0x7f:
+      textured = cmd & 4;
+      if (textured)
+        tex_rects(&tex, &clut, (GlobalTextAddrX >> 6) | (GlobalTextAddrY >> 4)
+          | (GlobalTextTP << 7), GETLE32(&list[2]) >> 16);
+      break;
+    case 0xe3:
+    case 0xe4:
+      drawY = band.area_y0;
+      drawH = band.area_y1;
+      primTableJ[cmd]((void *)list);
+      band.area_y0 = drawY;
+      band.area_y1 = drawH;
+      band_set_split(1);
+      return;
+    default:
+      primTableJ[cmd]((void *)list);
+      return;
+  }
+
+  dst.x0 = drawX; dst.x1 = drawW + 1;
+  dst.y0 = band.area_y0; dst.y1 = band.area_y1 + 1;
+
+  if (textured && (gpu_rect_hit(&tex, &dst) || gpu_rect_hit(&clut, &dst)
+      || (cmd >= 0x60 && (usMirror & 0x2000))))
+    band_set_serial(1);
+  else {
+    band_set_serial(0);
+    if (textured && (gpu_rect_hit(&tex, &band.wr) || gpu_rect_hit(&clut, &band.wr)))
+      band_sync();
+    else if (gpu_rect_hit(&dst, &band.rd))
+      band_sync();
+    gpu_rect_add(&band.wr, &dst);
+    if (textured) {
+      gpu_rect_add(&band.rd, &tex);
+      gpu_rect_add(&band.rd, &clut);
+    }
+  }
+
+  if (band_mine())
+    primTableJ[cmd]((void *)list);
+  else
+    band_skip(cmd, list);
+}
+#endif // GPU_PEOPS_THREADS
+
+static int do_cmd_list(uint32_t *list, int list_len, uint32_t *ex_regs,
  int *cycles_sum_out, int *cycles_last, int *last_cmd)
 {
   int cpu_cycles_sum = 0, cpu_cycles = *cycles_last;
@@ -327,6 +586,11 @@ int renderer_do_cmd_list(uint32_t *list, int list_len, uint32_t *ex_regs,
       ex_regs[cmd & 7] = GETLE32(list);
 #endif
 
+#ifdef GPU_PEOPS_THREADS
+    if (band.on)
+      band_cmd(cmd, list);
+    else
+#endif
     primTableJ[cmd]((void *)list);
 
     switch(cmd)
@@ -434,6 +698,59 @@ breakloop:
   return list - list_start;
 }
 
+#ifndef GPU_PEOPS_WORKER
+
+#ifdef GPU_PEOPS_THREADS
+// not worth waking the worker for less
+#define BAND_MIN_WORDS 64
+
+void peops_worker_load_state(const void *buf);
+int peops_worker_do_cmd_list(uint32_t *list, int list_len);
+
+int peops_band_syncs[2];
+
+static uint32_t *band_list;
+static int band_list_len;
+
+static void band_worker_func(void)
+{
+  peops_worker_do_cmd_list(band_list, band_list_len);
+}
+
+static int band_do_cmd_list(uint32_t *list, int list_len, uint32_t *ex_regs,
+ int *cycles_sum_out, int *cycles_last, int *last_cmd)
+{
+  unsigned char state[BAND_STATE_SIZE];
+  int ret;
+
+  band_state_save(state);
+  peops_worker_load_state(state);
+  peops_band_syncs[0] = peops_band_syncs[1] = 0;
+  band_list = list;
+  band_list_len = list_len;
+  gpu_worker_kick();
+
+  band_begin(0);
+  ret = do_cmd_list(list, list_len, ex_regs, cycles_sum_out, cycles_last, last_cmd);
+  band_end();
+
+  gpu_worker_wait();
+  return ret;
+}
+#endif // GPU_PEOPS_THREADS
+
+int renderer_do_cmd_list(uint32_t *list, int list_len, uint32_t *ex_regs,
+ int *cycles_sum_out, int *cycles_last, int *last_cmd)
+{
+#ifdef GPU_PEOPS_THREADS
+  if (gpu_worker_running() && list_len >= BAND_MIN_WORDS)
+    return band_do_cmd_list(list, list_len, ex_regs,
+             cycles_sum_out, cycles_last, last_cmd);
+#endif
+  return do_cmd_list(list, list_len, ex_regs,
+           cycles_sum_out, cycles_last, last_cmd);
+}
+
 void renderer_sync_ecmds(uint32_t *ecmds_)
 {
 #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
@@ -473,6 +790,14 @@ void renderer_set_config(const struct rearmed_cbs *cbs)
  if (cbs->pl_set_gpu_caps)
   cbs->pl_set_gpu_caps(0);
  set_vram(gpu.vram);
+#ifdef GPU_PEOPS_THREADS
+ if (cbs->gpu_peops.threaded)
+  gpu_worker_start(band_worker_func);
+ else
+  gpu_worker_stop();
+#endif
 }
 
+#endif // !GPU_PEOPS_WORKER
+
 // vim:ts=2:shiftwidth=2:expandtab
@@ -0,0 +1,82 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version. See also the license.txt file for *
+ *   additional informations.                                              *
+ *                                                                         *
+ ***************************************************************************/
+
+// The renderer again, with globals of its own, for the second thread
+// of the threaded mode. See gpulib_if.c.
+
+#define GPU_PEOPS_WORKER
+
+#define DataReadMode    peops_worker_DataReadMode
+#define DataWriteMode   peops_worker_DataWriteMode
+#define DrawSemiTrans   peops_worker_DrawSemiTrans
+#define GlobalTextABR   peops_worker_GlobalTextABR
+#define GlobalTextAddrX peops_worker_GlobalTextAddrX
+#define GlobalTextAddrY peops_worker_GlobalTextAddrY
+#define GlobalTextPAGE  peops_worker_GlobalTextPAGE
+#define GlobalTextTP    peops_worker_GlobalTextTP
+#define PSXDisplay      peops_worker_PSXDisplay
+#define TWin            peops_worker_TWin
+#define VRAMRead        peops_worker_VRAMRead
+#define VRAMWrite       peops_worker_VRAMWrite
+#define Ymax            peops_worker_Ymax
+#define Ymin            peops_worker_Ymin
+#define bCheckMask      peops_worker_bCheckMask
+#define bDoVSyncUpdate  peops_worker_bDoVSyncUpdate
+#define bUsingTWin      peops_worker_bUsingTWin
+#define dithertable     peops_worker_dithertable
+#define drawH           peops_worker_drawH
+#define drawW           peops_worker_drawW
+#define drawX           peops_worker_drawX
+#define drawY           peops_worker_drawY
+#define dwActFixes      peops_worker_dwActFixes
+#define dwCfgFixes      peops_worker_dwCfgFixes
+#define g_m1            peops_worker_g_m1
+#define g_m2            peops_worker_g_m2
+#define g_m3            peops_worker_g_m3
+#define iDither         peops_worker_iDither
+#define iUseDither      peops_worker_iUseDither
+#define iUseFixes       peops_worker_iUseFixes
+#define lGPUInfoVals    peops_worker_lGPUInfoVals
+#define lGPUstatusRet   peops_worker_lGPUstatusRet
+#define lLowerpart      peops_worker_lLowerpart
+#define lSetMask        peops_worker_lSetMask
+#define lx0             peops_worker_lx0
+#define lx1             peops_worker_lx1
+#define lx2             peops_worker_lx2
+#define lx3             peops_worker_lx3
+#define ly0             peops_worker_ly0
+#define ly1             peops_worker_ly1
+#define ly2             peops_worker_ly2
+#define ly3             peops_worker_ly3
+#define primTableJ      peops_worker_primTableJ
+#define primTableSkip   peops_worker_primTableSkip
+#define psxVub          peops_worker_psxVub
+#define psxVuw          peops_worker_psxVuw
+#define psxVuw_eom      peops_worker_psxVuw_eom
+#define sSetMask        peops_worker_sSetMask
+#define usMirror        peops_worker_usMirror
+
+#include "gpulib_if.c"
+
+void peops_worker_load_state(const void *buf)
+{
+  band_state_load(buf);
+}
+
+int peops_worker_do_cmd_list(uint32_t *list, int list_len)
+{
+  uint32_t ex_regs[8] = { 0 };
+  int dummy = 0, ret;
+
+  band_begin(1);
+  ret = do_cmd_list(list, list_len, ex_regs, &dummy, &dummy, &dummy);
+  band_end();
+  return ret;
+}
@@ -0,0 +1,328 @@
+/***************************************************************************
+                          gpuTexCache.c  -  description
+                             -------------------
+    PCSX rearmed texture hashing/conversion helpers
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version. See also the license.txt file for *
+ *   additional informations.                                              *
+ *                                                                         *
+ ***************************************************************************/
+
+////////////////////////////////////////////////////////////////////////
+// The sub texture cache keeps a hash of the vram (and clut) each cached
+// part was made from, so that a part hit by a vram write can be reused
+// if the data didn't actually change. The hash runs 4 independent
+// lanes, done with gcc vector extensions where available (like
+// frontend/cspace.c), so it's simd on arm and x86 at any -O level.
+// The 15 bit colour conversion is done the same way, 4 texels at a
+// time. The 4bpp palette lookup uses the byte table lookup of neon
+// (vtbl/tbl) or ssse3 (pshufb) as the 16 entry palette fits in one
+// vector per colour byte; 8bpp textures (256 entries) stay scalar.
+////////////////////////////////////////////////////////////////////////
+
+#include "gpuTexCache.h"
+
+#if !defined(TEXCACHE_NO_SIMD) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define TEXPAL_NEON
+#elif !defined(TEXCACHE_NO_SIMD) && defined(__SSSE3__)
+#include <tmmintrin.h>
+#define TEXPAL_SSSE3
+#endif
+
+extern unsigned char ubOpaqueDraw;
+
+#define HASH_PRIME 0x01000193
+
+#if !defined(TEXCACHE_NO_SIMD) \
+    && ((defined(__clang_major__) && __clang_major__ >= 4) \
+        || (defined(__GNUC__) && __GNUC__ >= 5)) \
+    && __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__
+#define TEXCACHE_SIMD
+typedef unsigned int tvu32  __attribute__((vector_size(16)));
+typedef unsigned int tvu32u __attribute__((vector_size(16),aligned(2)));
+typedef unsigned int tvu32a __attribute__((vector_size(16),aligned(4)));
+#endif
+
+////////////////////////////////////////////////////////////////////////
+// hash a w*h halfword area of the 1024 halfwords wide psx vram
+////////////////////////////////////////////////////////////////////////
+
+unsigned int TexHashArea(const unsigned short *src,int w,int h)
+{
+ unsigned int l[4]={0x811c9dc5,0x3b9aca07,0x2545f491,0x9e3779b9},t=0;
+ int x,y,k;
+#ifdef TEXCACHE_SIMD
+ tvu32 v={l[0],l[1],l[2],l[3]},s;
+#endif
+
+ // lane k takes halfwords 2k and 2k+1 of every 8, the rest of a line
+ // goes to t
+ for(y=0;y<h;y++,src+=1024)
+  {
+#ifdef TEXCACHE_SIMD
+   for(x=0;x+8<=w;x+=8)
+    {
+     s=*(const tvu32u *)(src+x);
+     v=(v^(s&0xffff))*HASH_PRIME;
+     v=(v^(s>>16))*HASH_PRIME;
+    }
+#else
+   for(x=0;x+8<=w;x+=8)
+    for(k=0;k<4;k++)
+     l[k]=(((l[k]^src[x+k*2])*HASH_PRIME)^src[x+k*2+1])*HASH_PRIME;
+#endif
+   for(;x<w;x++)
+    t=(t^src[x])*HASH_PRIME;
+  }
+
+#ifdef TEXCACHE_SIMD
+ for(k=0;k<4;k++) l[k]=v[k];
+#endif
+ l[0]^=(l[1]>>7)^(l[2]<<5)^(l[3]>>13)^t;
+ l[0]=(l[0]^((w<<16)|h))*HASH_PRIME;
+ return l[0]^(l[0]>>16);
+}
+
+////////////////////////////////////////////////////////////////////////
+// hash of a cached part and its clut (16 or 256 entries, clut=NULL for
+// 15 bit textures), never 0 and never has TEXHASH_DIRTY set
+////////////////////////////////////////////////////////////////////////
+
+unsigned int TexHashPart(const unsigned short *src,int w,int h,
+                         const unsigned short *clut,int clutw)
+{
+ unsigned int r=TexHashArea(src,w,h);
+
+ if(clut) r=(r*33)^TexHashArea(clut,clutw,1);
+ return (r&~TEXHASH_DIRTY)|1;
+}
+
+////////////////////////////////////////////////////////////////////////
+// *state is 0 for a part that wasn't hashed, else its TexHashPart()
+// with TEXHASH_DIRTY set once a vram write touched it.
+// TexHashInvalidate: a vram write hit the part, returns 0 if it has to
+// be dropped right away.
+// TexHashRevalidate: a dirty part is needed again, 'now' is what
+// TexHashPart() gives for it at this point. Returns 1 if it can be
+// reused as it is, 0 if it has to be dropped.
+////////////////////////////////////////////////////////////////////////
+
+int TexHashInvalidate(unsigned int *state)
+{
+ if(!*state) return 0;
+ *state|=TEXHASH_DIRTY;
+ return 1;
+}
+
+int TexHashRevalidate(unsigned int *state,unsigned int now)
+{
+ if(now!=(*state&~TEXHASH_DIRTY)) return 0;
+ *state=now;
+ return 1;
+}
+
+////////////////////////////////////////////////////////////////////////
+// TCF[] colour funcs with a batch version below, the others stay in
+// gpuTexture.c
+////////////////////////////////////////////////////////////////////////
+
+unsigned int XP8RGBA_0(unsigned int BGR)
+{
+ if(!(BGR&0xffff)) return 0x50000000;
+ return ((((BGR<<3)&0xf8)|((BGR<<6)&0xf800)|((BGR<<9)&0xf80000))&0xffffff)|0xff000000;
+}
+
+unsigned int CP8RGBA_0(unsigned int BGR)
+{
+ unsigned int l;
+
+ if(!(BGR&0xffff)) return 0x50000000;
+ l=((((BGR<<3)&0xf8)|((BGR<<6)&0xf800)|((BGR<<9)&0xf80000))&0xffffff)|0xff000000;
+ if(l==0xfff8f800) l=0xff000000;
+ return l;
+}
+
+unsigned int XP8RGBA_1(unsigned int BGR)
+{
+ if(!(BGR&0xffff)) return 0x50000000;
+ if(!(BGR&0x8000)) {ubOpaqueDraw=1;return ((((BGR<<3)&0xf8)|((BGR<<6)&0xf800)|((BGR<<9)&0xf80000))&0xffffff);}
+ return ((((BGR<<3)&0xf8)|((BGR<<6)&0xf800)|((BGR<<9)&0xf80000))&0xffffff)|0xff000000;
+}
+
+unsigned int P8RGBA(unsigned int BGR)
+{
+ if(!(BGR&0xffff)) return 0;
+ return ((((BGR<<3)&0xf8)|((BGR<<6)&0xf800)|((BGR<<9)&0xf80000))&0xffffff)|0xff000000;
+}
+
+////////////////////////////////////////////////////////////////////////
+// 15 bit psx colours -> 32 bit texels, returns 1 if a semi transparent
+// texel was seen (to be or'ed into ubOpaqueDraw like the TCF funcs do)
+////////////////////////////////////////////////////////////////////////
+
+#define CONV15(b) ((((b)<<3)&0xf8)|(((b)<<6)&0xf800)|(((b)<<9)&0xf80000))
+
+int TexConv15To32(unsigned int *dst,const unsigned short *src,int n,int mode)
+{
+ unsigned int b,c,semi=0;
+ int i=0;
+#ifdef TEXCACHE_SIMD
+ tvu32 v,vc,nz,op,sv={0,0,0,0};
+
+ // comparisons give all ones lanes, used as masks
+ for(;i+4<=n;i+=4)
+  {
+   v=(tvu32){src[i],src[i+1],src[i+2],src[i+3]};
+   vc=CONV15(v);
+   nz=(tvu32)(v!=0);
+   switch(mode)
+    {
+     case TEXCONV_P8:
+      vc=(vc|0xff000000)&nz;
+      break;
+     case TEXCONV_X0:
+      vc=((vc|0xff000000)&nz)|(0x50000000&~nz);
+      break;
+     case TEXCONV_C0:
+      vc=(vc&~(tvu32)(vc==0xf8f800))|0xff000000;
+      vc=(vc&nz)|(0x50000000&~nz);
+      break;
+     case TEXCONV_X1:
+      op=(tvu32)((v&0x8000)!=0);
+      sv|=nz&~op;
+      vc=((vc|(0xff000000&op))&nz)|(0x50000000&~nz);
+      break;
+     default:
+      return 0;
+    }
+   *(tvu32a *)(dst+i)=vc;
+  }
+ semi=sv[0]|sv[1]|sv[2]|sv[3];
+#endif
+
+ switch(mode)
+  {
+   case TEXCONV_P8:
+    for(;i<n;i++)
+     {
+      b=src[i];
+      dst[i]=b?(CONV15(b)|0xff000000):0;
+     }
+    break;
+   case TEXCONV_X0:
+    for(;i<n;i++)
+     {
+      b=src[i];
+      dst[i]=b?(CONV15(b)|0xff000000):0x50000000;
+     }
+    break;
+   case TEXCONV_C0:
+    for(;i<n;i++)
+     {
+      b=src[i];
+      c=CONV15(b);
+      c=(c==0xf8f800)?0xff000000:(c|0xff000000);
+      dst[i]=b?c:0x50000000;
+     }
+    break;
+   case TEXCONV_X1:
+    for(;i<n;i++)
+     {
+      b=src[i];
+      c=CONV15(b)|((b&0x8000)?0xff000000:0);
+      semi|=(b!=0)&((b>>15)^1);
+      dst[i]=b?c:0x50000000;
+     }
+    break;
+  }
+
+ return semi!=0;
+}
+
+////////////////////////////////////////////////////////////////////////
+// 4 bit texels -> 32 bit through a 16 entry (already converted) clut,
+// n texels from n/2 bytes, low nibble first, n must be even.
+// 16 texels at a time: every colour byte of the clut is one table,
+// looked up by the 16 indices, the 4 results are zipped to texels.
+////////////////////////////////////////////////////////////////////////
+
+#if defined(TEXPAL_NEON) && !defined(__aarch64__)
+static inline uint8x16_t vqtbl1q_u8(uint8x16_t t,uint8x16_t i)
+{
+ uint8x8x2_t t2={{vget_low_u8(t),vget_high_u8(t)}};
+ return vcombine_u8(vtbl2_u8(t2,vget_low_u8(i)),vtbl2_u8(t2,vget_high_u8(i)));
+}
+#endif
+
+void TexPal4To32(unsigned int *dst,const unsigned char *src,int n,
+                 const unsigned int *pal)
+{
+ int i=0;
+#if defined(TEXPAL_NEON) || defined(TEXPAL_SSSE3)
+ unsigned char pl[4][16];
+ int k;
+
+ if(n>=16)
+  {
+   for(k=0;k<16;k++)
+    {
+     pl[0][k]=pal[k];    pl[1][k]=pal[k]>>8;
+     pl[2][k]=pal[k]>>16;pl[3][k]=pal[k]>>24;
+    }
+  }
+#endif
+#if defined(TEXPAL_NEON)
+ if(n>=16)
+  {
+   uint8x16_t p0=vld1q_u8(pl[0]),p1=vld1q_u8(pl[1]);
+   uint8x16_t p2=vld1q_u8(pl[2]),p3=vld1q_u8(pl[3]);
+   for(;i+16<=n;i+=16,src+=8,dst+=16)
+    {
+     uint8x8_t b=vld1_u8(src);
+     uint8x8x2_t ix=vzip_u8(vand_u8(b,vdup_n_u8(15)),vshr_n_u8(b,4));
+     uint8x16_t x=vcombine_u8(ix.val[0],ix.val[1]);
+     uint8x16x2_t c01=vzipq_u8(vqtbl1q_u8(p0,x),vqtbl1q_u8(p1,x));
+     uint8x16x2_t c23=vzipq_u8(vqtbl1q_u8(p2,x),vqtbl1q_u8(p3,x));
+     uint16x8x2_t lo=vzipq_u16(vreinterpretq_u16_u8(c01.val[0]),vreinterpretq_u16_u8(c23.val[0]));
+     uint16x8x2_t hi=vzipq_u16(vreinterpretq_u16_u8(c01.val[1]),vreinterpretq_u16_u8(c23.val[1]));
+     vst1q_u32(dst,   vreinterpretq_u32_u16(lo.val[0]));
+     vst1q_u32(dst+4, vreinterpretq_u32_u16(lo.val[1]));
+     vst1q_u32(dst+8, vreinterpretq_u32_u16(hi.val[0]));
+     vst1q_u32(dst+12,vreinterpretq_u32_u16(hi.val[1]));
+    }
+  }
+#elif defined(TEXPAL_SSSE3)
+ if(n>=16)
+  {
+   __m128i p0=_mm_loadu_si128((const __m128i *)pl[0]),p1=_mm_loadu_si128((const __m128i *)pl[1]);
+   __m128i p2=_mm_loadu_si128((const __m128i *)pl[2]),p3=_mm_loadu_si128((const __m128i *)pl[3]);
+   __m128i m=_mm_set1_epi8(15);
+   for(;i+16<=n;i+=16,src+=8,dst+=16)
+    {
+     __m128i b=_mm_loadl_epi64((const __m128i *)src);
+     __m128i x=_mm_unpacklo_epi8(_mm_and_si128(b,m),_mm_and_si128(_mm_srli_epi16(b,4),m));
+     __m128i c0=_mm_shuffle_epi8(p0,x),c1=_mm_shuffle_epi8(p1,x);
+     __m128i c2=_mm_shuffle_epi8(p2,x),c3=_mm_shuffle_epi8(p3,x);
+     __m128i c01l=_mm_unpacklo_epi8(c0,c1),c01h=_mm_unpackhi_epi8(c0,c1);
+     __m128i c23l=_mm_unpacklo_epi8(c2,c3),c23h=_mm_unpackhi_epi8(c2,c3);
+     _mm_storeu_si128((__m128i *)dst,     _mm_unpacklo_epi16(c01l,c23l));
+     _mm_storeu_si128((__m128i *)(dst+4), _mm_unpackhi_epi16(c01l,c23l));
+     _mm_storeu_si128((__m128i *)(dst+8), _mm_unpacklo_epi16(c01h,c23h));
+     _mm_storeu_si128((__m128i *)(dst+12),_mm_unpackhi_epi16(c01h,c23h));
+    }
+  }
+#endif
+
+ for(;i<n;i+=2,src++,dst+=2)
+  {
+   dst[0]=pal[*src&15];
+   dst[1]=pal[*src>>4];
+  }
+}
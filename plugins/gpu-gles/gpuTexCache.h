@@ -0,0 +1,57 @@
+/***************************************************************************
+                          gpuTexCache.h  -  description
+                             -------------------
+    PCSX rearmed texture hashing/conversion helpers
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version. See also the license.txt file for *
+ *   additional informations.                                              *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef _GPU_TEXCACHE_H_
+#define _GPU_TEXCACHE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// no GL in here, so all of this can be used (and checked) standalone
+
+// batch versions of the TCF[] colour funcs, see gpuTexture.c
+enum
+{
+ TEXCONV_NONE=-1,
+ TEXCONV_P8,                                           // P8RGBA
+ TEXCONV_X0,                                           // XP8RGBA_0
+ TEXCONV_C0,                                           // CP8RGBA_0
+ TEXCONV_X1                                            // XP8RGBA_1
+};
+
+#define TEXHASH_DIRTY 0x80000000
+
+unsigned int   TexHashArea(const unsigned short *src,int w,int h);
+unsigned int   TexHashPart(const unsigned short *src,int w,int h,
+                           const unsigned short *clut,int clutw);
+int            TexHashInvalidate(unsigned int *state);
+int            TexHashRevalidate(unsigned int *state,unsigned int now);
+int            TexConv15To32(unsigned int *dst,const unsigned short *src,int n,int mode);
+void           TexPal4To32(unsigned int *dst,const unsigned char *src,int n,
+                           const unsigned int *pal);
+
+// the TCF[] funcs the batch versions stand for
+unsigned int   P8RGBA(unsigned int BGR);
+unsigned int   XP8RGBA_0(unsigned int BGR);
+unsigned int   CP8RGBA_0(unsigned int BGR);
+unsigned int   XP8RGBA_1(unsigned int BGR);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _GPU_TEXCACHE_H_
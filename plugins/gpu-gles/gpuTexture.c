@@ -75,6 +75,7 @@
 #include "gpuTexture.h"
 #include "gpuPlugin.h"
 #include "gpuPrim.h"
+#include "gpuTexCache.h"
 
 #define CLUTCHK   0x00060000
 #define CLUTSHIFT 17
@@ -189,6 +190,7 @@ typedef struct textureSubCacheEntryTagS
 
 textureWndCacheEntry     wcWndtexStore[MAXWNDTEXCACHE];
 textureSubCacheEntryS *  pscSubtexStore[3][MAXTPAGES_MAX];
+unsigned int *           puiSubtexHash[3][MAXTPAGES_MAX]; // vram/clut hash per entry, 0: none
 EXLong *                 pxSsubtexLeft [MAXSORTTEX_MAX];
 GLuint                   uiStexturePage[MAXSORTTEX_MAX];
 
@@ -251,12 +253,6 @@ unsigned int CP8RGBAEx(unsigned int BGR)
  return l;
 }
 
-unsigned int XP8RGBA_0(unsigned int BGR)
-{
- if(!(BGR&0xffff)) return 0x50000000;
- return ((((BGR<<3)&0xf8)|((BGR<<6)&0xf800)|((BGR<<9)&0xf80000))&0xffffff)|0xff000000;
-}
-
 unsigned int XP8RGBAEx_0(unsigned int BGR)
 {
  if(!(BGR&0xffff)) return 0x03000000;
@@ -275,16 +271,6 @@ unsigned int XP8BGRAEx_0(unsigned int BGR)
  return ((((BGR>>7)&0xf8)|((BGR<<6)&0xf800)|((BGR<<19)&0xf80000))&0xffffff)|0xff000000;
 }
 
-unsigned int CP8RGBA_0(unsigned int BGR)
-{
- unsigned int l;
-
- if(!(BGR&0xffff)) return 0x50000000;
- l=((((BGR<<3)&0xf8)|((BGR<<6)&0xf800)|((BGR<<9)&0xf80000))&0xffffff)|0xff000000;
- if(l==0xfff8f800) l=0xff000000;
- return l;
-}
-
 unsigned int CP8RGBAEx_0(unsigned int BGR)
 {
  unsigned int l;
@@ -315,13 +301,6 @@ unsigned int CP8BGRAEx_0(unsigned int BGR)
  return l;
 }
 
-unsigned int XP8RGBA_1(unsigned int BGR)
-{
- if(!(BGR&0xffff)) return 0x50000000;
- if(!(BGR&0x8000)) {ubOpaqueDraw=1;return ((((BGR<<3)&0xf8)|((BGR<<6)&0xf800)|((BGR<<9)&0xf80000))&0xffffff);}
- return ((((BGR<<3)&0xf8)|((BGR<<6)&0xf800)|((BGR<<9)&0xf80000))&0xffffff)|0xff000000;
-}
-
 unsigned int XP8RGBAEx_1(unsigned int BGR)
 {
  if(!(BGR&0xffff)) return 0x03000000;
@@ -343,12 +322,6 @@ unsigned int XP8BGRAEx_1(unsigned int BGR)
  return ((((BGR>>7)&0xf8)|((BGR<<6)&0xf800)|((BGR<<19)&0xf80000))&0xffffff)|0xff000000;
 }
 
-unsigned int P8RGBA(unsigned int BGR)
-{
- if(!(BGR&0xffff)) return 0;
- return ((((BGR<<3)&0xf8)|((BGR<<6)&0xf800)|((BGR<<9)&0xf80000))&0xffffff)|0xff000000;
-}
-
 unsigned int P8BGRA(unsigned int BGR)
 {
  if(!(BGR&0xffff)) return 0;
@@ -432,6 +405,17 @@ unsigned short P4RGBA(unsigned short BGR)
  return (((((BGR&0x1e)<<11))|((BGR&0x7800)>>7)|((BGR&0x3c0)<<2)))|0xf;
 }
 
+// which batch converter (gpuTexCache.c) does the same as a TCF func
+
+static int TexConvMode(unsigned int (*fn)(unsigned int))
+{
+ if(fn==P8RGBA)    return TEXCONV_P8;
+ if(fn==XP8RGBA_0) return TEXCONV_X0;
+ if(fn==CP8RGBA_0) return TEXCONV_C0;
+ if(fn==XP8RGBA_1) return TEXCONV_X1;
+ return TEXCONV_NONE;
+}
+
 ////////////////////////////////////////////////////////////////////////
 // CHECK TEXTURE MEM (on plugin startup)
 ////////////////////////////////////////////////////////////////////////
@@ -556,6 +540,7 @@ void InitializeTextureStore()
    {                                               
     pscSubtexStore[i][j]=(textureSubCacheEntryS *)malloc(CSUBSIZES*sizeof(textureSubCacheEntryS));
     memset(pscSubtexStore[i][j],0,CSUBSIZES*sizeof(textureSubCacheEntryS));
+    puiSubtexHash[i][j]=(unsigned int *)calloc(CSUBSIZES,sizeof(unsigned int));
    }
  for(i=0;i<MAXSORTTEX;i++)                           // -> info 0..511
   {
@@ -613,6 +598,8 @@ void CleanupTextureStore()
    {
     free(pscSubtexStore[i][j]);                      // -> clean mem
     pscSubtexStore[i][j]=0;
+    free(puiSubtexHash[i][j]);
+    puiSubtexHash[i][j]=0;
    }
  for(i=0;i<MAXSORTTEX;i++)
   {
@@ -771,6 +758,75 @@ void MarkFree(textureSubCacheEntryS * tsx)
   }
 }
 
+////////////////////////////////////////////////////////////////////////
+// content hashes of sort textures: a vram write only marks the parts
+// it touches dirty, a dirty part gets checked against the vram again
+// when it's needed, and reused if nothing changed
+////////////////////////////////////////////////////////////////////////
+
+static unsigned int * SubTexHashPtr(int mode,int page,textureSubCacheEntryS * tsx)
+{
+ return puiSubtexHash[mode][page]+(tsx-pscSubtexStore[mode][page]);
+}
+
+static unsigned int SubTexHash(int mode,int page,textureSubCacheEntryS * tsx)
+{
+ int x1=tsx->pos.c[3]>>(2-mode),x2=tsx->pos.c[2]>>(2-mode);
+ int y1=tsx->pos.c[1],y2=tsx->pos.c[0];
+ unsigned short * src, * clut=NULL;
+
+ if(GlobalTextIL) return 0;                            // swizzled, don't bother
+
+ src=psxVuw+((page>>4)<<18)+((page&15)<<6)+(y1<<10)+x1;
+ if(mode!=2)
+  clut=psxVuw+((tsx->ClutID<<4)&0x3f0)+(((tsx->ClutID>>6)&CLUTYMASK)<<10);
+ return TexHashPart(src,x2-x1+1,y2-y1+1,clut,mode?256:16);
+}
+
+static void SubTexInvalidate(int mode,int page,textureSubCacheEntryS * tsx)
+{
+ if(!TexHashInvalidate(SubTexHashPtr(mode,page,tsx)))
+  {tsx->ClutID=0;MarkFree(tsx);}
+}
+
+static BOOL SubTexValid(int mode,int page,textureSubCacheEntryS * tsx)
+{
+ unsigned int * ph=SubTexHashPtr(mode,page,tsx);
+
+ if(!(*ph&TEXHASH_DIRTY)) return TRUE;
+ if(TexHashRevalidate(ph,SubTexHash(mode,page,tsx))) return TRUE;
+
+ tsx->ClutID=0;MarkFree(tsx);
+ return FALSE;
+}
+
+// drop the dirty parts of one rect info area, returns the first freed slot
+
+static textureSubCacheEntryS * FreeDirtySubTex(int mode,int page,textureSubCacheEntryS * tsg,textureSubCacheEntryS * tskeep)
+{
+ textureSubCacheEntryS * tsb=tsg+1, * tsx=NULL;
+ int i,iMax=tsg->pos.l;
+
+ for(i=0;i<iMax;i++,tsb++)
+  if(tsb!=tskeep && tsb->ClutID && (*SubTexHashPtr(mode,page,tsb)&TEXHASH_DIRTY))
+   {
+    tsb->ClutID=0;MarkFree(tsb);
+    if(!tsx) tsx=tsb;
+   }
+ return tsx;
+}
+
+static BOOL FreeAllDirtySubTex(textureSubCacheEntryS * tskeep)
+{
+ int i,j,k;BOOL bFreed=FALSE;
+
+ for(i=0;i<3;i++)
+  for(j=0;j<MAXTPAGES;j++)
+   for(k=0;k<4;k++)
+    if(FreeDirtySubTex(i,j,pscSubtexStore[i][j]+k*SOFFB,tskeep)) bFreed=TRUE;
+ return bFreed;
+}
+
 void InvalidateSubSTextureArea(int X,int Y,int W, int H)
 {
  int i,j,k,iMax,px,py,px1,px2,py1,py2,iYM=1;
@@ -828,27 +884,27 @@ void InvalidateSubSTextureArea(int X,int Y,int W, int H)
         {
          tsb=pscSubtexStore[k][j]+SOFFA;iMax=tsb->pos.l;tsb++;
          for(i=0;i<iMax;i++,tsb++)
-          if(tsb->ClutID && XCHECK(tsb->pos,npos)) {tsb->ClutID=0;MarkFree(tsb);}
+          if(tsb->ClutID && XCHECK(tsb->pos,npos)) SubTexInvalidate(k,j,tsb);
 
 //         if(npos.l & 0x00800000)
           {
            tsb=pscSubtexStore[k][j]+SOFFB;iMax=tsb->pos.l;tsb++;
            for(i=0;i<iMax;i++,tsb++)
-            if(tsb->ClutID && XCHECK(tsb->pos,npos)) {tsb->ClutID=0;MarkFree(tsb);}
+            if(tsb->ClutID && XCHECK(tsb->pos,npos)) SubTexInvalidate(k,j,tsb);
           }
 
 //         if(npos.l & 0x00000080)
           {
            tsb=pscSubtexStore[k][j]+SOFFC;iMax=tsb->pos.l;tsb++;
            for(i=0;i<iMax;i++,tsb++)
-            if(tsb->ClutID && XCHECK(tsb->pos,npos)) {tsb->ClutID=0;MarkFree(tsb);}
+            if(tsb->ClutID && XCHECK(tsb->pos,npos)) SubTexInvalidate(k,j,tsb);
           }
 
 //         if(npos.l & 0x00800080)
           {
            tsb=pscSubtexStore[k][j]+SOFFD;iMax=tsb->pos.l;tsb++;
            for(i=0;i<iMax;i++,tsb++)
-            if(tsb->ClutID && XCHECK(tsb->pos,npos)) {tsb->ClutID=0;MarkFree(tsb);}
+            if(tsb->ClutID && XCHECK(tsb->pos,npos)) SubTexInvalidate(k,j,tsb);
           }
         }
       }
@@ -2483,8 +2539,10 @@ void LoadSubTexturePageSort(int pageid, int mode, short cx, short cy)
  unsigned int (*LTCOL)(unsigned int);
  unsigned int a,r,g,b,cnt,h;
  unsigned int scol[8];
+ int iConv;
  
  LTCOL=TCF[DrawSemiTrans];
+ iConv=TexConvMode(LTCOL);
 
  pa=px=(unsigned int *)ubPaletteBuffer;
  ta=(unsigned int *)texturepart;
@@ -2535,15 +2593,20 @@ void LoadSubTexturePageSort(int pageid, int mode, short cx, short cy)
 
     wSRCPtr=psxVuw+palstart;
 
-    row=4;do
+    if(iConv!=TEXCONV_NONE)
+     ubOpaqueDraw|=TexConv15To32(px,wSRCPtr,16,iConv);
+    else
      {
-      *px    =LTCOL(*wSRCPtr);
-      *(px+1)=LTCOL(*(wSRCPtr+1));
-      *(px+2)=LTCOL(*(wSRCPtr+2));
-      *(px+3)=LTCOL(*(wSRCPtr+3));
-      row--;px+=4;wSRCPtr+=4;
+      row=4;do
+       {
+        *px    =LTCOL(*wSRCPtr);
+        *(px+1)=LTCOL(*(wSRCPtr+1));
+        *(px+2)=LTCOL(*(wSRCPtr+2));
+        *(px+3)=LTCOL(*(wSRCPtr+3));
+        row--;px+=4;wSRCPtr+=4;
+       }
+      while (row);
      }
-    while (row);
 
     x2a=x2?(x2-1):0;//if(x2) x2a=x2-1; else x2a=0;
     sxm=x1&1;sxh=x1>>1;
@@ -2554,12 +2617,9 @@ void LoadSubTexturePageSort(int pageid, int mode, short cx, short cy)
     
       if(sxm) *ta++=*(pa+((*cSRCPtr++ >> 4) & 0xF));
 
-      for(row=j;row<x2a;row+=2)
-       {
-        *ta    =*(pa+(*cSRCPtr & 0xF)); 
-        *(ta+1)=*(pa+((*cSRCPtr >> 4) & 0xF)); 
-        cSRCPtr++;ta+=2;
-       }
+      row=(x2a>j)?((x2a-j+1)&~1):0;
+      TexPal4To32(ta,cSRCPtr,row,pa);
+      ta+=row;cSRCPtr+=row>>1;row+=j;
 
       if(row<=x2) 
        {
@@ -2614,15 +2674,20 @@ void LoadSubTexturePageSort(int pageid, int mode, short cx, short cy)
      {
       wSRCPtr=psxVuw+palstart;
 
-      row=64;do
+      if(iConv!=TEXCONV_NONE)
+       ubOpaqueDraw|=TexConv15To32(px,wSRCPtr,256,iConv);
+      else
        {
-        *px    =LTCOL(*wSRCPtr);
-        *(px+1)=LTCOL(*(wSRCPtr+1));
-        *(px+2)=LTCOL(*(wSRCPtr+2));
-        *(px+3)=LTCOL(*(wSRCPtr+3));
-        row--;px+=4;wSRCPtr+=4;
+        row=64;do
+         {
+          *px    =LTCOL(*wSRCPtr);
+          *(px+1)=LTCOL(*(wSRCPtr+1));
+          *(px+2)=LTCOL(*(wSRCPtr+2));
+          *(px+3)=LTCOL(*(wSRCPtr+3));
+          row--;px+=4;wSRCPtr+=4;
+         }
+        while (row);
        }
-      while (row);
 
       column=dy;do 
        {
@@ -2656,6 +2721,18 @@ void LoadSubTexturePageSort(int pageid, int mode, short cx, short cy)
     wSRCPtr = psxVuw + start + (y1<<10) + x1;
     LineOffset = 1024 - dx; 
 
+    if(iConv!=TEXCONV_NONE)
+     {
+      column=dy;do 
+       {
+        ubOpaqueDraw|=TexConv15To32(ta,wSRCPtr,dx,iConv);
+        ta+=dx+xalign;
+        wSRCPtr+=1024;column--;
+       }
+      while(column);
+      break;
+     }
+
     column=dy;do 
      {
       row=dx;
@@ -3563,6 +3640,7 @@ unsigned char * CheckTextureInSubSCache(int TextureMode,unsigned int GivenClutId
  EXLong * ul=0, * uls;
  EXLong rfree;
  unsigned char cXAdj,cYAdj;
+ BOOL bDirtyFreed;
 
  npos.l=*((unsigned int *)&gl_ux[4]);
 
@@ -3581,7 +3659,8 @@ unsigned char * CheckTextureInSubSCache(int TextureMode,unsigned int GivenClutId
    do
     {
      if(GivenClutId==tsb->ClutID &&
-        (INCHECK(tsb->pos,npos)))
+        (INCHECK(tsb->pos,npos)) &&
+        SubTexValid(TextureMode,GlobalTexturePage,tsb))
       {
         {
          cx=tsb->pos.c[3]-tsb->posTX;
@@ -3619,6 +3698,9 @@ unsigned char * CheckTextureInSubSCache(int TextureMode,unsigned int GivenClutId
    if(!tsb->ClutID) {tsx=tsb;break;}
   }
 
+ if(!tsx && iMax>=SOFFB-3)                             // list full? drop stale parts first
+  tsx=FreeDirtySubTex(TextureMode,GlobalTexturePage,tsg,NULL);
+
  if(!tsx) 
   {
    iMax++;
@@ -3676,6 +3758,10 @@ ENDLOOP3:
  rx+=3;if(rx>255) {cXAdj=0;rx=255;}
  ry+=3;if(ry>255) {cYAdj=0;ry=255;}
 
+ bDirtyFreed=FALSE;
+
+SEARCHSPACE:
+
  iC=usLRUTexPage;
 
  for(k=0;k<iSortTexCnt;k++)
@@ -3768,6 +3854,9 @@ ENDLOOP3:
    iC++; if(iC>=iSortTexCnt) iC=0;
   }
 
+ if(!bDirtyFreed && FreeAllDirtySubTex(tsx))           // out of space? drop stale parts and retry
+  {bDirtyFreed=TRUE;goto SEARCHSPACE;}
+
  //----------------------------------------------------//
  // check, if free space got
  //----------------------------------------------------//
@@ -3833,6 +3922,8 @@ ENDLOOP:
  tsx->ClutID   = GivenClutId;
  tsx->posTX    = rfree.c[3];
  tsx->posTY    = rfree.c[1];
+ *SubTexHashPtr(TextureMode,GlobalTexturePage,tsx)=
+   SubTexHash(TextureMode,GlobalTexturePage,tsx);
 
  cx=gl_ux[7]-rfree.c[3];
  cy=gl_ux[5]-rfree.c[1];
@@ -4100,6 +4191,7 @@ void CompressTextureSpace(void)
              LoadSubTexFn(k,j,cx,cy);
              uiStexturePage[tsx->cTexID]=gTexName;
              tsx->Opaque=ubOpaqueDraw;
+             *SubTexHashPtr(j,k,tsx)=SubTexHash(j,k,tsx);
             }
           }
         }
@@ -27,6 +27,8 @@
 #ifndef _GPU_TEXTURE_H_
 #define _GPU_TEXTURE_H_
 
+#include "gpuTexCache.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -52,17 +54,13 @@ void           LoadPackedSubTexturePage(int pageid, int mode, short cx, short cy
 void           LoadPackedSubTexturePageSort(int pageid, int mode, short cx, short cy);
 unsigned int   XP8RGBA(unsigned int BGR);
 unsigned int   XP8RGBAEx(unsigned int BGR);
-unsigned int   XP8RGBA_0(unsigned int BGR);
 unsigned int   XP8RGBAEx_0(unsigned int BGR);
 unsigned int   XP8BGRA_0(unsigned int BGR);
 unsigned int   XP8BGRAEx_0(unsigned int BGR);
-unsigned int   XP8RGBA_1(unsigned int BGR);
 unsigned int   XP8RGBAEx_1(unsigned int BGR);
 unsigned int   XP8BGRA_1(unsigned int BGR);
 unsigned int   XP8BGRAEx_1(unsigned int BGR);
-unsigned int   P8RGBA(unsigned int BGR);
 unsigned int   P8BGRA(unsigned int BGR);
-unsigned int   CP8RGBA_0(unsigned int BGR);
 unsigned int   CP8RGBAEx_0(unsigned int BGR);
 unsigned int   CP8BGRA_0(unsigned int BGR);
 unsigned int   CP8BGRAEx_0(unsigned int BGR);
@@ -18,6 +18,7 @@
 
 #include "gpuStdafx.h"
 #include "gpuDraw.c"
+#include "gpuTexCache.c"
 #include "gpuTexture.c"
 #include "gpuPrim.c"
 #include "hud.c"
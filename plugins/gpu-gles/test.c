@@ -0,0 +1,252 @@
+/*
+ * Checks for gpuTexCache.c, which has no GL dependency:
+ * - TexHashArea() against a plain reference and for sensitivity
+ * - the TCF[] colour funcs and TexConv15To32() against hand worked
+ *   texels, and the batch version against the TCF[] funcs
+ * - TexPal4To32() 4bpp clut lookup
+ * - the dirty/reuse logic of the sort texture cache parts
+ * see Makefile.test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gpuTexCache.h"
+
+#define P 0x01000193
+
+static unsigned short vram[1024 * 512];
+static int failed;
+
+#define check(c, ...) do { \
+	if (!(c)) { \
+		printf("%s:%d: ", __FILE__, __LINE__); \
+		printf(__VA_ARGS__); \
+		printf("\n"); \
+		failed++; \
+	} \
+} while (0)
+
+// what TexHashArea() is defined to be, one halfword at a time
+static unsigned int ref_hash(const unsigned short *src, int w, int h)
+{
+	unsigned int l[4] = { 0x811c9dc5, 0x3b9aca07, 0x2545f491, 0x9e3779b9 }, t = 0;
+	int x, y;
+
+	for (y = 0; y < h; y++, src += 1024) {
+		for (x = 0; x < w / 8 * 8; x++)
+			l[(x & 7) / 2] = (l[(x & 7) / 2] ^ src[x]) * P;
+		for (; x < w; x++)
+			t = (t ^ src[x]) * P;
+	}
+	l[0] ^= (l[1] >> 7) ^ (l[2] << 5) ^ (l[3] >> 13) ^ t;
+	l[0] = (l[0] ^ ((w << 16) | h)) * P;
+	return l[0] ^ (l[0] >> 16);
+}
+
+static void test_hash(void)
+{
+	unsigned int h0, h1;
+	unsigned short *src;
+	int w, h, x, y;
+
+	for (w = 1; w <= 40; w++) {
+		for (h = 1; h <= 5; h++) {
+			// odd x for unaligned loads
+			src = vram + (w * 37 & 511) * 1024 + (w * 13 & 255) + (h & 1);
+			check(TexHashArea(src, w, h) == ref_hash(src, w, h),
+				"hash %dx%d differs from the reference", w, h);
+		}
+	}
+
+	// any single changed texel must show, nothing outside the area may
+	src = vram + 100 * 1024 + 203;
+	w = 21; h = 7;
+	h0 = TexHashArea(src, w, h);
+	for (y = -1; y <= h; y++) {
+		for (x = -1; x <= w; x++) {
+			src[y * 1024 + x] ^= 0x0421;
+			h1 = TexHashArea(src, w, h);
+			src[y * 1024 + x] ^= 0x0421;
+			if (0 <= x && x < w && 0 <= y && y < h)
+				check(h1 != h0, "change at %d,%d not seen", x, y);
+			else
+				check(h1 == h0, "change at %d,%d outside the area seen", x, y);
+		}
+	}
+	check(TexHashArea(src, w, h) != TexHashArea(src, h, w), "size not hashed");
+}
+
+// worked out by hand from the psx format: r in bits 0-4, g 5-9,
+// b 10-14, bit 15 is the semi transparency (stp) bit
+static const struct {
+	unsigned short in;
+	unsigned int out[4];		// TEXCONV_P8, _X0, _C0, _X1
+	int semi;			// TEXCONV_X1 reports semi transparency
+} conv_tab[] = {
+	{ 0x0000, { 0x00000000, 0x50000000, 0x50000000, 0x50000000 }, 0 },
+	{ 0x8000, { 0xff000000, 0xff000000, 0xff000000, 0xff000000 }, 0 },
+	{ 0x001f, { 0xff0000f8, 0xff0000f8, 0xff0000f8, 0x000000f8 }, 1 },
+	{ 0x03e0, { 0xff00f800, 0xff00f800, 0xff00f800, 0x0000f800 }, 1 },
+	{ 0x7c00, { 0xfff80000, 0xfff80000, 0xfff80000, 0x00f80000 }, 1 },
+	{ 0x7fff, { 0xfff8f8f8, 0xfff8f8f8, 0xfff8f8f8, 0x00f8f8f8 }, 1 },
+	{ 0xffff, { 0xfff8f8f8, 0xfff8f8f8, 0xfff8f8f8, 0xfff8f8f8 }, 0 },
+	{ 0x7fe0, { 0xfff8f800, 0xfff8f800, 0xff000000, 0x00f8f800 }, 1 },
+	{ 0xffe0, { 0xfff8f800, 0xfff8f800, 0xff000000, 0xfff8f800 }, 0 },
+	{ 0x1234, { 0xff2088a0, 0xff2088a0, 0xff2088a0, 0x002088a0 }, 1 },
+	{ 0x9234, { 0xff2088a0, 0xff2088a0, 0xff2088a0, 0xff2088a0 }, 0 },
+	{ 0x0001, { 0xff000008, 0xff000008, 0xff000008, 0x00000008 }, 1 },
+	{ 0x0421, { 0xff080808, 0xff080808, 0xff080808, 0x00080808 }, 1 },
+};
+#define CONV_TAB_N (int)(sizeof(conv_tab) / sizeof(conv_tab[0]))
+
+// set by XP8RGBA_1, lives in gpuTexture.c in the plugin
+unsigned char ubOpaqueDraw;
+
+static unsigned int (*const tcf[4])(unsigned int) = {
+	P8RGBA, XP8RGBA_0, CP8RGBA_0, XP8RGBA_1
+};
+
+static void test_conv(void)
+{
+	static unsigned short src[65536 + 3];
+	static unsigned int dst[65536 + 3];
+	int mode, semi, i, n, k;
+
+	for (mode = TEXCONV_P8; mode <= TEXCONV_X1; mode++) {
+		// the TCF[] funcs and the batch version (all alignments and
+		// tail lengths) against the table
+		for (i = 0; i < CONV_TAB_N; i++) {
+			ubOpaqueDraw = 0;
+			check(tcf[mode](conv_tab[i].in) == conv_tab[i].out[mode],
+				"tcf %d: %04x -> %08x, expected %08x", mode, conv_tab[i].in,
+				tcf[mode](conv_tab[i].in), conv_tab[i].out[mode]);
+			check(ubOpaqueDraw == (mode == TEXCONV_X1 && conv_tab[i].semi),
+				"tcf %d: %04x semi %d", mode, conv_tab[i].in, ubOpaqueDraw);
+		}
+		for (k = 0; k < 4; k++) {
+			for (n = 1; n <= CONV_TAB_N; n++) {
+				for (i = 0; i < n; i++)
+					src[k + i] = conv_tab[i].in;
+				semi = TexConv15To32(dst + k, src + k, n, mode);
+				for (i = 0; i < n; i++)
+					check(dst[k + i] == conv_tab[i].out[mode],
+						"mode %d: %04x -> %08x, expected %08x", mode,
+						conv_tab[i].in, dst[k + i], conv_tab[i].out[mode]);
+				check(semi == (mode == TEXCONV_X1 && n > 2),
+					"mode %d n %d: semi %d", mode, n, semi);
+			}
+		}
+
+		// all colours, batch version against the TCF[] func
+		for (i = 0; i < 65536; i++)
+			src[i] = i;
+		TexConv15To32(dst, src, 65536, mode);
+		for (i = n = 0; i < 65536; i++)
+			if (dst[i] != tcf[mode](i) && n++ < 4)
+				check(0, "mode %d: %04x -> %08x, tcf gives %08x",
+					mode, i, dst[i], tcf[mode](i));
+	}
+
+	// opaque texels only, no semi transparency to report
+	for (i = 0; i < 16; i++)
+		src[i] = 0x8000 | i;
+	check(!TexConv15To32(dst, src, 16, TEXCONV_X1), "semi for opaque texels");
+}
+
+static void test_pal4(void)
+{
+	// low nibble first
+	static const unsigned char src[20] = {
+		0x10, 0x32, 0x54, 0x76, 0x98, 0xba, 0xdc, 0xfe,
+		0x0f, 0x1e, 0x2d, 0x3c, 0x4b, 0x5a, 0x69, 0x78,
+		0xa5, 0x5a, 0x00, 0xff,
+	};
+	static const unsigned char idx[40] = {
+		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+		15, 0, 14, 1, 13, 2, 12, 3, 11, 4, 10, 5, 9, 6, 8, 7,
+		5, 10, 10, 5, 0, 0, 15, 15,
+	};
+	unsigned int pal[16], dst[40 + 1];
+	int i, n;
+
+	// every byte differs, so a wrong byte order shows
+	for (i = 0; i < 16; i++)
+		pal[i] = 0x01020304 * (i + 1) ^ 0x80408020;
+	for (n = 0; n <= 40; n += 2) {
+		memset(dst, 0x55, sizeof(dst));
+		TexPal4To32(dst, src, n, pal);
+		for (i = 0; i < n; i++)
+			check(dst[i] == pal[idx[i]], "pal4 n %d: texel %d is %08x, expected %08x",
+				n, i, dst[i], pal[idx[i]]);
+		check(dst[n] == 0x55555555, "pal4 n %d: wrote past the end", n);
+	}
+}
+
+// a cached 4bpp part as gpuTexture.c hashes it
+static unsigned int part_hash(void)
+{
+	return TexHashPart(vram + 256 * 1024 + 64 + 10 * 1024 + 2, 8, 16,
+		vram + 480 * 1024 + 32, 16);
+}
+
+static void test_reuse(void)
+{
+	unsigned short *tex = vram + 266 * 1024 + 66;
+	unsigned short *clut = vram + 480 * 1024 + 32;
+	unsigned int state, none = 0;
+
+	state = part_hash();
+	check(state != 0 && !(state & TEXHASH_DIRTY), "bad hash %08x", state);
+
+	// a part that wasn't hashed is dropped right away
+	check(!TexHashInvalidate(&none), "unhashed part kept");
+
+	// the same data written again
+	check(TexHashInvalidate(&state), "hashed part dropped");
+	check(state & TEXHASH_DIRTY, "not marked dirty");
+	check(TexHashRevalidate(&state, part_hash()), "unchanged part not reused");
+	check(!(state & TEXHASH_DIRTY), "still dirty after reuse");
+
+	// texture data changed
+	TexHashInvalidate(&state);
+	tex[3 * 1024 + 5]++;
+	check(!TexHashRevalidate(&state, part_hash()), "changed texture reused");
+	tex[3 * 1024 + 5]--;
+
+	// clut changed
+	state = part_hash();
+	TexHashInvalidate(&state);
+	clut[15] ^= 0x8000;
+	check(!TexHashRevalidate(&state, part_hash()), "changed clut reused");
+	clut[15] ^= 0x8000;
+
+	// changed and changed back before the part was needed
+	state = part_hash();
+	TexHashInvalidate(&state);
+	tex[0] = ~tex[0];
+	tex[0] = ~tex[0];
+	check(TexHashRevalidate(&state, part_hash()), "restored part not reused");
+
+	// swizzled textures aren't hashed, 0 as the current hash never matches
+	TexHashInvalidate(&state);
+	check(!TexHashRevalidate(&state, 0), "part reused against no hash");
+}
+
+int main(void)
+{
+	unsigned int r = 1;
+	int i;
+
+	for (i = 0; i < 1024 * 512; i++) {
+		r = r * 1103515245 + 12345;
+		vram[i] = r >> 16;
+	}
+
+	test_hash();
+	test_conv();
+	test_pal4();
+	test_reuse();
+
+	printf("%s\n", failed ? "FAILED" : "ok");
+	return failed ? 1 : 0;
+}
@@ -79,7 +79,11 @@ INLINE float FloatInv(const float x)
 
 //  big precision inverse table.
 #define TABLE_BITS 16
+#ifndef GPU_UNAI_WORKER
 s32 s_invTable[(1<<TABLE_BITS)];
+#else
+extern "C" s32 s_invTable[(1<<TABLE_BITS)];
+#endif
 #endif
 
 #ifdef GPU_UNAI_USE_INT_DIV_MULTINV
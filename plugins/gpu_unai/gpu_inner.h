@@ -335,14 +335,15 @@ template<int CF>
 static noinline void gpuTileDriverFn(le16_t *pDst, u16 data, u32 count,
 	const gpu_unai_inner_t &inn)
 {
-	const int li=gpu_unai.inn.ilace_mask;
+	const int li=inn.ilace_mask;
+	const int lp=inn.ilace_parity;
 	const int pi=(ProgressiveInterlaceEnabled()?(gpu_unai.inn.ilace_mask+1):0);
 	const int pif=(ProgressiveInterlaceEnabled()?(gpu_unai.prog_ilace_flag?(gpu_unai.inn.ilace_mask+1):0):1);
 	const int y1 = inn.y1;
 	int y0 = inn.y0;
 
 	for (; y0 < y1; ++y0) {
-		if (!(y0&li) && (y0&pi) != pif)
+		if (!((y0^lp)&li) && (y0&pi) != pif)
 			gpuTileSpanFn<CF>(pDst, data, count);
 		pDst += FRAME_WIDTH;
 	}
@@ -353,6 +354,19 @@ static noinline void gpuTileDriverFn(le16_t *pDst, u16 data, u32 count,
 template<int CF>
 static void TileAsm(le16_t *pDst, u16 data, u32 count, const gpu_unai_inner_t &inn)
 {
+	if (inn.ilace_mask) {
+		// asm doesn't skip lines, give it one line at a time
+		gpu_unai_inner_t inn1 = inn;
+		inn1.ilace_mask = 0;
+		for (s32 y = inn.y0; y < inn.y1; y++, pDst += FRAME_WIDTH) {
+			if ((y ^ inn.ilace_parity) & inn.ilace_mask)
+				continue;
+			inn1.y0 = y;
+			inn1.y1 = y + 1;
+			TileAsm<CF>(pDst, data, count, inn1);
+		}
+		return;
+	}
 	switch (CF) {
 	case 0x02: tile_driver_st0_asm(pDst, data, count, &inn); return;
 	case 0x0a: tile_driver_st1_asm(pDst, data, count, &inn); return;
@@ -435,7 +449,7 @@ static noinline void gpuSpriteDriverFn(le16_t *pPixel, u32 count, const u8 *pTxt
 
 	const le16_t *CBA_; if (CF_TEXTMODE!=3) CBA_ = inn.CBA;
 	const u32 v0_mask = inn.v_msk >> 10;
-	s32 y0 = inn.y0, y1 = inn.y1, li = inn.ilace_mask;
+	s32 y0 = inn.y0, y1 = inn.y1, li = inn.ilace_mask, lp = inn.ilace_parity;
 	u32 u0_ = inn.u, v0 = inn.v;
 
 	if (CF_TEXTMODE==3) {
@@ -446,7 +460,7 @@ static noinline void gpuSpriteDriverFn(le16_t *pPixel, u32 count, const u8 *pTxt
 
 	for (; y0 < y1; ++y0, pPixel += FRAME_WIDTH, ++v0)
 	{
-	  if (y0 & li) continue;
+	  if ((y0 ^ lp) & li) continue;
 	  const u8 *pTxt = pTxt_base + ((v0 & v0_mask) * 2048);
 	  le16_t *pDst = pPixel;
 	  u32 u0 = u0_;
@@ -499,6 +513,20 @@ template<int CF>
 static void SpriteMaybeAsm(le16_t *pPixel, u32 count, const u8 *pTxt_base,
         const gpu_unai_inner_t &inn)
 {
+  if (inn.ilace_mask) {
+    // asm doesn't skip lines, give it one line at a time
+    gpu_unai_inner_t inn1 = inn;
+    inn1.ilace_mask = 0;
+    for (s32 y = inn.y0; y < inn.y1; y++, pPixel += FRAME_WIDTH) {
+      if ((y ^ inn.ilace_parity) & inn.ilace_mask)
+        continue;
+      inn1.y0 = y;
+      inn1.y1 = y + 1;
+      inn1.v = inn.v + (y - inn.y0);
+      SpriteMaybeAsm<CF>(pPixel, count, pTxt_base, inn1);
+    }
+    return;
+  }
 #if 1
   s32 lines = inn.y1 - inn.y0;
   u32 u1m = inn.u + count - 1, v1m = inn.v + lines - 1;
@@ -184,10 +184,17 @@ void gpuClearImage(PtrUnion packet)
 		le32_t* pixel = (le32_t*)gpu_unai.vram + ((FRAME_OFFSET(x0, y0))>>1);
 		u32 _rgb = GPU_RGB16(le32_to_u32(packet.U4[0]));
 		le32_t rgb = u32_to_le32(_rgb | (_rgb << 16));
+		// threaded mode: only this thread's lines
+		const int lb = gpu_unai.split_bit, lp = gpu_unai.inn.ilace_parity;
+		int ly = y0;
 		{
 			y0 = (FRAME_WIDTH - w0)>>1;
 			w0>>=3;
 			do {
+				if ((ly++ ^ lp) & lb) {
+					pixel += FRAME_WIDTH >> 1;
+					continue;
+				}
 				x0=w0;
 				do {
 					pixel[0] = rgb;
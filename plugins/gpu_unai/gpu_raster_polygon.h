@@ -358,13 +358,14 @@ void gpuDrawPolyF(const PtrUnion packet, const PP gpuPolySpanDriver, u32 is_quad
 
 			le16_t* PixelBase = &gpu_unai.vram[FRAME_OFFSET(0, ya)];
 			int li=gpu_unai.inn.ilace_mask;
+			int lp=gpu_unai.inn.ilace_parity;
 			int pi=(ProgressiveInterlaceEnabled()?(gpu_unai.inn.ilace_mask+1):0);
 			int pif=(ProgressiveInterlaceEnabled()?(gpu_unai.prog_ilace_flag?(gpu_unai.inn.ilace_mask+1):0):1);
 
 			for (; loop1; --loop1, ya++, PixelBase += FRAME_WIDTH,
 					x3 += dx3, x4 += dx4 )
 			{
-				if (ya&li) continue;
+				if ((ya^lp)&li) continue;
 				if ((ya&pi)==pif) continue;
 
 				xa = FixedCeilToInt(x3);  xb = FixedCeilToInt(x4);
@@ -670,6 +671,7 @@ void gpuDrawPolyFT(const PtrUnion packet, const PP gpuPolySpanDriver, u32 is_qua
 
 			le16_t* PixelBase = &gpu_unai.vram[FRAME_OFFSET(0, ya)];
 			int li=gpu_unai.inn.ilace_mask;
+			int lp=gpu_unai.inn.ilace_parity;
 			int pi=(ProgressiveInterlaceEnabled()?(gpu_unai.inn.ilace_mask+1):0);
 			int pif=(ProgressiveInterlaceEnabled()?(gpu_unai.prog_ilace_flag?(gpu_unai.inn.ilace_mask+1):0):1);
 
@@ -677,7 +679,7 @@ void gpuDrawPolyFT(const PtrUnion packet, const PP gpuPolySpanDriver, u32 is_qua
 					x3 += dx3, x4 += dx4,
 					u3 += du3, v3 += dv3 )
 			{
-				if (ya&li) continue;
+				if ((ya^lp)&li) continue;
 				if ((ya&pi)==pif) continue;
 
 				u32 u4, v4;
@@ -1016,6 +1018,7 @@ void gpuDrawPolyG(const PtrUnion packet, const PP gpuPolySpanDriver, u32 is_quad
 
 			le16_t* PixelBase = &gpu_unai.vram[FRAME_OFFSET(0, ya)];
 			int li=gpu_unai.inn.ilace_mask;
+			int lp=gpu_unai.inn.ilace_parity;
 			int pi=(ProgressiveInterlaceEnabled()?(gpu_unai.inn.ilace_mask+1):0);
 			int pif=(ProgressiveInterlaceEnabled()?(gpu_unai.prog_ilace_flag?(gpu_unai.inn.ilace_mask+1):0):1);
 
@@ -1023,7 +1026,7 @@ void gpuDrawPolyG(const PtrUnion packet, const PP gpuPolySpanDriver, u32 is_quad
 					x3 += dx3, x4 += dx4,
 					r3 += dr3, g3 += dg3, b3 += db3 )
 			{
-				if (ya&li) continue;
+				if ((ya^lp)&li) continue;
 				if ((ya&pi)==pif) continue;
 
 				u32 r4, g4, b4;
@@ -1412,6 +1415,7 @@ void gpuDrawPolyGT(const PtrUnion packet, const PP gpuPolySpanDriver, u32 is_qua
 
 			le16_t* PixelBase = &gpu_unai.vram[FRAME_OFFSET(0, ya)];
 			int li=gpu_unai.inn.ilace_mask;
+			int lp=gpu_unai.inn.ilace_parity;
 			int pi=(ProgressiveInterlaceEnabled()?(gpu_unai.inn.ilace_mask+1):0);
 			int pif=(ProgressiveInterlaceEnabled()?(gpu_unai.prog_ilace_flag?(gpu_unai.inn.ilace_mask+1):0):1);
 
@@ -1420,7 +1424,7 @@ void gpuDrawPolyGT(const PtrUnion packet, const PP gpuPolySpanDriver, u32 is_qua
 					u3 += du3, v3 += dv3,
 					r3 += dr3, g3 += dg3, b3 += db3 )
 			{
-				if (ya&li) continue;
+				if ((ya^lp)&li) continue;
 				if ((ya&pi)==pif) continue;
 
 				u32 u4, v4;
@@ -242,6 +242,10 @@ struct gpu_unai_inner_t {
 	                        //  device (320x240), will usually be set to 1
 	                        //  so odd lines are not rendered. (Unless future
 	                        //  full-screen scaling option is in use ..TODO)
+
+	u8 ilace_parity;        // Lines are skipped when (y ^ ilace_parity) &
+	                        //  ilace_mask is nonzero. Only nonzero for the
+	                        //  second thread of the threaded mode.
 };
 
 struct gpu_unai_t {
@@ -319,6 +323,9 @@ struct gpu_unai_t {
 
 	bool prog_ilace_flag;   // Tracks successive frames for 'prog_ilace' option
 
+	u8 split_bit;           // Threaded mode: line bit telling which thread
+	                        //  draws a line (see gpulib_if.cpp), 0 if off
+
 	u8 BLEND_MODE;
 	u8 TEXT_MODE;
 	u8 Masking;
@@ -336,7 +343,9 @@ static __attribute__((aligned(32))) gpu_unai_t gpu_unai;
 // Global config that frontend can alter.. Values are read in GPU_init().
 // TODO: if frontend menu modifies a setting, add a function that can notify
 // GPU plugin to use new setting.
+#ifndef GPU_UNAI_WORKER
 gpu_unai_config_t gpu_unai_config_ext;
+#endif
 
 ///////////////////////////////////////////////////////////////////////////////
 // Internal inline funcs to get option status: (Allows flexibility)
@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "../gpulib/gpu.h"
+#include "../gpulib/gpu_worker.h"
 #include "old/if.h"
 
 //#include "port.h"
@@ -59,6 +60,8 @@
 #define IS_OLD_RENDERER() false
 #endif
 
+#ifndef GPU_UNAI_WORKER
+
 int renderer_init(void)
 {
   memset((void*)&gpu_unai, 0, sizeof(gpu_unai));
@@ -107,6 +110,9 @@ int renderer_init(void)
 
 void renderer_finish(void)
 {
+#ifdef GPU_UNAI_THREADS
+  gpu_worker_stop();
+#endif
 }
 
 void renderer_notify_screen_change(const struct psx_gpu_screen *screen)
@@ -124,6 +130,7 @@ void renderer_notify_screen_change(const struct psx_gpu_screen *screen)
       gpu_unai.ilace_mask);
   */
 }
+#endif // !GPU_UNAI_WORKER
 
 #ifdef USE_GPULIB
 // Handles GP0 draw settings commands 0xE1...0xE6
@@ -228,9 +235,161 @@ static inline void textured_sprite(int &cpu_cycles_sum, int &cpu_cycles)
   gput_sum(cpu_cycles_sum, cpu_cycles, gput_sprite(w, h));
 }
 
-extern const unsigned char cmd_lengths[256];
+#ifdef GPU_UNAI_THREADS
+// Threaded mode: a long enough list is run by two threads at once, each
+// drawing every other line. gpu_unai state is global, so the second thread
+// runs a copy of this file (gpulib_if_worker.cpp) with its own gpu_unai,
+// which gets a copy of the main one before each list. Both threads go
+// through all the commands, so their state stays the same; they only need
+// to wait for each other when one could read (as a texture) or overwrite
+// what the other has drawn in this list. Lines, and prims texturing from
+// their own drawing area, are drawn by thread 0 alone.
+
+static struct {
+  u8 on, part;
+  u8 li;              // ilace_mask when not split
+  u8 serial;          // thread 0 draws everything
+  int syncs;
+  struct gpu_rect wr, rd;  // vram drawn / read as textures since the last sync
+} split;
+
+// sync counts of both threads
+extern "C" int unai_split_syncs[2];
+
+static void split_set_lines(void)
+{
+  u8 lb = split.li + 1;
+  gpu_unai.split_bit = lb;
+  if (split.serial) {
+    gpu_unai.inn.ilace_mask = split.li;
+    gpu_unai.inn.ilace_parity = 0;
+  }
+  else {
+    gpu_unai.inn.ilace_mask = split.li | lb;
+    gpu_unai.inn.ilace_parity = split.part ? lb : 0;
+  }
+}
+
+static void split_begin(int part)
+{
+  memset(&split, 0, sizeof(split));
+  split.on = 1;
+  split.part = part;
+  split.li = gpu_unai.inn.ilace_mask;
+  split_set_lines();
+}
+
+static void split_end(void)
+{
+  gpu_unai.inn.ilace_mask = split.li;
+  gpu_unai.inn.ilace_parity = 0;
+  gpu_unai.split_bit = 0;
+  split.on = 0;
+}
+
+static noinline void split_sync(void)
+{
+  int n = ++split.syncs;
+  __atomic_store_n(&unai_split_syncs[split.part], n, __ATOMIC_RELEASE);
+  while (__atomic_load_n(&unai_split_syncs[split.part ^ 1], __ATOMIC_ACQUIRE) < n)
+    CPU_RELAX();
+  memset(&split.wr, 0, sizeof(split.wr));
+  memset(&split.rd, 0, sizeof(split.rd));
+}
+
+static void split_set_serial(int serial)
+{
+  if (split.serial == serial)
+    return;
+  split_sync();
+  split.serial = serial;
+  split_set_lines();
+}
+
+// Called for each command before it's executed. Returns true if this
+// thread should skip drawing it (its state effects are done here then).
+static bool split_check(u32 cmd, const le32_t *list)
+{
+  struct gpu_rect dst, tex, clut;
+  u32 tpage = 0, tmode;
+
+  switch (cmd) {
+    case 0x02: {
+      s32 y = (s16)(le32_to_u32(list[1]) >> 16);
+      dst.x0 = 0; dst.x1 = 1024;
+      dst.y0 = y < 0 ? 0 : y;
+      dst.y1 = y + ((le32_to_u32(list[2]) >> 16) & 0x1ff);
+      break;
+    }
+    case 0x20 ... 0x3f:
+    case 0x60 ... 0x7f:
+      dst.x0 = gpu_unai.DrawingArea[0]; dst.x1 = gpu_unai.DrawingArea[2];
+      dst.y0 = gpu_unai.DrawingArea[1]; dst.y1 = gpu_unai.DrawingArea[3];
+      break;
+    case 0x40 ... 0x5f:
+      // drawn by thread 0 only, see gpuLineDriver()
+      split_set_serial(1);
+      return false;
+    default:
+      return false;
+  }
+
+  memset(&tex, 0, sizeof(tex));
+  memset(&clut, 0, sizeof(clut));
+  if (cmd != 0x02 && (cmd & 4)) {
+    if (cmd < 0x40)
+      tpage = le32_to_u32(list[(cmd & 0x10) ? 5 : 4]) >> 16;
+    else
+      tpage = gpu_unai.GPU_GP1;
+    tmode = (tpage >> 7) & 3;
+    tex.x0 = (tpage & 0x0f) << 6;
+    tex.y0 = (tpage & 0x10) << 4;
+    tex.x1 = tex.x0 + (64 << (tmode < 2 ? tmode : 2));
+    tex.y1 = tex.y0 + 256;
+    gpu_rect_wrap(&tex);
+    if (tmode < 2) {
+      u32 c = le32_to_u32(list[2]) >> 16;
+      clut.x0 = (c & 0x3f) << 4;
+      clut.y0 = (c >> 6) & 0x1ff;
+      clut.x1 = clut.x0 + (tmode ? 256 : 16);
+      clut.y1 = clut.y0 + 1;
+      gpu_rect_wrap(&clut);
+    }
+  }
+
+  // feedback effects, the order of lines matters
+  if (cmd != 0x02 && (gpu_rect_hit(&tex, &dst) || gpu_rect_hit(&clut, &dst))) {
+    split_set_serial(1);
+    if (!split.part)
+      return false;
+    if ((cmd & 0xe4) == 0x24)
+      gpuSetTexture(tpage);
+    return true;
+  }
+  split_set_serial(0);
+
+  if (gpu_rect_hit(&tex, &split.wr) || gpu_rect_hit(&clut, &split.wr)
+      || gpu_rect_hit(&dst, &split.rd))
+    split_sync();
+  gpu_rect_add(&split.wr, &dst);
+  gpu_rect_add(&split.rd, &tex);
+  gpu_rect_add(&split.rd, &clut);
+  return false;
+}
+#endif // GPU_UNAI_THREADS
+
+static inline PSD gpuLineDriver(u32 driver_idx)
+{
+#ifdef GPU_UNAI_THREADS
+  if (split.on && split.part)
+    return PixelSpanNULL;
+#endif
+  return gpuPixelSpanDrivers[driver_idx];
+}
+
+extern "C" const unsigned char cmd_lengths[256];
 
-int renderer_do_cmd_list(u32 *list_, int list_len, uint32_t *ex_regs,
+static int do_cmd_list(u32 *list_, int list_len, uint32_t *ex_regs,
  int *cycles_sum_out, int *cycles_last, int *last_cmd)
 {
   int cpu_cycles_sum = 0, cpu_cycles = *cycles_last;
@@ -239,11 +398,6 @@ int renderer_do_cmd_list(u32 *list_, int list_len, uint32_t *ex_regs,
   le32_t *list_start = list;
   le32_t *list_end = list + list_len;
 
-  if (IS_OLD_RENDERER()) {
-    return oldunai_do_cmd_list(list_, list_len, ex_regs,
-             cycles_sum_out, cycles_last, last_cmd);
-  }
-
   for (; list < list_end; list += 1 + len)
   {
     cmd = le32_to_u32(*list) >> 24;
@@ -260,6 +414,11 @@ int renderer_do_cmd_list(u32 *list_, int list_len, uint32_t *ex_regs,
 
     PtrUnion packet = { .ptr = (void*)&gpu_unai.PacketBuffer };
 
+#ifdef GPU_UNAI_THREADS
+    if (split.on && split_check(cmd, list))
+      continue;
+#endif
+
     switch (cmd)
     {
       case 0x02:
@@ -487,7 +646,7 @@ int renderer_do_cmd_list(u32 *list_, int list_len, uint32_t *ex_regs,
       case 0x43: {          // Monochrome line
         // Shift index right by one, as untextured prims don't use lighting
         u32 driver_idx = (Blending_Mode | gpu_unai.Masking | Blending | (gpu_unai.PixelMSB>>3)) >> 1;
-        PSD driver = gpuPixelSpanDrivers[driver_idx];
+        PSD driver = gpuLineDriver(driver_idx);
         gpuDrawLineF(packet, driver);
         gput_sum(cpu_cycles_sum, cpu_cycles, gput_line(0));
       } break;
@@ -498,7 +657,7 @@ int renderer_do_cmd_list(u32 *list_, int list_len, uint32_t *ex_regs,
 
         // Shift index right by one, as untextured prims don't use lighting
         u32 driver_idx = (Blending_Mode | gpu_unai.Masking | Blending | (gpu_unai.PixelMSB>>3)) >> 1;
-        PSD driver = gpuPixelSpanDrivers[driver_idx];
+        PSD driver = gpuLineDriver(driver_idx);
         gpuDrawLineF(packet, driver);
 
         while(1)
@@ -528,7 +687,7 @@ int renderer_do_cmd_list(u32 *list_, int list_len, uint32_t *ex_regs,
         u32 driver_idx = (Blending_Mode | gpu_unai.Masking | Blending | (gpu_unai.PixelMSB>>3)) >> 1;
         // Index MSB selects Gouraud-shaded PixelSpanDriver:
         driver_idx |= (1 << 5);
-        PSD driver = gpuPixelSpanDrivers[driver_idx];
+        PSD driver = gpuLineDriver(driver_idx);
         gpuDrawLineG(packet, driver);
         gput_sum(cpu_cycles_sum, cpu_cycles, gput_line(0));
       } break;
@@ -541,7 +700,7 @@ int renderer_do_cmd_list(u32 *list_, int list_len, uint32_t *ex_regs,
         u32 driver_idx = (Blending_Mode | gpu_unai.Masking | Blending | (gpu_unai.PixelMSB>>3)) >> 1;
         // Index MSB selects Gouraud-shaded PixelSpanDriver:
         driver_idx |= (1 << 5);
-        PSD driver = gpuPixelSpanDrivers[driver_idx];
+        PSD driver = gpuLineDriver(driver_idx);
         gpuDrawLineG(packet, driver);
 
         while(1)
@@ -673,6 +832,61 @@ breakloop:
   return list - list_start;
 }
 
+#ifndef GPU_UNAI_WORKER
+
+#ifdef GPU_UNAI_THREADS
+// not worth waking the worker for less
+#define SPLIT_MIN_WORDS 128
+
+void *unai_worker_state(void);
+int unai_worker_do_cmd_list(uint32_t *list, int list_len);
+
+int unai_split_syncs[2];
+
+static u32 *split_list;
+static int split_list_len;
+
+static void split_worker_func(void)
+{
+  unai_worker_do_cmd_list(split_list, split_list_len);
+}
+
+static int split_do_cmd_list(u32 *list, int list_len, uint32_t *ex_regs,
+ int *cycles_sum_out, int *cycles_last, int *last_cmd)
+{
+  int ret;
+
+  memcpy(unai_worker_state(), &gpu_unai, offsetof(gpu_unai_t, LightLUT));
+  unai_split_syncs[0] = unai_split_syncs[1] = 0;
+  split_list = list;
+  split_list_len = list_len;
+  gpu_worker_kick();
+
+  split_begin(0);
+  ret = do_cmd_list(list, list_len, ex_regs, cycles_sum_out, cycles_last, last_cmd);
+  split_end();
+
+  gpu_worker_wait();
+  return ret;
+}
+#endif // GPU_UNAI_THREADS
+
+int renderer_do_cmd_list(u32 *list, int list_len, uint32_t *ex_regs,
+ int *cycles_sum_out, int *cycles_last, int *last_cmd)
+{
+  if (IS_OLD_RENDERER()) {
+    return oldunai_do_cmd_list(list, list_len, ex_regs,
+             cycles_sum_out, cycles_last, last_cmd);
+  }
+#ifdef GPU_UNAI_THREADS
+  if (gpu_worker_running() && list_len >= SPLIT_MIN_WORDS)
+    return split_do_cmd_list(list, list_len, ex_regs,
+             cycles_sum_out, cycles_last, last_cmd);
+#endif
+  return do_cmd_list(list, list_len, ex_regs,
+           cycles_sum_out, cycles_last, last_cmd);
+}
+
 void renderer_sync_ecmds(u32 *ecmds)
 {
   if (!IS_OLD_RENDERER()) {
@@ -711,6 +925,18 @@ void renderer_set_config(const struct rearmed_cbs *cbs)
 
   renderer_notify_screen_change(&gpu.screen);
   oldunai_renderer_set_config(cbs);
+
+#ifdef GPU_UNAI_THREADS
+  if (cbs->gpu_unai.threaded && !IS_OLD_RENDERER()) {
+    // lookup tables are only set up once
+    if (!gpu_worker_running())
+      memcpy(unai_worker_state(), &gpu_unai, sizeof(gpu_unai));
+    gpu_worker_start(split_worker_func);
+  }
+  else
+    gpu_worker_stop();
+#endif
 }
+#endif // !GPU_UNAI_WORKER
 
 // vim:shiftwidth=2:expandtab
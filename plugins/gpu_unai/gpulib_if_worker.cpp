@@ -0,0 +1,46 @@
+/***************************************************************************
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License as published by  *
+*   the Free Software Foundation; either version 2 of the License, or     *
+*   (at your option) any later version.                                   *
+***************************************************************************/
+
+// The renderer again, with a gpu_unai of its own, for the second thread
+// of the dual thread mode. See gpulib_if.cpp.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../gpulib/gpu.h"
+#include "../gpulib/gpu_worker.h"
+#include "arm_features.h"
+#include "compiler_features.h"
+
+#define GPU_UNAI_WORKER
+
+// the table setup is done by the main instance
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+namespace unai_worker {
+#include "gpulib_if.cpp"
+}
+
+void *unai_worker_state(void)
+{
+  return &unai_worker::gpu_unai;
+}
+
+int unai_worker_do_cmd_list(uint32_t *list, int list_len)
+{
+  uint32_t ex_regs[8] = { 0 };
+  int dummy = 0, ret;
+
+  unai_worker::split_begin(1);
+  ret = unai_worker::do_cmd_list(list, list_len, ex_regs, &dummy, &dummy, &dummy);
+  unai_worker::split_end();
+  return ret;
+}
+
+// vim:shiftwidth=2:expandtab
@@ -169,9 +169,53 @@ static noinline void update_height(struct psx_gpu *gpu)
   //  gpu->screen.y1, gpu->screen.y2, y, sh, vres);
 }
 
+// the async renderer draws on its own thread where do_cmd_buffer can't
+// time it, it's left to the frontend's advice like before
+static int fskip_model_on(const struct psx_gpu *gpu)
+{
+  return gpu->frameskip.set < 0 && gpu->frameskip.ctl
+    && gpu->frameskip.ctl->get_usec && !gpu_async_enabled(gpu);
+}
+
+// Auto frameskip by cost. At each flip the busy time the frontend
+// reported since the previous one is split into drawing (timed in
+// do_cmd_buffer) and the rest, per vsync. Both are averaged with a 1/8
+// weight, drawing only over frames that were drawn. The next frame is
+// skipped if drawing it is predicted to take longer than the time the
+// frontend says it has, but not more than 3 in a row.
+static noinline int fskip_predict(struct psx_gpu *gpu)
+{
+  struct rearmed_fskip *ctl = gpu->frameskip.ctl;
+  int vsyncs = *gpu->state.frame_count - gpu->frameskip.last_flip_frame;
+  int render = gpu->frameskip.render_us;
+  int busy = ctl->busy_us;
+
+  ctl->busy_us = 0;
+  gpu->frameskip.render_us = 0;
+  // skip the first flip and anything after pauses or loads
+  if (0 < vsyncs && vsyncs <= 8 && busy > 0) {
+    if (render > busy)
+      render = busy;
+    ctl->cpu_us += ((busy - render) / vsyncs - ctl->cpu_us) / 8;
+    if (!gpu->frameskip.active)
+      ctl->gpu_us += (render / vsyncs - ctl->gpu_us) / 8;
+  }
+
+  if (ctl->cpu_us + ctl->gpu_us <= ctl->slack_us)
+    return 0;
+  ctl->predicted++;
+  return ctl->gpu_us > 0;
+}
+
 static noinline void decide_frameskip(struct psx_gpu *gpu)
 {
+  int predict = -1;
+
   *gpu->frameskip.dirty = 1;
+  if (fskip_model_on(gpu))
+    predict = fskip_predict(gpu);
+  else if (gpu->frameskip.ctl)
+    gpu->frameskip.ctl->busy_us = 0;
 
   if (gpu->frameskip.active)
     gpu->frameskip.cnt++;
@@ -182,6 +226,11 @@ static noinline void decide_frameskip(struct psx_gpu *gpu)
 
   if (*gpu->frameskip.force)
     gpu->frameskip.active = 1;
+  else if (predict >= 0) {
+    gpu->frameskip.active = predict && gpu->frameskip.cnt < 3;
+    if (gpu->frameskip.active)
+      gpu->frameskip.ctl->skipped++;
+  }
   else if (!gpu->frameskip.active && *gpu->frameskip.advice)
     gpu->frameskip.active = 1;
   else if (gpu->frameskip.set > 0 && gpu->frameskip.cnt < gpu->frameskip.set)
@@ -824,8 +873,11 @@ static noinline int do_cmd_buffer(struct psx_gpu *gpu, uint32_t *data, int count
       vram_dirty = 1;
     }
     else {
+      long long t0 = fskip_model_on(gpu) ? gpu->frameskip.ctl->get_usec() : 0;
       pos += renderer_do_cmd_list(data + pos, count - pos, gpu->ex_regs,
                cycles_sum, cycles_last, &cmd);
+      if (t0)
+        gpu->frameskip.render_us += gpu->frameskip.ctl->get_usec() - t0;
       vram_dirty = 1;
     }
 
@@ -1120,6 +1172,7 @@ void GPUrearmedCallbacks(const struct rearmed_cbs *cbs)
   gpu.frameskip.advice = &cbs->fskip_advice;
   gpu.frameskip.force = &cbs->fskip_force;
   gpu.frameskip.dirty = (void *)&cbs->fskip_dirty;
+  gpu.frameskip.ctl = (void *)&cbs->fskip;
   gpu.frameskip.active = 0;
   gpu.frameskip.frame_ready = 1;
   gpu.state.hcnt = (uint32_t *)cbs->gpu_hcnt;
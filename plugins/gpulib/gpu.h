@@ -115,6 +115,8 @@ struct psx_gpu {
     const int *advice;
     const int *force;
     int *dirty;
+    struct rearmed_fskip *ctl;
+    uint32_t render_us; /* since the last flip, when ctl is used */
     uint32_t last_flip_frame;
     uint32_t pending_fill[3];
   } frameskip;
@@ -14,6 +14,7 @@
 #include "gpu.h"
 #include "gpu_async.h"
 #include "gpu_timing.h"
+#include "gpu_worker.h"
 #include "../../include/arm_features.h"
 #include "../../include/compiler_features.h"
 #include "../../frontend/pcsxr-threads.h"
@@ -22,11 +23,17 @@
 #define agpu_log(...)
 
 // these constants must be power of 2
-#define AGPU_BUF_LEN    (128*1024/4u)
-#define AGPU_BUF_MASK   (AGPU_BUF_LEN - 1)
+#define AGPU_BUF_LEN    (128*1024/4u)   // initial size
+#define AGPU_BUF_LEN_MAX (1024*1024/4u) // grows up to this when it fills up
 #define AGPU_AREAS_CNT  8u
 #define AGPU_AREAS_MASK (AGPU_AREAS_CNT - 1)
 
+// don't wake a parked thread for less than this many words,
+// sync points wake it regardless
+#define AGPU_WAKE_WORDS 64
+// polls of an empty ring before the thread parks on the condvar
+#define AGPU_SPIN_COUNT 256
+
 #ifndef min
 #define min(a, b) ((b) < (a) ? (b) : (a))
 #endif
@@ -38,15 +45,12 @@
 #define FAKECMD_DMA_WRITE     0xddu
 #define FAKECMD_BREAK         0xdcu
 
-#if defined(__aarch64__) || defined(HAVE_ARMV7)
-#define BARRIER() __asm__ __volatile__ ("dmb ishst" ::: "memory")
-#elif defined(HAVE_ARMV6)
-#define BARRIER() __asm__ __volatile__ ("mcr p15, 0, %0, c7, c10, 5" :: "r"(0) : "memory")
-#else
-#define BARRIER() __asm__ __volatile__ ("" ::: "memory")
-#endif
 #define RDPOS(pos_) *(volatile uint32_t *)&(pos_)
-#define WRPOS(pos_, d_) *(volatile uint32_t *)&(pos_) = (d_)
+// acquire/release for the positions the other side writes/reads,
+// full barrier for the store->load checks around idle/wait_mode
+#define RDPOS_ACQ(pos_) __atomic_load_n(&(pos_), __ATOMIC_ACQUIRE)
+#define WRPOS_REL(pos_, d_) __atomic_store_n(&(pos_), (d_), __ATOMIC_RELEASE)
+#define FULL_BARRIER() __atomic_thread_fence(__ATOMIC_SEQ_CST)
 
 enum waitmode {
   waitmode_none = 0,
@@ -61,20 +65,27 @@ struct pos_drawarea {
   uint16_t x1, y1;
 };
 
+// Single producer (emu thread) / single consumer (gpu thread) ring.
+// The data path is lock-free: only the producer writes pos_added and
+// only the consumer writes pos_used. The lock and condvars are only
+// used to park/unpark the consumer when the ring is empty (idle) and
+// to block the producer when it has to wait (wait_mode).
 struct psx_gpu_async
 {
   uint32_t pos_added;
   uint32_t pos_used;
   uint32_t pos_target;
   enum waitmode wait_mode;
-  uint8_t exit;
-  uint8_t idle;
+  uint32_t exit;
+  uint32_t idle;
   sthread_t *thread;
   slock_t *lock;
   scond_t *cond_use;
   scond_t *cond_add;
   uint32_t ex_regs[8]; // used by vram copy at least
-  uint32_t cmd_buffer[AGPU_BUF_LEN];
+  uint32_t *cmd_buffer;
+  uint32_t buf_len;    // power of 2, only changes while idle and empty
+  uint32_t buf_mask;
   uint32_t pos_area;
   struct pos_drawarea draw_areas[AGPU_AREAS_CNT];
 };
@@ -121,6 +132,8 @@ static int do_set_interlace(struct psx_gpu *gpu,
 static int do_dma_write(struct psx_gpu *gpu,
     const union cmd_dma_write *cmd, uint32_t pos);
 
+static void agpu_sync(struct psx_gpu_async *agpu);
+
 static void run_thread_nolock(struct psx_gpu_async *agpu)
 {
   if (agpu->idle) {
@@ -129,21 +142,66 @@ static void run_thread_nolock(struct psx_gpu_async *agpu)
   }
 }
 
+// must be called after pos_added is published; the lock is only
+// taken if the thread is (about to be) parked
 static void run_thread(struct psx_gpu_async *agpu)
 {
+  FULL_BARRIER(); // pairs with agpu_park()
+  if (!RDPOS(agpu->idle))
+    return;
+  slock_lock(agpu->lock);
+  run_thread_nolock(agpu);
+  slock_unlock(agpu->lock);
+}
+
+// same, but leave a parked thread alone until there is enough work queued
+static void run_thread_batched(struct psx_gpu_async *agpu)
+{
+  FULL_BARRIER();
+  if (!RDPOS(agpu->idle))
+    return;
+  if (agpu->pos_added - RDPOS(agpu->pos_used) < AGPU_WAKE_WORDS)
+    return;
   slock_lock(agpu->lock);
   run_thread_nolock(agpu);
   slock_unlock(agpu->lock);
 }
 
+// parked with nothing queued, so renderer state can be touched directly
+static int agpu_is_idle(struct psx_gpu_async *agpu)
+{
+  return RDPOS_ACQ(agpu->idle) && agpu->pos_added == RDPOS_ACQ(agpu->pos_used);
+}
+
 static int calc_space_for_add(struct psx_gpu_async *agpu, uint32_t pos_added)
 {
-  int space = AGPU_BUF_LEN - (pos_added - RDPOS(agpu->pos_used));
+  int space = agpu->buf_len - (pos_added - RDPOS_ACQ(agpu->pos_used));
   assert(space >= 0);
-  assert(space <= AGPU_BUF_LEN);
+  assert(space <= (int)agpu->buf_len);
   return space;
 }
 
+// called with the ring empty and the thread parked
+static void try_grow_buffer(struct psx_gpu_async *agpu)
+{
+  uint32_t len = agpu->buf_len * 2;
+  uint32_t *buf;
+
+  if (len > AGPU_BUF_LEN_MAX)
+    return;
+  assert(agpu->idle && agpu->pos_added == agpu->pos_used);
+  buf = malloc(len * 4);
+  if (buf == NULL)
+    return;
+  SysPrintf("gpu thread: cmd buffer %uK -> %uK\n", agpu->buf_len / 256, len / 256);
+  free(agpu->cmd_buffer);
+  agpu->cmd_buffer = buf;
+  agpu->buf_len = len;
+  agpu->buf_mask = len - 1;
+  // the thread only looks at these after being woken through the lock
+  FULL_BARRIER();
+}
+
 // adds everything or nothing, else we may get incomplete cmd
 static int do_add_pos(struct psx_gpu_async *agpu, const void *list, int list_words,
     uint32_t *pos_added_)
@@ -151,13 +209,13 @@ static int do_add_pos(struct psx_gpu_async *agpu, const void *list, int list_wor
   int pos, space, left, retval = 0;
   uint32_t pos_added = *pos_added_;
 
-  assert(list_words < AGPU_BUF_LEN);
+  assert(list_words < (int)agpu->buf_len);
   space = calc_space_for_add(agpu, pos_added);
   if (space < list_words)
     return 0;
 
-  pos = pos_added & AGPU_BUF_MASK;
-  left = AGPU_BUF_LEN - pos;
+  pos = pos_added & agpu->buf_mask;
+  left = agpu->buf_len - pos;
   if (left < list_words) {
     memset(&agpu->cmd_buffer[pos], 0, left * 4);
     pos_added += left;
@@ -177,11 +235,32 @@ static int do_add(struct psx_gpu_async *agpu, const void *list, int list_words)
 {
   uint32_t pos_added = agpu->pos_added;
   int ret = do_add_pos(agpu, list, list_words, &pos_added);
-  BARRIER();
-  WRPOS(agpu->pos_added, pos_added);
+  WRPOS_REL(agpu->pos_added, pos_added);
   return ret;
 }
 
+// block (with the lock held) until the thread sets wait_mode back to none
+static void wait_for_thread(struct psx_gpu_async *agpu, enum waitmode mode)
+{
+  assert(agpu->wait_mode == waitmode_none);
+  run_thread_nolock(agpu);
+  agpu->wait_mode = mode;
+  FULL_BARRIER(); // pairs with check_waiter()
+  for (;;) {
+    uint32_t pos_used = RDPOS_ACQ(agpu->pos_used);
+    if (mode == waitmode_full && agpu->idle && agpu->pos_added == pos_used)
+      break;
+    if (mode == waitmode_target && (int32_t)(pos_used - agpu->pos_target) >= 0)
+      break;
+    if (mode == waitmode_progress && agpu->pos_added - pos_used < agpu->buf_len)
+      break;
+    if (agpu->wait_mode == waitmode_none)
+      break;
+    scond_wait(agpu->cond_add, agpu->lock);
+  }
+  agpu->wait_mode = waitmode_none;
+}
+
 static void do_add_with_wait(struct psx_gpu_async *agpu,
     const void *list, int list_words)
 {
@@ -189,13 +268,17 @@ static void do_add_with_wait(struct psx_gpu_async *agpu,
   {
     if (do_add(agpu, list, list_words))
       break;
+    if (agpu->buf_len < AGPU_BUF_LEN_MAX) {
+      // stall once to enlarge the buffer instead of repeatedly later
+      agpu_sync(agpu);
+      slock_lock(agpu->lock);
+      try_grow_buffer(agpu);
+      slock_unlock(agpu->lock);
+      continue;
+    }
     slock_lock(agpu->lock);
-    run_thread_nolock(agpu);
-    while (list_words > AGPU_BUF_LEN - (agpu->pos_added - RDPOS(agpu->pos_used))) {
-      assert(!agpu->idle);
-      assert(agpu->wait_mode == waitmode_none);
-      agpu->wait_mode = waitmode_progress;
-      scond_wait(agpu->cond_add, agpu->lock);
+    while (list_words > (int)(agpu->buf_len - (agpu->pos_added - RDPOS_ACQ(agpu->pos_used)))) {
+      wait_for_thread(agpu, waitmode_progress);
     }
     slock_unlock(agpu->lock);
   }
@@ -374,8 +457,10 @@ int gpu_async_do_cmd_list(struct psx_gpu *gpu, const uint32_t *list_data, int li
     }
   }
 breakloop:
-  if (pos_handled && (rendered_anything || pos_handled < pos))
+  if (pos_handled && pos_handled < pos)
     run_thread(agpu);
+  else if (pos_handled && rendered_anything)
+    run_thread_batched(agpu);
   if (pos_handled < pos) {
     // note: this is poorly implemented (wrong pos_added for draw_areas)
     int left = pos - pos_handled;
@@ -404,11 +489,11 @@ int gpu_async_try_dma(struct psx_gpu *gpu, const uint32_t *data, int words)
   if (!agpu)
     return 0;
   // avoid double copying
-  used = agpu->pos_added - RDPOS(agpu->pos_used);
-  if (RDPOS(agpu->idle) && used == 0)
+  used = agpu->pos_added - RDPOS_ACQ(agpu->pos_used);
+  if (RDPOS_ACQ(agpu->idle) && used == 0)
     return 0;
   // only proceed if there is space to avoid messy sync
-  if (AGPU_BUF_LEN - used < sizeof(cmd) / 4 + ((w + 1) / 2) * (h + 1)) {
+  if (agpu->buf_len - used < sizeof(cmd) / 4 + ((w + 1) / 2) * (h + 1)) {
     agpu_log(gpu, "agpu: dma: used %d\n", used);
     return 0;
   }
@@ -429,54 +514,97 @@ int gpu_async_try_dma(struct psx_gpu *gpu, const uint32_t *data, int words)
   }
   assert(!bad); (void)bad;
 
+  WRPOS_REL(agpu->pos_added, pos_added);
+  run_thread(agpu);
+
+  return 1;
+}
+
+// let a waiting emu thread know about progress, called after pos_used update
+static void check_waiter(struct psx_gpu_async *agpu)
+{
+  FULL_BARRIER(); // pairs with wait_for_thread()
+  switch (RDPOS(agpu->wait_mode)) {
+    case waitmode_target:
+    case waitmode_progress:
+      break;
+    default:
+      return;
+  }
   slock_lock(agpu->lock);
-  agpu->pos_added = pos_added;
-  run_thread_nolock(agpu);
+  switch (agpu->wait_mode) {
+    case waitmode_target:
+      if ((int32_t)(agpu->pos_used - agpu->pos_target) < 0)
+        break;
+      // fallthrough
+    case waitmode_progress:
+      agpu->wait_mode = waitmode_none;
+      scond_signal(agpu->cond_add);
+      break;
+    default:
+      break;
+  }
   slock_unlock(agpu->lock);
+}
 
-  return 1;
+// the ring is empty and everything is flushed, sleep until run_thread()
+static void agpu_park(struct psx_gpu_async *agpu)
+{
+  slock_lock(agpu->lock);
+  WRPOS_REL(agpu->idle, 1);
+  FULL_BARRIER(); // pairs with run_thread()
+  if (RDPOS_ACQ(agpu->pos_added) != agpu->pos_used) {
+    // raced with an add that didn't see idle set
+    agpu->idle = 0;
+    slock_unlock(agpu->lock);
+    return;
+  }
+  switch (agpu->wait_mode) {
+    case waitmode_full:
+    case waitmode_target:
+      agpu->wait_mode = waitmode_none;
+      scond_signal(agpu->cond_add);
+      break;
+    case waitmode_none:
+      break;
+    default:
+      assert(0);
+  }
+  while (agpu->idle && !agpu->exit)
+    scond_wait(agpu->cond_use, agpu->lock);
+  slock_unlock(agpu->lock);
 }
 
 static STRHEAD_RET_TYPE gpu_async_thread(void *unused)
 {
   struct psx_gpu *gpup = &gpu;
   struct psx_gpu_async *agpu = gpup->async;
-  int dirty = 0;
+  int dirty = 0, spin = 0;
 
   assert(agpu);
-  slock_lock(agpu->lock);
-  while (!agpu->exit)
+  while (!RDPOS(agpu->exit))
   {
-    int len = RDPOS(agpu->pos_added) - agpu->pos_used;
-    int pos = agpu->pos_used & AGPU_BUF_MASK;
+    uint32_t pos_used = agpu->pos_used;
+    int len = RDPOS_ACQ(agpu->pos_added) - pos_used;
+    int pos = pos_used & agpu->buf_mask;
     int done, cycles_dummy = 0, cmd = -1;
     assert(len >= 0);
-    if (len == 0 && !dirty) {
-      switch (agpu->wait_mode) {
-        case waitmode_full:
-        case waitmode_target:
-          agpu->wait_mode = waitmode_none;
-          scond_signal(agpu->cond_add);
-          break;
-        case waitmode_none:
-          break;
-        default:
-          assert(0);
+    if (len == 0) {
+      if (dirty) {
+        renderer_flush_queues();
+        dirty = 0;
+      }
+      else if (spin++ < AGPU_SPIN_COUNT && RDPOS(agpu->wait_mode) == waitmode_none)
+        CPU_RELAX();
+      else {
+        spin = 0;
+        agpu_park(agpu);
       }
-      agpu->idle = 1;
-      scond_wait(agpu->cond_use, agpu->lock);
-      continue;
-    }
-    slock_unlock(agpu->lock);
-
-    if (len == 0 && dirty) {
-      renderer_flush_queues();
-      dirty = 0;
-      slock_lock(agpu->lock);
       continue;
     }
+    spin = 0;
 
-    len = min(len, AGPU_BUF_LEN - pos);
+    len = min(len, (int)agpu->buf_len - pos);
     done = renderer_do_cmd_list(agpu->cmd_buffer + pos, len, agpu->ex_regs,
              &cycles_dummy, &cycles_dummy, &cmd);
     if (done != len) {
@@ -507,22 +635,9 @@ static STRHEAD_RET_TYPE gpu_async_thread(void *unused)
 
     dirty = 1;
     assert(done > 0);
-    slock_lock(agpu->lock);
-    agpu->pos_used += done;
-    switch (agpu->wait_mode) {
-      case waitmode_target:
-        if ((int32_t)(agpu->pos_used - agpu->pos_target) < 0)
-          break;
-        // fallthrough
-      case waitmode_progress:
-        agpu->wait_mode = waitmode_none;
-        scond_signal(agpu->cond_add);
-        break;
-      default:
-        break;
-    }
+    WRPOS_REL(agpu->pos_used, pos_used + done);
+    check_waiter(agpu);
   }
-  slock_unlock(agpu->lock);
   STRHEAD_RETURN();
 }
 
@@ -533,7 +648,7 @@ void gpu_async_notify_screen_change(struct psx_gpu *gpu)
 
   if (!agpu)
     return;
-  if (RDPOS(agpu->idle) && agpu->pos_added == RDPOS(agpu->pos_used)) {
+  if (agpu_is_idle(agpu)) {
     renderer_notify_screen_change(&gpu->screen);
     return;
   }
@@ -568,7 +683,7 @@ void gpu_async_set_interlace(struct psx_gpu *gpu, int enable, int is_odd)
 
   if (!agpu)
     return;
-  if (RDPOS(agpu->idle) && agpu->pos_added == RDPOS(agpu->pos_used)) {
+  if (agpu_is_idle(agpu)) {
     renderer_flush_queues();
     renderer_set_interlace(enable, is_odd);
     return;
@@ -599,10 +714,10 @@ static int do_dma_write(struct psx_gpu *gpu,
 
   pos += sizeof(*cmd) / 4u;
   done += sizeof(*cmd) / 4u;
-  assert(pos <= AGPU_BUF_LEN);
+  assert(pos <= agpu->buf_len);
   for (; h > 0; h--, y++) {
-    if (stride > AGPU_BUF_LEN - pos) {
-      done += AGPU_BUF_LEN - pos;
+    if (stride > agpu->buf_len - pos) {
+      done += agpu->buf_len - pos;
       pos = 0;
     }
 
@@ -615,28 +730,25 @@ static int do_dma_write(struct psx_gpu *gpu,
   return done;
 }
 
-void gpu_async_sync(struct psx_gpu *gpu)
+static void agpu_sync(struct psx_gpu_async *agpu)
 {
-  struct psx_gpu_async *agpu = gpu->async;
-
-  if (!agpu || (RDPOS(agpu->idle) && agpu->pos_added == RDPOS(agpu->pos_used)))
+  if (agpu_is_idle(agpu))
     return;
-  agpu_log(gpu, "agpu: sync %d\n", agpu->pos_added - agpu->pos_used);
+  agpu_log(&gpu, "agpu: sync %d\n", agpu->pos_added - agpu->pos_used);
   slock_lock(agpu->lock);
-  if (agpu->idle && agpu->pos_added != RDPOS(agpu->pos_used)) {
-    agpu_log(gpu, "agpu: idle %d\n", agpu->pos_added - agpu->pos_used);
-    run_thread_nolock(agpu);
-  }
-  if (!agpu->idle) {
-    assert(agpu->wait_mode == waitmode_none);
-    agpu->wait_mode = waitmode_full;
-    scond_wait(agpu->cond_add, agpu->lock);
-  }
+  if (!agpu->idle || agpu->pos_added != RDPOS_ACQ(agpu->pos_used))
+    wait_for_thread(agpu, waitmode_full);
   slock_unlock(agpu->lock);
   assert(agpu->pos_added == agpu->pos_used);
   assert(agpu->idle);
 }
 
+void gpu_async_sync(struct psx_gpu *gpu)
+{
+  if (gpu->async)
+    agpu_sync(gpu->async);
+}
+
 void gpu_async_sync_scanout(struct psx_gpu *gpu)
 {
   struct psx_gpu_async *agpu = gpu->async;
@@ -647,9 +759,9 @@ void gpu_async_sync_scanout(struct psx_gpu *gpu)
 
   if (!agpu)
     return;
-  pos = RDPOS(agpu->pos_used);
-  if (RDPOS(agpu->idle) && agpu->pos_added == pos)
+  if (agpu_is_idle(agpu))
     return;
+  pos = RDPOS_ACQ(agpu->pos_used);
   i = agpu->pos_area;
   if (agpu->idle)
     /* unlikely but possible - do a full sync */;
@@ -677,7 +789,7 @@ void gpu_async_sync_scanout(struct psx_gpu *gpu)
           area_x0, area_y0, area_x1 - area_x0, area_y1 - area_y0);
         break;
       }
-      pos = RDPOS(agpu->pos_used);
+      pos = RDPOS_ACQ(agpu->pos_used);
       if (pos >= agpu->draw_areas[i].pos)
         return;
     }
@@ -686,11 +798,9 @@ void gpu_async_sync_scanout(struct psx_gpu *gpu)
       agpu_log(gpu, "agpu: wait %d/%d\n", agpu->draw_areas[i].pos - agpu->pos_used,
           agpu->pos_added - agpu->pos_used);
       slock_lock(agpu->lock);
-      if (!agpu->idle) {
-        assert(agpu->wait_mode == waitmode_none);
+      if (!agpu->idle || agpu->pos_added != agpu->pos_used) {
         agpu->pos_target = agpu->draw_areas[i].pos + 1;
-        agpu->wait_mode = waitmode_target;
-        scond_wait(agpu->cond_add, agpu->lock);
+        wait_for_thread(agpu, waitmode_target);
       }
       slock_unlock(agpu->lock);
       return;
@@ -704,7 +814,7 @@ void gpu_async_sync_ecmds(struct psx_gpu *gpu)
   struct psx_gpu_async *agpu = gpu->async;
   if (!agpu)
     return;
-  if (RDPOS(agpu->idle) && agpu->pos_added == RDPOS(agpu->pos_used))
+  if (agpu_is_idle(agpu))
     memcpy(agpu->ex_regs + 1, gpu->ex_regs + 1, 6*4);
   else
     do_add_with_wait(agpu, gpu->ex_regs + 1, 6);
@@ -712,9 +822,9 @@ void gpu_async_sync_ecmds(struct psx_gpu *gpu)
 
 static void psx_gpu_async_free(struct psx_gpu_async *agpu)
 {
-  agpu->exit = 1;
   if (agpu->lock) {
     slock_lock(agpu->lock);
+    agpu->exit = 1;
     if (agpu->cond_use)
       scond_signal(agpu->cond_use);
     slock_unlock(agpu->lock);
@@ -726,6 +836,7 @@ static void psx_gpu_async_free(struct psx_gpu_async *agpu)
   if (agpu->cond_add) { scond_free(agpu->cond_add); agpu->cond_add = NULL; }
   if (agpu->cond_use) { scond_free(agpu->cond_use); agpu->cond_use = NULL; }
   if (agpu->lock)     { slock_free(agpu->lock); agpu->lock = NULL; }
+  free(agpu->cmd_buffer);
   free(agpu);
 }
 
@@ -748,10 +859,13 @@ void gpu_async_start(struct psx_gpu *gpu)
 
   agpu = calloc(1, sizeof(*agpu));
   if (agpu) {
+    agpu->buf_len = AGPU_BUF_LEN;
+    agpu->buf_mask = AGPU_BUF_LEN - 1;
+    agpu->cmd_buffer = malloc(AGPU_BUF_LEN * 4);
     agpu->lock = slock_new();
     agpu->cond_add = scond_new();
     agpu->cond_use = scond_new();
-    if (agpu->lock && agpu->cond_add && agpu->cond_use) {
+    if (agpu->cmd_buffer && agpu->lock && agpu->cond_add && agpu->cond_use) {
       gpu->async = agpu;
       agpu->thread = pcsxr_sthread_create(gpu_async_thread, PCSXRT_GPU);
     }
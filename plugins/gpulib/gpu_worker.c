@@ -0,0 +1,107 @@
+/*
+ * This work is licensed under the terms of any of these licenses
+ * (at your option):
+ *  - GNU GPL, version 2 or later.
+ *  - GNU LGPL, version 2.1 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "gpu_worker.h"
+#include "../../frontend/pcsxr-threads.h"
+
+// polls for a new job before the worker parks on the condvar
+#define WORKER_SPIN_COUNT 1024
+
+static struct {
+  sthread_t *thread;
+  slock_t *lock;
+  scond_t *cond;
+  void (*func)(void);
+  int job, done;
+  int parked;
+  int exit;
+} worker;
+
+static STRHEAD_RET_TYPE worker_thread(void *unused)
+{
+  int job, seen = 0, spins;
+
+  for (;;) {
+    spins = 0;
+    while ((job = __atomic_load_n(&worker.job, __ATOMIC_ACQUIRE)) == seen) {
+      if (++spins < WORKER_SPIN_COUNT) {
+        CPU_RELAX();
+        continue;
+      }
+      slock_lock(worker.lock);
+      __atomic_store_n(&worker.parked, 1, __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+      if (__atomic_load_n(&worker.job, __ATOMIC_RELAXED) == seen)
+        scond_wait(worker.cond, worker.lock);
+      __atomic_store_n(&worker.parked, 0, __ATOMIC_RELAXED);
+      slock_unlock(worker.lock);
+      spins = 0;
+    }
+    seen = job;
+    if (worker.exit)
+      break;
+    worker.func();
+    __atomic_store_n(&worker.done, job, __ATOMIC_RELEASE);
+  }
+  STRHEAD_RETURN();
+}
+
+void gpu_worker_kick(void)
+{
+  __atomic_store_n(&worker.job, worker.job + 1, __ATOMIC_RELEASE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&worker.parked, __ATOMIC_RELAXED)) {
+    slock_lock(worker.lock);
+    scond_signal(worker.cond);
+    slock_unlock(worker.lock);
+  }
+}
+
+void gpu_worker_wait(void)
+{
+  while (__atomic_load_n(&worker.done, __ATOMIC_ACQUIRE) != worker.job)
+    CPU_RELAX();
+}
+
+int gpu_worker_running(void)
+{
+  return worker.thread != NULL;
+}
+
+void gpu_worker_stop(void)
+{
+  if (worker.thread) {
+    worker.exit = 1;
+    gpu_worker_kick();
+    sthread_join(worker.thread);
+    worker.thread = NULL;
+  }
+  if (worker.cond) { scond_free(worker.cond); worker.cond = NULL; }
+  if (worker.lock) { slock_free(worker.lock); worker.lock = NULL; }
+}
+
+int gpu_worker_start(void (*func)(void))
+{
+  if (worker.thread)
+    return 0;
+  worker.job = worker.done = worker.exit = 0;
+  worker.func = func;
+  worker.lock = slock_new();
+  worker.cond = scond_new();
+  if (worker.lock && worker.cond)
+    worker.thread = pcsxr_sthread_create(worker_thread, PCSXRT_GPU);
+  if (!worker.thread) {
+    fprintf(stderr, "gpulib: failed to start the worker thread\n");
+    gpu_worker_stop();
+    return -1;
+  }
+  return 0;
+}
+
+// vim:shiftwidth=2:expandtab
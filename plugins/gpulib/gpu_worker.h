@@ -0,0 +1,65 @@
+#ifndef __GPULIB_GPU_WORKER_H__
+#define __GPULIB_GPU_WORKER_H__
+
+// Shared by the renderers that draw a long cmd list with two threads at
+// once: the second thread, the vram rects they track to know when one
+// has to wait for the other, and the spin hint for those waits.
+
+#if defined(__aarch64__) || defined(HAVE_ARMV7)
+#define CPU_RELAX() __asm__ __volatile__ ("yield" ::: "memory")
+#elif defined(__i386__) || defined(__x86_64__)
+#define CPU_RELAX() __asm__ __volatile__ ("pause" ::: "memory")
+#else
+#define CPU_RELAX() __asm__ __volatile__ ("" ::: "memory")
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// vram area, x1/y1 exclusive, empty when x0 >= x1
+struct gpu_rect { int x0, y0, x1, y1; };
+
+static inline int gpu_rect_hit(const struct gpu_rect *a, const struct gpu_rect *b)
+{
+  return a->x0 < b->x1 && b->x0 < a->x1 && a->y0 < b->y1 && b->y0 < a->y1;
+}
+
+static inline void gpu_rect_add(struct gpu_rect *a, const struct gpu_rect *b)
+{
+  if (b->x0 >= b->x1)
+    return;
+  if (a->x0 >= a->x1) {
+    *a = *b;
+    return;
+  }
+  if (b->x0 < a->x0) a->x0 = b->x0;
+  if (b->y0 < a->y0) a->y0 = b->y0;
+  if (b->x1 > a->x1) a->x1 = b->x1;
+  if (b->y1 > a->y1) a->y1 = b->y1;
+}
+
+// reads past the right edge of vram continue on the next line
+static inline void gpu_rect_wrap(struct gpu_rect *a)
+{
+  if (a->x1 > 1024) {
+    a->x0 = 0; a->x1 = 1024;
+    a->y1++;
+  }
+}
+
+// One worker per renderer. It spins for a while after each job and then
+// parks, so back to back lists don't pay for a wakeup.
+int  gpu_worker_start(void (*func)(void));
+void gpu_worker_stop(void);
+int  gpu_worker_running(void);
+// func runs once more on the worker; what was written before is visible to it
+void gpu_worker_kick(void);
+// waits for the last kick's func to return
+void gpu_worker_wait(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __GPULIB_GPU_WORKER_H__
@@ -0,0 +1,237 @@
+/*
+ * Finds the first place where two execution traces disagree,
+ * see libpcsxcore/psxtrace.h for the format and how records are matched.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../libpcsxcore/psxtrace.h"
+
+static const char * const reg_names[PSXTR_REG_COUNT] = {
+	"r0", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+	"t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+	"s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+	"t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra",
+	"lo", "hi", "sr", "cause", "epc",
+};
+
+struct trace {
+	const char *name;
+	FILE *f;
+	struct psxTraceHeader hdr;
+	unsigned long long recno;
+	unsigned int regs[PSXTR_REG_COUNT];
+	// last record read
+	int type;
+	unsigned int pc, cycle, event, istat, ram, spad;
+	unsigned long long mask;
+};
+
+static unsigned int get32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static int read_bytes(struct trace *t, unsigned char *buf, size_t len)
+{
+	if (fread(buf, 1, len, t->f) == len)
+		return 1;
+	if (len)
+		fprintf(stderr, "%s: truncated record %llu\n", t->name, t->recno);
+	return 0;
+}
+
+static int trace_open(struct trace *t, const char *name)
+{
+	memset(t, 0, sizeof(*t));
+	t->name = name;
+	t->f = fopen(name, "rb");
+	if (t->f == NULL) {
+		perror(name);
+		return -1;
+	}
+	if (fread(&t->hdr, 1, sizeof(t->hdr), t->f) != sizeof(t->hdr)
+	    || memcmp(t->hdr.magic, PSXTR_MAGIC, sizeof(t->hdr.magic))
+	    || get32((unsigned char *)&t->hdr.version) != PSXTR_VERSION) {
+		fprintf(stderr, "%s: not a v%d trace\n", name, PSXTR_VERSION);
+		return -1;
+	}
+	t->hdr.core[sizeof(t->hdr.core) - 1] = 0;
+	return 0;
+}
+
+static void trace_rewind(struct trace *t)
+{
+	fseek(t->f, sizeof(t->hdr), SEEK_SET);
+	memset(t->regs, 0, sizeof(t->regs));
+	t->recno = 0;
+}
+
+// read the next record, steps are applied to regs[]
+static int trace_next(struct trace *t)
+{
+	unsigned char b[PSXTR_REG_COUNT * 4];
+	int c, i, n;
+
+	c = fgetc(t->f);
+	if (c == EOF)
+		return 0;
+	t->type = c;
+	t->recno++;
+	switch (c) {
+	case PSXTR_STEP:
+		if (!read_bytes(t, b, 16))
+			return 0;
+		t->pc = get32(b);
+		t->cycle = get32(b + 4);
+		t->mask = get32(b + 8) | ((unsigned long long)get32(b + 12) << 32);
+		for (i = n = 0; i < PSXTR_REG_COUNT; i++)
+			n += (t->mask >> i) & 1;
+		if (!read_bytes(t, b, n * 4))
+			return 0;
+		for (i = n = 0; i < PSXTR_REG_COUNT; i++)
+			if ((t->mask >> i) & 1)
+				t->regs[i] = get32(b + 4 * n++);
+		return 1;
+	case PSXTR_EVENT:
+		if (!read_bytes(t, b, 13))
+			return 0;
+		t->pc = get32(b);
+		t->cycle = get32(b + 4);
+		t->event = b[8];
+		t->istat = get32(b + 9);
+		return 1;
+	case PSXTR_MEM:
+		if (!read_bytes(t, b, 12))
+			return 0;
+		t->cycle = get32(b);
+		t->ram = get32(b + 4);
+		t->spad = get32(b + 8);
+		return 1;
+	}
+	fprintf(stderr, "%s: bad record type %d at %llu\n", t->name, c, t->recno);
+	return 0;
+}
+
+static int trace_next_of(struct trace *t, int type1, int type2)
+{
+	while (trace_next(t))
+		if (t->type == type1 || t->type == type2)
+			return 1;
+	return 0;
+}
+
+static void print_regs(const struct trace *a, const struct trace *b)
+{
+	int i;
+
+	for (i = 0; i < PSXTR_REG_COUNT; i++) {
+		if (a->regs[i] == b->regs[i])
+			continue;
+		printf("  %-5s %08x %08x\n", reg_names[i], a->regs[i], b->regs[i]);
+	}
+}
+
+/*
+ * Steps are matched by cycle and pc, the side that is behind skips
+ * ahead. Returns the record number in a of the first mismatch, or 0.
+ */
+static unsigned long long diff_steps(struct trace *a, struct trace *b,
+	unsigned long long *matched)
+{
+	unsigned int last_pc = 0, last_cycle = 0;
+	int ha, hb;
+	int d;
+
+	ha = trace_next_of(a, PSXTR_STEP, PSXTR_STEP);
+	hb = trace_next_of(b, PSXTR_STEP, PSXTR_STEP);
+	while (ha && hb) {
+		d = (int)(a->cycle - b->cycle);
+		if (d < 0) {
+			ha = trace_next_of(a, PSXTR_STEP, PSXTR_STEP);
+			continue;
+		}
+		if (d > 0) {
+			hb = trace_next_of(b, PSXTR_STEP, PSXTR_STEP);
+			continue;
+		}
+		if (a->pc != b->pc || memcmp(a->regs, b->regs, sizeof(a->regs))) {
+			printf("step mismatch at cycle %08x (records %llu, %llu)\n",
+				a->cycle, a->recno, b->recno);
+			printf("  last match: pc %08x cycle %08x\n", last_pc, last_cycle);
+			printf("  %-5s %08x %08x\n", "pc", a->pc, b->pc);
+			print_regs(a, b);
+			return a->recno;
+		}
+		last_pc = a->pc;
+		last_cycle = a->cycle;
+		(*matched)++;
+		ha = trace_next_of(a, PSXTR_STEP, PSXTR_STEP);
+		hb = trace_next_of(b, PSXTR_STEP, PSXTR_STEP);
+	}
+	return 0;
+}
+
+// events and memory hashes, one by one in order
+static unsigned long long diff_events(struct trace *a, struct trace *b,
+	unsigned long long *matched)
+{
+	int ha, hb;
+
+	for (;;) {
+		ha = trace_next_of(a, PSXTR_EVENT, PSXTR_MEM);
+		hb = trace_next_of(b, PSXTR_EVENT, PSXTR_MEM);
+		if (!ha || !hb) {
+			if (ha != hb)
+				printf("%s has more events\n", ha ? a->name : b->name);
+			return 0;
+		}
+		if (a->type != b->type || a->cycle != b->cycle
+		    || (a->type == PSXTR_EVENT && (a->event != b->event
+		        || a->pc != b->pc || a->istat != b->istat))
+		    || (a->type == PSXTR_MEM && (a->ram != b->ram
+		        || a->spad != b->spad)))
+			break;
+		(*matched)++;
+	}
+
+	printf("event mismatch after %llu matched (records %llu, %llu)\n",
+		*matched, a->recno, b->recno);
+	if (a->type == PSXTR_MEM && b->type == PSXTR_MEM)
+		printf("  cycle %08x %08x ram %08x %08x scratchpad %08x %08x\n",
+			a->cycle, b->cycle, a->ram, b->ram, a->spad, b->spad);
+	else
+		printf("  cycle %08x %08x pc %08x %08x event %02x %02x i_stat %04x %04x\n",
+			a->cycle, b->cycle, a->pc, b->pc, a->event, b->event,
+			a->istat, b->istat);
+	return a->recno;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long long step_rec, ev_rec, steps = 0, events = 0;
+	struct trace a, b;
+
+	if (argc != 3) {
+		fprintf(stderr, "usage:\n%s <trace_a> <trace_b>\n", argv[0]);
+		return 1;
+	}
+	if (trace_open(&a, argv[1]) || trace_open(&b, argv[2]))
+		return 1;
+	printf("%s: %s\n%s: %s\n", a.name, a.hdr.core, b.name, b.hdr.core);
+
+	step_rec = diff_steps(&a, &b, &steps);
+	trace_rewind(&a);
+	trace_rewind(&b);
+	ev_rec = diff_events(&a, &b, &events);
+
+	if (!step_rec && !ev_rec) {
+		printf("no divergence (%llu steps, %llu events matched)\n",
+			steps, events);
+		return 0;
+	}
+	if (step_rec && ev_rec)
+		printf("first divergence: the %s mismatch\n",
+			step_rec < ev_rec ? "step" : "event");
+	return 2;
+}